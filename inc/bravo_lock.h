@@ -0,0 +1,68 @@
+#ifndef BRAVO_LOCK_H
+#define BRAVO_LOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Number of reader slots of a lock. Threads are spread over them, so
+  readers of different threads rarely write the same cache line */
+#define BRAVO_SLOTS (64)
+
+/* Size of a reader slot, one cache line */
+#define BRAVO_SLOT_SIZE (64)
+
+/* After revoking the read bias writers keep it off for this many times
+  the revocation took, so write heavy phases stay on the underlying lock */
+#define BRAVO_INHIBIT_FACTOR (9)
+
+/* Number of readers that entered through one slot */
+typedef struct _bravo_slot {
+  uint64_t readers;
+  char pad[BRAVO_SLOT_SIZE - sizeof(uint64_t)];
+} __attribute__((aligned(BRAVO_SLOT_SIZE))) bravo_slot;
+
+/* Reader-writer lock with biased reads (BRAVO). While the read bias is
+  on a reader only increments the slot of its thread and checks the bias,
+  no shared counter is written. A writer takes the underlying lock, turns
+  the bias off and waits until every slot has drained. Readers fall back to
+  the underlying lock while the bias is off and turn it back on once the
+  inhibit period of the last revocation has passed */
+typedef struct _bravo_lock {
+  /* per-thread reader indicator, read by writers when revoking */
+  bravo_slot slots[BRAVO_SLOTS];
+
+  /* true if readers may enter through the slots */
+  bool read_bias;
+
+  /* time in ns before which readers must not turn the bias back on */
+  uint64_t inhibit_until;
+
+  /* underlying lock, writer preferring so readers on the slow path
+  cannot starve writers */
+  pthread_rwlock_t rwlock;
+} bravo_lock;
+
+/* Create an unlocked lock with the read bias on, NULL if out of memory */
+bravo_lock* bravo_lock_init(void);
+
+/* Reclaim memory used by the lock, it must not be held */
+void bravo_lock_destroy(bravo_lock* lock);
+
+/* Acquire 'lock' shared. Returns a token that has to be passed to
+  bravo_read_unlock, the slot the reader entered through or -1 if it
+  holds the underlying lock */
+int bravo_read_lock(bravo_lock* lock);
+
+/* Release a shared acquisition that returned 'token' */
+void bravo_read_unlock(bravo_lock* lock, int token);
+
+/* Acquire 'lock' exclusively, waiting for readers that entered
+  through the slots to leave */
+void bravo_write_lock(bravo_lock* lock);
+
+/* Release an exclusive acquisition */
+void bravo_write_unlock(bravo_lock* lock);
+
+#endif // BRAVO_LOCK_H
@@ -1,66 +1,293 @@
 #ifndef COARSE_SKIPLIST_H
 #define COARSE_SKIPLIST_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <omp.h>
 
 #include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "node_arena.h"
+#include "bravo_lock.h"
+#include "list_lock.h"
 
-typedef struct _coarse_node {
-  /* array of next pointers, next[0] holds next element
-  in level 0, next[1] the next element in level 1 if it
-  exists or null if this node is not present in level 1
-  and above */
-  struct _coarse_node** next;
+/* How a coarse list serializes its operations */
+typedef enum _coarse_lock_mode{
+  COARSE_MUTEX,   /* every operation takes one exclusive lock */
+  COARSE_RWLOCK,  /* searches and scans share a BRAVO reader-writer lock,
+                     updates take it exclusively */
+  COARSE_SEQLOCK, /* like COARSE_MUTEX, but contains reads optimistically
+                     under a sequence counter without taking the lock */
+} coarse_lock_mode;
+
+/* Attempts of an optimistic contains before it takes the lock */
+#define COARSE_OPTIMISTIC_RETRIES (4)
+
+/* Number of threads that can read optimistically at the same time,
+  others take the lock until one of them exits, see thread_slot.h */
+#define COARSE_READER_SLOTS (64)
 
+/* Removed nodes are freed in groups of at least this many */
+#define COARSE_RECLAIM_BATCH (64)
+
+/* Epoch an optimistic reader entered in, 0 while it is not reading.
+  One cache line per thread, so readers do not write shared lines */
+typedef struct _coarse_reader_slot {
+  uint64_t epoch;
+  char pad[64 - sizeof(uint64_t)];
+} __attribute__((aligned(64))) coarse_reader_slot;
+
+/* Keys are skey_t, the list is built for the key type selected with
+  SKIPLIST_KEY, see skiplist_key.h */
+typedef struct _coarse_node {
   /* the key this node is identified with */
-  int key;
+  skey_t key;
+
+  /* number of levels the node is linked in, length of next */
+  uint8_t height;
+
   void* data;
+
+  /* tower of next pointers stored inline, next[0] holds next
+  element in level 0, next[1] the next element in level 1.
+  Only the first 'height' entries exist */
+  struct _coarse_node* next[];
 } coarse_node;
 
 typedef struct _coarse_list {
   /* Head node of the skip list */
   coarse_node* head;
 
-  /* Number of levels in the skip list */
+  /* Number of levels in use, grows with the list up to SKIPLIST_MAX_LEVELS.
+  Only changed while holding the list lock */
   uint8_t levels;
 
+  /* Number of keys in the list and the number the current levels
+  are sized for, protected by the list lock */
+  size_t size;
+  size_t capacity;
+
   /* Probability of a node being present in higher levels */
   double prob;
 
+  /* log2(1/prob) if prob is a power of two, see geometric_height */
+  uint8_t height_shift;
+
+  /* RANDOM_TOWERS or HASHED_TOWERS, how inserts choose tower heights */
+  tower_mode towers;
+
   /* Key range for the skip list */
-  keyrange_t keyrange;
+  skey_range_t keyrange;
 
-  /* one BIG lock for whole list */
-  omp_lock_t* lock;
+  /* one BIG lock for whole list, of the kind given to coarse_skiplist_init */
+  list_lock* lock;
+
+  /* how operations are serialized, see coarse_lock_mode */
+  coarse_lock_mode lock_mode;
+
+  /* with COARSE_RWLOCK the reader-writer lock used instead of 'lock', NULL otherwise */
+  bravo_lock* rw_lock;
+
+  /* Arena the nodes are carved from, NULL if every node and tower is
+  allocated with malloc. Only accessed while holding the list lock */
+  node_arena* arena;
+
+  /* Number of nodes removed so far, protected by the list lock. Fingers
+  remember it to detect that one of their nodes may have been unlinked */
+  uint64_t removals;
+
+  /* COARSE_SEQLOCK state, unused otherwise. 'seq' is odd while a writer
+  holds the lock, a reader that sees it unchanged around its search
+  saw a consistent list */
+  uint64_t seq;
+
+  /* Removed nodes are kept in 'limbo' with the epoch they were removed in
+  until every optimistic reader has entered a later epoch. Only changed
+  while holding the list lock */
+  uint64_t epoch;
+  coarse_reader_slot* readers;
+  struct _coarse_retired* limbo;
+  size_t n_limbo;
+  size_t limbo_capacity;
+
+  /* size of limbo at which writers next try to free nodes */
+  size_t reclaim_at;
 } coarse_list;
 
+/* A removed node waiting to be freed */
+typedef struct _coarse_retired {
+  coarse_node* node;
+  uint64_t epoch;
+} coarse_retired;
+
+/* Cached predecessors of the key last operated on, searches for nearby
+  keys start from here instead of the head. Each thread needs its own */
+typedef struct _coarse_finger {
+  /* predecessors for each level */
+  coarse_node** preds;
+
+  /* list->removals when the finger was last known to be valid */
+  uint64_t removals;
+} coarse_finger;
+
+/* Maximum number of elements a range scan collects per lock acquisition */
+#define COARSE_SCAN_CHUNK (64)
+
+/* Position in the list for ordered iteration, it does not hold the lock */
+typedef struct _coarse_cursor {
+  /* key and data of the element the cursor is on, only meaningful if valid */
+  skey_t key;
+  void* data;
+
+  /* false once the cursor moved past the last element */
+  bool valid;
+
+  /* node of the element the cursor is on, only followed if the
+  list saw no removal since the cursor was placed */
+  coarse_node* node;
+  uint64_t removals;
+} coarse_cursor;
+
 /* Initialize an instance of a sequential skip list 
-    levels -> number of levels of express lanes
+    levels -> initial number of levels of express lanes, more are added
+      once the list outgrows them, up to SKIPLIST_MAX_LEVELS
     prob -> probability that an element is inserted in levels > 0
     keyrange -> range for keys to be used
+    allocator -> HEAP_ALLOC to malloc every node, ARENA_ALLOC to carve
+      nodes from a per-list arena and recycle removed nodes
+    lock_mode -> COARSE_MUTEX to serialize all operations, COARSE_RWLOCK
+      to let searches, range scans and cursors run concurrently,
+      COARSE_SEQLOCK for contains without any shared writes
+    lock -> kind of the exclusive lock used by COARSE_MUTEX and by the
+      writers of COARSE_SEQLOCK, OMP_LOCK, TICKET_LOCK or MCS_LOCK
 */
-coarse_list* coarse_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange);
+coarse_list* coarse_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange,
+  node_allocator allocator, coarse_lock_mode lock_mode, lock_kind lock);
+
+/* Create a list like coarse_skiplist_init holding the 'n' keys in 'keys'
+  with data 'values' (may be NULL), linking all towers in a single pass.
+  'keys' has to be sorted ascending, keys out of range or not larger than
+  their predecessor are skipped.
+    towers -> RANDOM_TOWERS to draw heights from 'random_state' like
+      coarse_skiplist_add, DETERMINISTIC_TOWERS for a perfectly balanced list,
+      HASHED_TOWERS to derive them from the keys, which later inserts keep doing
+*/
+coarse_list* coarse_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+  uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+  coarse_lock_mode lock_mode, lock_kind lock, tower_mode towers, rng_state* random_state);
+
+/* Number of keys in the list */
+size_t coarse_skiplist_size(coarse_list* list);
 
-/* Reclaim memory used by the skip list */
+/* Number of bytes taken by the nodes in the list, not counting the
+  head. Writes the number of keys in the list to 'n_keys' */
+size_t coarse_skiplist_memory(coarse_list* list, size_t* n_keys);
+
+/* Reclaim memory used by the skip list, with ARENA_ALLOC this
+  releases the arena chunks without visiting the nodes */
 void coarse_skiplist_destroy(coarse_list* list);
 
 /* Search for an element in the list.
   Return a node pointer to the element if key is found in list,
-  otherwise return NULL */
-coarse_node* coarse_skiplist_contains(coarse_list* list, int key);
+  otherwise return NULL. With ARENA_ALLOC or COARSE_SEQLOCK the node
+  is recycled once it is removed from the list.
+  With COARSE_SEQLOCK the search runs without the lock and is repeated
+  if a writer interfered, after COARSE_OPTIMISTIC_RETRIES attempts
+  it takes the lock */
+coarse_node* coarse_skiplist_contains(coarse_list* list, skey_t key);
 
 /* Add an element with key and data to the list.
   Return TRUE if inserted or FALSE if insertion failed
   Because we want randomness per thread, supply random_state for choosing levels to link */
-bool coarse_skiplist_add(coarse_list* list, int key, void* data, unsigned short int random_state[3]);
+bool coarse_skiplist_add(coarse_list* list, skey_t key, void* data, rng_state* random_state);
 
 /* Remove a node with the specified 'key' from 'list'.
   Returns true if removal was successful and sets 'data_out'
   to the data element it contained.
   Returns false if key was not found. */
-bool coarse_skiplist_remove(coarse_list* list, int key, void** data_out);
+bool coarse_skiplist_remove(coarse_list* list, skey_t key, void** data_out);
+
+/* Batch variants of contains, add and remove for 'n' keys sorted
+  ascending, each taking the list lock once for the whole batch.
+  The predecessors found for one key are the starting point for the
+  next, so a batch does not restart at the head for every key.
+  Unsorted keys are handled correctly, but without the speedup */
+
+/* Search for every key in 'keys', writing the node or NULL to
+  'results[i]' if 'results' is not NULL. Returns the number of keys found */
+size_t coarse_skiplist_contains_batch(coarse_list* list, const skey_t* keys, size_t n, coarse_node** results);
+
+/* Add every key in 'keys' with the data in 'values' (may be NULL).
+  Returns the number of keys inserted */
+size_t coarse_skiplist_add_batch(coarse_list* list, const skey_t* keys, void** values, size_t n,
+  rng_state* random_state);
+
+/* Remove every key in 'keys', writing the data of a removed element
+  or NULL to 'data_out[i]' if 'data_out' is not NULL.
+  Returns the number of keys removed */
+size_t coarse_skiplist_remove_batch(coarse_list* list, const skey_t* keys, size_t n, void** data_out);
+
+/* Kind of an operation in a mixed batch */
+typedef enum _coarse_op_type{
+  COARSE_OP_CONTAINS,
+  COARSE_OP_ADD,
+  COARSE_OP_REMOVE,
+} coarse_op_type;
+
+/* One operation of a mixed batch, see coarse_skiplist_apply_batch */
+typedef struct _coarse_op {
+  coarse_op_type type;
+  skey_t key;
+
+  /* data to add, afterwards the data of the element found or removed */
+  void* data;
+
+  /* random state for the height of an added node */
+  rng_state* random_state;
+
+  /* set to whether the operation succeeded */
+  bool result;
+} coarse_op;
+
+/* Apply the 'n' operations in 'ops' in order, taking the list lock once.
+  Like the batch variants each search starts from the predecessors of the
+  previous key, so keys sorted ascending are fastest */
+void coarse_skiplist_apply_batch(coarse_list* list, coarse_op* ops, size_t n);
+
+/* Create a finger for 'list' that starts at the head */
+coarse_finger* coarse_skiplist_finger_init(coarse_list* list);
+
+/* Reclaim memory used by the finger */
+void coarse_skiplist_finger_destroy(coarse_finger* finger);
+
+/* Variants of contains, add and remove that start searching from
+  'finger' and leave it at the predecessors of 'key'. Keys close to the
+  previous one are found in expected O(1). Falls back to a search from
+  the head if 'key' lies before the finger or any thread removed a key
+  since the finger was last used */
+coarse_node* coarse_skiplist_finger_contains(coarse_list* list, coarse_finger* finger, skey_t key);
+bool coarse_skiplist_finger_add(coarse_list* list, coarse_finger* finger, skey_t key, void* data,
+  rng_state* random_state);
+bool coarse_skiplist_finger_remove(coarse_list* list, coarse_finger* finger, skey_t key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order until it returns false. Elements are collected in chunks of
+  COARSE_SCAN_CHUNK under the lock, the callback runs without it and may
+  use the list. Every element visited was in the list while its chunk was
+  collected, the scan is not a snapshot of the whole range.
+  Returns the number of elements visited */
+size_t coarse_skiplist_range_scan(coarse_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx);
+
+/* Place 'cursor' on the first element with a key not smaller than 'key'.
+  Returns false if there is no such element */
+bool coarse_skiplist_cursor_seek(coarse_list* list, coarse_cursor* cursor, skey_t key);
+
+/* Move 'cursor' to the first element with a key larger than the current
+  one, which is still found if the current element has been removed.
+  Returns false if there is no such element */
+bool coarse_skiplist_cursor_next(coarse_list* list, coarse_cursor* cursor);
 
 
 #endif // SEQ_SKIPLIST_H
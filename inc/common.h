@@ -1,6 +1,10 @@
 #ifndef H_COMMON
 #define H_COMMON
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
 /* These structs should to match the definition in benchmark.py
  */
 struct counters {
@@ -10,16 +14,47 @@ struct counters {
     int successfull_removes;
     int failed_contains;
     int successfull_contains;
+    /* a range scan is successful if it visited at least one key */
+    int failed_ranges;
+    int successfull_ranges;
 };
 struct bench_result {
     float cpu_time;
     struct counters counters;
+    /* memory taken by the nodes at the end of the run divided by the keys in the list */
+    float bytes_per_key;
+    /* average number of keys visited by a range scan */
+    float keys_per_range;
+    /* time a thread waited for a list lock, averaged over all acquisitions
+      and the longest single wait, in nanoseconds. Locks of list_lock.h, and
+      the waits of the lock-free list on node locks and flags, which count
+      as one acquisition each */
+    float lock_wait_ns;
+    float max_lock_wait_ns;
+    /* Jain's fairness index of the operations completed per thread,
+      1 if every thread completed equally many, 1/threads if one did all */
+    float fairness;
+    /* resident set size of the process at the end of the run while the list
+      still exists, in MiB. Includes removed nodes that were not freed */
+    float resident_mb;
+    /* updates of the fine list repeated after a failed validation, passes of
+      the lock-free list repeated after a conflict, and pause iterations the
+      fine list spent on node locks, nodes not fully linked yet and backoff,
+      both per operation */
+    float retries;
+    float spins;
+    /* levels a repeated search descended, resuming from the lowest predecessor
+      still in the list, and the levels that saved compared to restarting
+      from the head, both per retry */
+    float retry_depth;
+    float retry_skipped;
 };
 
 typedef struct _operations_mix{
     float insert_p;
-    // delete_p is implied by 1 - (insert_p + contain_p)
+    // delete_p is implied by 1 - (insert_p + contain_p + range_p)
     float contain_p;
+    float range_p;
 } operations_mix_t;
 
 typedef struct _keyrange{
@@ -46,6 +81,106 @@ typedef struct _unique_keyarray{
     int size;       /* size in number of ints */
 } unique_keyarray_t;
 
-typedef enum _implementation{SEQUENTIAL, COARSE, FINE, LOCK_FREE} implementation;
+/* Called by a range scan for every element it visits, in ascending
+  key order. Returning false stops the scan */
+typedef bool (*range_callback)(int key, void* data, void* ctx);
+
+/* COARSE_RW and COARSE_SEQ are the coarse list with a reader-writer lock
+  and with optimistic reads, see coarse_lock_mode. HARRIS is the lock-free
+  list with marked next pointers, see harris_skiplist.h */
+typedef enum _implementation{SEQUENTIAL, COARSE, FINE, LOCK_FREE, UNROLLED, COARSE_RW, COARSE_SEQ,
+  FLAT_COMBINING, HARRIS} implementation;
+
+/* Most levels a seq, coarse or fine list can grow to. Their heads are
+  allocated at this height, so levels can be added as the list grows
+  without touching existing nodes */
+#ifndef SKIPLIST_MAX_LEVELS
+#define SKIPLIST_MAX_LEVELS (32)
+#endif
+
+/* Number of keys a list with 'levels' levels is sized for, (1/prob)^levels.
+  Beyond it another level keeps the expected search cost logarithmic */
+static inline size_t level_capacity(double prob, uint8_t levels) {
+    if (prob <= 0.0) return SIZE_MAX;
+    double capacity = 1.0;
+    for (uint8_t i = 0; i < levels; i++) {
+        capacity /= prob;
+        if (capacity >= (double)SIZE_MAX) return SIZE_MAX;
+    }
+    return (size_t)capacity;
+}
+
+/* Nodes are allocated at this alignment, so that the first 32 bytes of
+  a node (the key and next[0]) never straddle two cache lines */
+#define NODE_ALIGN (32)
+
+/* Where the sequential, coarse and fine lists take memory for their nodes from */
+typedef enum _node_alloc{
+  HEAP_ALLOC,   /* one malloc per node */
+  ARENA_ALLOC,  /* node and tower in one block carved from a per-list arena,
+                   the fine list recycles freed nodes in per-thread pools */
+} node_allocator;
+
+/* Which mutual exclusion lock guards a coarse list, see list_lock.h */
+typedef enum _lock_kind{
+  OMP_LOCK,     /* omp_lock_t, no ordering among waiters */
+  TICKET_LOCK,  /* FIFO, every waiter polls the same counter */
+  MCS_LOCK,     /* FIFO queue, every waiter spins on its own node */
+} lock_kind;
+
+/* How the fine list waits before it retries an update that failed
+  validation, and between polls of a node that is not fully linked yet */
+typedef enum _backoff_policy{
+  NO_BACKOFF,           /* retry at once */
+  EXPONENTIAL_BACKOFF,  /* random wait below a bound doubling with every retry */
+  CONTENTION_BACKOFF,   /* wait proportional to the updates of the list
+                           that are retrying at the moment */
+} backoff_policy;
+
+/* How the lock-free list waits for node locks and flags other threads
+  hold, and before it repeats a pass that ran into a change */
+typedef enum _wait_policy{
+  YIELD_WAIT,   /* sched_yield between polls */
+  SPIN_WAIT,    /* pause instructions, twice as many with every poll,
+                   and sched_yield too once they stop growing */
+  PARK_WAIT,    /* spin like SPIN_WAIT for a while, then sleep on a futex
+                   until the lock or flag changes */
+} wait_policy;
+
+/* How tower heights are chosen when a list is built from sorted keys */
+typedef enum _tower_mode{
+  RANDOM_TOWERS,        /* drawn like for a regular insert */
+  DETERMINISTIC_TOWERS, /* every (1/prob)^i-th key reaches level i */
+  HASHED_TOWERS,        /* derived from a hash of the key, also for later
+                           inserts, so the layout is reproducible */
+} tower_mode;
+
+/* Height of the 'position'-th (counting from 1) node of a list built with
+  DETERMINISTIC_TOWERS. The node is linked in level i if 'position' is
+  divisible by (1/prob)^i, which gives a perfectly balanced skiplist */
+static inline uint8_t deterministic_height(size_t position, double prob, uint8_t levels) {
+    size_t step = prob > 0.0 ? (size_t)(1.0 / prob + 0.5) : 0;
+    if (step == 0) return 1;
+    if (step == 1) return levels;
+    uint8_t height = 1;
+    while (height < levels && position % step == 0) {
+        position /= step;
+        height++;
+    }
+    return height;
+}
+
+/* Settings of the implementation under test that are not part of the
+  workload itself, this struct should match the definition in benchmark.py */
+typedef struct _bench_options{
+    node_allocator allocator;
+    tower_mode towers;      /* heights of the prefilled nodes */
+    int batch_size;         /* keys per operation, > 1 uses the sorted batch API */
+    int use_finger;         /* start searches from a per-thread finger where supported */
+    int range_size;         /* width of the key interval a RANGE operation scans */
+    lock_kind lock;         /* exclusive lock of the coarse lists */
+    backoff_policy backoff; /* retry policy of the fine list */
+    wait_policy wait;       /* how the lock-free list waits */
+} bench_options_t;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,143 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Deferred reclamation for lists whose readers take no locks. Objects
+  an update made unreachable are retired and handed to a free callback
+  in batches, once no running operation can still read them.
+
+  With EPOCH_BASED every operation announces the current epoch of the
+  domain in the slot of its thread, every attempt to free objects
+  advances it. A retired object is freed once no operation that
+  announced an epoch up to the one it was retired in is still running.
+  With HAZARD_POINTERS operations only announce the objects they are
+  about to read with epoch_protect. A stalled thread then keeps only
+  those from being freed instead of everything retired after it started */
+
+/* Number of running threads with their own slot, see thread_slot.h.
+  Others announce their operations in a shared counter, while one of
+  them runs no object is freed. A slot is handed to the next thread with
+  the objects its last owner retired */
+#define EPOCH_THREAD_SLOTS (64)
+
+/* Retired objects a thread collects before it tries to free them */
+#define EPOCH_RECLAIM_BATCH (64)
+
+/* Objects a thread can protect at a time with HAZARD_POINTERS, a
+  predecessor for every level of a skip list and the nodes around it */
+#define EPOCH_HAZARDS (40)
+
+typedef enum _epoch_mode{
+  EPOCH_BASED,      /* operations protect everything they reach */
+  HAZARD_POINTERS,  /* operations protect the objects they announce */
+} epoch_mode;
+
+/* Called for every retired 'object' once no operation can reach it,
+  with the 'ctx' the domain was created with. Returning false keeps the
+  object retired, it is offered again with the next batch. The callback
+  must free it when the domain is destroyed, the result is ignored then */
+typedef bool (*epoch_free_fn)(void* object, void* ctx);
+
+/* A retired object and the epoch it was retired in */
+typedef struct _epoch_retired {
+  void* object;
+  uint64_t epoch;
+} epoch_retired;
+
+/* Retired objects that operations in progress may still be reading */
+typedef struct _epoch_limbo {
+  epoch_retired* objects;
+  size_t n;
+  size_t capacity;
+
+  /* size at which the owner next tries to free objects */
+  size_t reclaim_at;
+} epoch_limbo;
+
+/* Reclamation state of one thread, only written by its owner.
+  One cache line per thread for the epoch */
+typedef struct _epoch_slot {
+  /* epoch the running operation announced, 0 between operations */
+  uint64_t epoch;
+
+  /* operations of the thread that started and did not end, an operation
+    may call others. Only the outermost one announces and clears the epoch */
+  int depth;
+
+  /* objects this thread retired */
+  epoch_limbo limbo;
+
+  /* with HAZARD_POINTERS, objects the running operation announced */
+  void* hazards[EPOCH_HAZARDS];
+} __attribute__((aligned(64))) epoch_slot;
+
+typedef struct _epoch_domain {
+  /* current epoch, starts at 1 */
+  uint64_t epoch;
+  epoch_slot* slots;
+
+  /* which objects operations protect */
+  epoch_mode mode;
+
+  /* running operations of threads without a slot, and the objects they
+    retired which slot owners free for them. 'guest_lock' guards 'guest_limbo' */
+  int guests;
+  uint8_t guest_lock;
+  epoch_limbo guest_limbo;
+
+  /* what retired objects are handed to */
+  epoch_free_fn free_fn;
+  void* ctx;
+} epoch_domain;
+
+/* Create a domain handing retired objects to 'free_fn' */
+epoch_domain* epoch_domain_init(epoch_mode mode, epoch_free_fn free_fn, void* ctx);
+
+/* Hand all objects still retired to the free callback and reclaim the
+  domain. No operation may be running */
+void epoch_domain_destroy(epoch_domain* domain);
+
+/* Start an operation of the calling thread. With EPOCH_BASED objects it
+  reaches from now on stay readable until epoch_leave. Returns the slot
+  of the thread, NULL if it has none, to pass to the other calls */
+epoch_slot* epoch_enter(epoch_domain* domain);
+
+/* Start an operation like epoch_enter for a caller that kept objects an
+  earlier operation of its thread found in epoch '*saved' (e.g. a cursor),
+  0 if it kept none. Returns true if they can still be read, which with
+  EPOCH_BASED is the case if no attempt to free objects was made since.
+  Otherwise '*saved' is set to the epoch the objects found by this
+  operation have to be kept with, 0 if they cannot be kept past it.
+  '*slot' is set to what epoch_enter returns */
+bool epoch_resume(epoch_domain* domain, epoch_slot** slot, uint64_t* saved);
+
+/* End the operation started with epoch_enter, then free objects if
+  the thread retired enough of them. Ending the outermost operation
+  clears the objects it protected */
+void epoch_leave(epoch_domain* domain, epoch_slot* slot);
+
+/* With HAZARD_POINTERS, keep 'object' from being freed in place of the
+  one protected at 'index' before. 'object' has to be known to be not
+  retired yet once this returns, e.g. by reading the pointer it was
+  found through again. NULL clears the index. Nothing to do for
+  EPOCH_BASED, and threads without a slot rely on the guest counter */
+static inline void epoch_protect(epoch_domain* domain, epoch_slot* slot, int index, void* object) {
+    if (domain->mode != HAZARD_POINTERS || !slot) return;
+    __atomic_store_n(&slot->hazards[index], object, __ATOMIC_RELAXED);
+    /* the announcement is visible before the object is checked again */
+    if (object) __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Hand 'object', which the caller made unreachable for operations that
+  start from now on, over to be freed once no running operation can
+  still read it. Only call between epoch_enter and epoch_leave */
+void epoch_retire(epoch_domain* domain, epoch_slot* slot, void* object);
+
+/* Number of objects retired but not freed yet. Must not run
+  concurrently with operations */
+size_t epoch_retired_count(epoch_domain* domain);
+
+#endif // EPOCH_H
@@ -0,0 +1,84 @@
+#ifndef FC_SKIPLIST_H
+#define FC_SKIPLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <omp.h>
+
+#include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "coarse_skiplist.h"
+
+/* Number of threads that can publish requests at the same time, others
+  apply their operations to the list directly until one of them exits */
+#define FC_SLOTS (64)
+
+/* Request of one thread. Each slot fills whole cache lines, so publishing
+  a request does not disturb the slots of other threads */
+typedef struct _fc_slot {
+  coarse_op op;
+
+  /* set by the owner once 'op' is filled in, cleared by the combiner
+  once the result has been written back */
+  int pending;
+} __attribute__((aligned(64))) fc_slot;
+
+/* Flat-combining skip list. Threads publish their operation in their slot,
+  whichever thread gets the combiner lock applies all pending operations
+  sorted by key in one pass over a coarse list, so the list stays in the
+  cache of one core while other threads only wait on their own slot */
+typedef struct _fc_list {
+  /* the list the combiner works on */
+  coarse_list* list;
+
+  /* held by the combining thread */
+  omp_lock_t* combiner;
+
+  /* request slot of each thread */
+  fc_slot* slots;
+} fc_list;
+
+/* Initialize a flat-combining skip list, the parameters are those of
+  coarse_skiplist_init */
+fc_list* fc_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange,
+  node_allocator allocator);
+
+/* Create a list holding the 'n' sorted keys in 'keys', see
+  coarse_skiplist_build_sorted */
+fc_list* fc_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+  uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+  tower_mode towers, rng_state* random_state);
+
+/* Reclaim memory used by the skip list */
+void fc_skiplist_destroy(fc_list* list);
+
+/* Number of keys in the list */
+size_t fc_skiplist_size(fc_list* list);
+
+/* Number of bytes taken by the nodes in the list, not counting the
+  head. Writes the number of keys in the list to 'n_keys' */
+size_t fc_skiplist_memory(fc_list* list, size_t* n_keys);
+
+/* Search for an element in the list.
+  Return true and set 'data_out' to the data of the element if key
+  is found in list, otherwise return false */
+bool fc_skiplist_contains(fc_list* list, skey_t key, void** data_out);
+
+/* Add an element with key and data to the list.
+  Return TRUE if inserted or FALSE if insertion failed.
+  The combiner draws the height of the node from 'random_state' */
+bool fc_skiplist_add(fc_list* list, skey_t key, void* data, rng_state* random_state);
+
+/* Remove the element with the specified 'key' from 'list'.
+  Returns true if removal was successful and sets 'data_out'
+  to the data element it contained.
+  Returns false if key was not found. */
+bool fc_skiplist_remove(fc_list* list, skey_t key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order, see coarse_skiplist_range_scan */
+size_t fc_skiplist_range_scan(fc_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx);
+
+#endif // FC_SKIPLIST_H
@@ -1,74 +1,224 @@
 #ifndef FINE_SKIPLIST_H
 #define FINE_SKIPLIST_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <omp.h>
 
 #include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "epoch.h"
 
+/* Keys are skey_t, the list is built for the key type selected with
+  SKIPLIST_KEY, see skiplist_key.h */
 typedef struct _fine_node {
-  /* array of next pointers, next[0] holds next element
-  in level 0, next[1] the next element in level 1 if it
-  exists or null if this node is not present in level 1
-  and above */
-  struct _fine_node** next;
-
   /* the key this node is identified with */
-  int key;
-
-  /* possible data*/
-  void* data;
+  skey_t key;
 
   /* element is in list if marked is false and fully_linked is true*/
   bool marked;
   bool fully_linked;
 
-  omp_nest_lock_t* lock;
+  /* node is linked up to level k, its tower has k+1 entries */
+  uint8_t k;
+
+  /* spin lock guarding the next pointers and 'marked', set while held.
+  Updates lock each distinct predecessor once, so it need not be recursive */
+  uint8_t lock;
+
+  /* possible data*/
+  void* data;
 
-  /* node is linked up to level k */
-  int k;
+  /* tower of next pointers stored inline, next[0] holds next
+  element in level 0, next[1] the next element in level 1.
+  Only the first k+1 entries exist */
+  struct _fine_node* next[];
 } fine_node;
 
+/* Freed nodes kept for reuse with ARENA_ALLOC, one pool per thread slot,
+  see thread_slot.h. Only the thread owning the slot takes nodes from it or
+  adds to it. nodes[k] holds nodes with k+1 levels linked through next[0] */
+typedef struct _fine_pool {
+  fine_node* nodes[SKIPLIST_MAX_LEVELS];
+} __attribute__((aligned(64))) fine_pool;
+
 typedef struct _fine_list {
   /* Head node of the skip list */
   fine_node* head;
 
-  /* Number of levels in the skip list */
+  /* Number of levels in use, grows with the list up to SKIPLIST_MAX_LEVELS.
+  Read and raised atomically, it never shrinks */
   uint8_t levels;
 
+  /* Number of keys in the list, updated atomically */
+  size_t size;
+
+  /* Keys the current levels are sized for, see level_capacity. Only a hint
+  to skip the level check while the list is small enough */
+  size_t capacity;
+
   /* Probability of a node being present in higher levels */
   double prob;
 
+  /* log2(1/prob) if prob is a power of two, see geometric_height */
+  uint8_t height_shift;
+
+  /* RANDOM_TOWERS or HASHED_TOWERS, how inserts choose tower heights */
+  tower_mode towers;
+
   /* Key range for the skip list */
-  keyrange_t keyrange;
+  skey_range_t keyrange;
+
+  /* Removed nodes are freed once no operation can reach them anymore */
+  epoch_domain* reclaim;
+
+  /* with ARENA_ALLOC, the pools of the thread slots */
+  fine_pool* pools;
+
+  /* keep freed nodes in the pool of the thread that freed them */
+  bool recycle;
+
+  /* how failed updates wait before they retry. With CONTENTION_BACKOFF
+    'retrying' counts the updates that failed at least once and did not
+    finish yet */
+  backoff_policy backoff;
+  int retrying;
 } fine_list;
 
+/* Cached neighbours of the key last operated on, searches for nearby
+  keys start from here instead of the head. Each thread needs its own */
+typedef struct _fine_finger {
+  /* predecessors and successors for each level */
+  fine_node** preds;
+  fine_node** succs;
+
+  /* epoch the nodes were found in, see epoch_resume. 0 if the finger
+  was never used */
+  uint64_t epoch;
+} fine_finger;
+
+/* Position in the list for ordered iteration */
+typedef struct _fine_cursor {
+  /* key and data of the element the cursor is on, only meaningful if valid */
+  skey_t key;
+  void* data;
+
+  /* false once the cursor moved past the last element */
+  bool valid;
+
+  /* node of the element the cursor is on, it stays readable if it is
+  removed and its next pointers still lead to larger keys. If it may
+  have been freed since it was found in 'epoch', the cursor moves
+  on from 'key' with a new search instead */
+  fine_node* node;
+  uint64_t epoch;
+} fine_cursor;
+
 /* Initialize an instance of a sequential skip list 
-    levels -> number of levels of express lanes
+    levels -> initial number of levels of express lanes, more are added
+      once the list outgrows them, up to SKIPLIST_MAX_LEVELS
     prob -> probability that an element is inserted in levels > 0
     keyrange -> range for keys to be used
+    allocator -> HEAP_ALLOC to free removed nodes, ARENA_ALLOC to keep them
+      in a pool of the thread that frees them, where its inserts take them from
+    backoff -> how updates wait before retrying, see backoff_policy
+  Removed nodes are freed once no operation can still reach them, see epoch.h
 */
-fine_list* fine_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange);
-
-/* Reclaim memory used by the skip list */
+fine_list* fine_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange,
+  node_allocator allocator, backoff_policy backoff);
+
+/* Create a list like fine_skiplist_init holding the 'n' keys in 'keys'
+  with data 'values' (may be NULL), linking all towers in a single pass.
+  'keys' has to be sorted ascending, keys out of range or not larger than
+  their predecessor are skipped.
+    towers -> RANDOM_TOWERS to draw heights from 'random_state' like
+      fine_skiplist_add, DETERMINISTIC_TOWERS for a perfectly balanced list,
+      HASHED_TOWERS to derive them from the keys, which later inserts keep doing
+*/
+fine_list* fine_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+  uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+  backoff_policy backoff, tower_mode towers, rng_state* random_state);
+
+/* Retries and busy waiting of the calling thread in fine list operations */
+typedef struct _fine_retry_stats {
+  /* searches repeated because validation failed or the key was being removed */
+  uint64_t retries;
+  /* pause iterations spent on node locks, nodes not fully linked yet and
+    backoff, a yield counts as one */
+  uint64_t spins;
+  /* levels the repeated searches descended, they resume from the lowest
+    predecessor still in the list, and the levels that saved compared to
+    searching from the head again */
+  uint64_t retry_levels;
+  uint64_t skipped_levels;
+} fine_retry_stats;
+
+/* Reset the counters of the calling thread */
+void fine_stats_reset(void);
+
+/* Counters of the calling thread since the last reset */
+fine_retry_stats fine_stats_get(void);
+
+/* Number of keys in the list */
+size_t fine_skiplist_size(fine_list* list);
+
+/* Number of bytes taken by the nodes in the list, not counting the
+  sentinels. Writes the number of keys in the list to 'n_keys'.
+  Must not run concurrently with updates */
+size_t fine_skiplist_memory(fine_list* list, size_t* n_keys);
+
+/* Reclaim memory used by the skip list, including removed nodes
+  that were not freed yet */
 void fine_skiplist_destroy(fine_list* list);
 
 /* Search for an element in the list.
   Return a node pointer to the element if key is found in list,
-  otherwise return NULL */
-fine_node* fine_skiplist_contains(fine_list* list, int key);
+  otherwise return NULL. The node is freed or recycled once it
+  is removed from the list and no operation can reach it anymore */
+fine_node* fine_skiplist_contains(fine_list* list, skey_t key);
 
 /* Add an element with key and data to the list.
   Return TRUE if inserted or FALSE if insertion failed
   Because we want randomness per thread, supply random_state for choosing levels to link */
-bool fine_skiplist_add(fine_list* list, int key, void* data, unsigned short int random_state[3]);
+bool fine_skiplist_add(fine_list* list, skey_t key, void* data, rng_state* random_state);
 
 /* Remove a node with the specified 'key' from 'list'.
   Returns true if removal was successful and sets 'data_out'
   to the data element it contained.
   Returns false if key was not found. */
-bool fine_skiplist_remove(fine_list* list, int key, void** data_out);
+bool fine_skiplist_remove(fine_list* list, skey_t key, void** data_out);
+
+/* Create a finger for 'list' that starts at the head */
+fine_finger* fine_skiplist_finger_init(fine_list* list);
+
+/* Reclaim memory used by the finger */
+void fine_skiplist_finger_destroy(fine_finger* finger);
+
+/* Variants of contains, add and remove that start searching from
+  'finger' and leave it at the neighbours of 'key'. Keys close to the
+  previous one are found in expected O(1). Falls back to a search from
+  the head if 'key' lies before the finger or a node of the finger
+  has been removed */
+fine_node* fine_skiplist_finger_contains(fine_list* list, fine_finger* finger, skey_t key);
+bool fine_skiplist_finger_add(fine_list* list, fine_finger* finger, skey_t key, void* data,
+  rng_state* random_state);
+bool fine_skiplist_finger_remove(fine_list* list, fine_finger* finger, skey_t key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order until it returns false. Takes no locks, nodes that are marked or
+  not yet fully linked are skipped, so every element visited was in the
+  list when the scan passed it. The scan is not a snapshot of the range.
+  Returns the number of elements visited */
+size_t fine_skiplist_range_scan(fine_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx);
+
+/* Place 'cursor' on the first element with a key not smaller than 'key'.
+  Returns false if there is no such element */
+bool fine_skiplist_cursor_seek(fine_list* list, fine_cursor* cursor, skey_t key);
+
+/* Move 'cursor' to the next element, skipping removed ones.
+  Returns false if it moved past the last one */
+bool fine_skiplist_cursor_next(fine_list* list, fine_cursor* cursor);
 
 
 #endif // SEQ_SKIPLIST_H
@@ -0,0 +1,135 @@
+#ifndef HARRIS_SKIPLIST_H
+#define HARRIS_SKIPLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "epoch.h"
+
+/* Lock-free skip list in the style of Fraser and Harris. The only
+  synchronisation is a CAS on next pointers, a node is removed by
+  setting the lowest bit of its next pointers, top level first. It is
+  deleted once level 0 is marked and no update can link behind it
+  anymore. Searches unlink the marked nodes they pass.
+  Keys are skey_t, see skiplist_key.h */
+typedef struct _harris_node {
+  /* the key this node is identified with */
+  skey_t key;
+
+  /* possible data*/
+  void* data;
+
+  /* node is linked up to level k, its tower has k+1 entries */
+  uint8_t k;
+
+  /* the inserter and the remover, the last one to let go of the node
+  retires it. The inserter may still link upper levels after the node
+  was removed, so neither can tell alone when it is unreachable */
+  uint8_t owners;
+
+  /* tower of next pointers stored inline, the lowest bit of next[i]
+  set marks the node as removed in level i. Only the first k+1 entries exist */
+  uintptr_t next[];
+} harris_node;
+
+typedef struct _harris_list {
+  /* Head node of the skip list, its tower spans SKIPLIST_MAX_LEVELS.
+  Levels end in NULL, there is no tail */
+  harris_node* head;
+
+  /* Number of levels in use, grows with the list up to SKIPLIST_MAX_LEVELS.
+  Read and raised atomically, it never shrinks */
+  uint8_t levels;
+
+  /* Number of keys in the list, updated atomically */
+  size_t size;
+
+  /* Keys the current levels are sized for, see level_capacity. Only a hint
+  to skip the level check while the list is small enough */
+  size_t capacity;
+
+  /* Probability of a node being present in higher levels */
+  double prob;
+
+  /* log2(1/prob) if prob is a power of two, see geometric_height */
+  uint8_t height_shift;
+
+  /* RANDOM_TOWERS or HASHED_TOWERS, how inserts choose tower heights */
+  tower_mode towers;
+
+  /* Key range for the skip list */
+  skey_range_t keyrange;
+
+  /* Removed nodes are freed once no operation can reach them anymore */
+  epoch_domain* reclaim;
+} harris_list;
+
+/* Initialize an instance of a lock-free skip list
+    levels -> initial number of levels of express lanes, more are added
+      once the list outgrows them, up to SKIPLIST_MAX_LEVELS
+    prob -> probability that an element is inserted in levels > 0
+    keyrange -> range for keys to be used
+*/
+harris_list* harris_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange);
+
+/* Create a list like harris_skiplist_init holding the 'n' keys in 'keys'
+  with data 'values' (may be NULL), linking all towers in a single pass.
+  'keys' has to be sorted ascending, keys out of range or not larger than
+  their predecessor are skipped. See fine_skiplist_build_sorted for 'towers' */
+harris_list* harris_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+  uint8_t levels, double prob, skey_range_t keyrange, tower_mode towers, rng_state* random_state);
+
+/* Searches of the calling thread in harris list operations */
+typedef struct _harris_retry_stats {
+  /* searches started again from the head because a CAS failed,
+    and the levels they descended */
+  uint64_t retries;
+  uint64_t retry_levels;
+} harris_retry_stats;
+
+/* Reset the counters of the calling thread */
+void harris_stats_reset(void);
+
+/* Counters of the calling thread since the last reset */
+harris_retry_stats harris_stats_get(void);
+
+/* Number of keys in the list */
+size_t harris_skiplist_size(harris_list* list);
+
+/* Number of bytes taken by the nodes in the list, not counting the
+  head. Writes the number of keys in the list to 'n_keys'.
+  Must not run concurrently with updates */
+size_t harris_skiplist_memory(harris_list* list, size_t* n_keys);
+
+/* Reclaim memory used by the skip list, including removed nodes
+  that were not freed yet */
+void harris_skiplist_destroy(harris_list* list);
+
+/* Search for an element in the list without writing to it, it finishes
+  in a bounded number of steps whatever other threads do.
+  Return true and set 'data_out' (may be NULL) to the data of the element
+  if key is found in list, otherwise return false */
+bool harris_skiplist_contains(harris_list* list, skey_t key, void** data_out);
+
+/* Add an element with key and data to the list.
+  Return TRUE if inserted or FALSE if the key is already in the list.
+  Because we want randomness per thread, supply random_state for choosing levels to link */
+bool harris_skiplist_add(harris_list* list, skey_t key, void* data, rng_state* random_state);
+
+/* Remove the element with the specified 'key' from 'list'.
+  Returns true if removal was successful and sets 'data_out' (may be NULL)
+  to the data element it contained.
+  Returns false if key was not found. */
+bool harris_skiplist_remove(harris_list* list, skey_t key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order until it returns false. Marked nodes are skipped, so every element
+  visited was in the list when the scan passed it. The scan is not a
+  snapshot of the range. Returns the number of elements visited */
+size_t harris_skiplist_range_scan(harris_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx);
+
+#endif // HARRIS_SKIPLIST_H
@@ -0,0 +1,65 @@
+#ifndef LIST_LOCK_H
+#define LIST_LOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <omp.h>
+
+#include "common.h"
+
+/* MCS locks one thread can hold at the same time with a queue node of
+  its own, further ones allocate theirs */
+#define MCS_MAX_HELD (4)
+
+/* Pauses a waiter spins for before it yields, the holder
+  or the thread ahead in the queue may have been preempted.
+  The FIFO locks hand the lock to the next waiter even if it is not
+  running, so they lose to OMP_LOCK once threads outnumber cores */
+#define LOCK_SPINS (1024)
+
+/* Queue node of a waiter on an MCS lock, on its own cache line */
+typedef struct _mcs_node {
+  struct _mcs_node* next;
+  int locked;
+} __attribute__((aligned(64))) mcs_node;
+
+typedef struct _list_lock {
+  lock_kind kind;
+
+  /* OMP_LOCK */
+  omp_lock_t omp;
+
+  /* TICKET_LOCK, the next ticket to hand out and the one being served,
+  on separate cache lines so arriving threads do not disturb the holder */
+  uint32_t next_ticket __attribute__((aligned(64)));
+  uint32_t serving __attribute__((aligned(64)));
+
+  /* MCS_LOCK, last waiter in the queue and the node of the holder */
+  mcs_node* tail __attribute__((aligned(64)));
+  mcs_node* holder;
+} list_lock;
+
+/* Time the calling thread waited for locks of this module since the
+  last lock_stats_reset. Uncontended acquisitions are counted, but not timed */
+typedef struct _lock_wait_stats {
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t wait_ns;
+  uint64_t max_wait_ns;
+} lock_wait_stats;
+
+/* Create an unlocked lock of 'kind', NULL if out of memory */
+list_lock* list_lock_init(lock_kind kind);
+
+/* Reclaim memory used by the lock, it must not be held */
+void list_lock_destroy(list_lock* lock);
+
+void list_lock_acquire(list_lock* lock);
+void list_lock_release(list_lock* lock);
+
+/* Clear and read the wait statistics of the calling thread */
+void lock_stats_reset(void);
+lock_wait_stats lock_stats_get(void);
+
+#endif // LIST_LOCK_H
@@ -1,5 +1,10 @@
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "epoch.h"
 
 #define SKIPLIST_max_levels (32)
 
@@ -18,6 +23,7 @@ typedef struct _skiplist_node {
     atm_bool being_modified;
     atm_bool removed;
     uint8_t top_layer; // 0: bottom
+    uint8_t embedded;  // `next` is part of the node's pool block, see lock_free_skiplist_set_pool
     atm_uint16_t ref_count;
     atm_uint32_t accessing_next;
 } skiplist_node;
@@ -28,36 +34,188 @@ typedef struct _skiplist_node {
 typedef int skiplist_cmp_t(skiplist_node *a, skiplist_node *b, void *aux);
 
 typedef struct {
-    size_t prob;
+    double prob;
     size_t maxLayer;
     void *aux;
 } skiplist_raw_config;
 
+// How erased nodes are handed back, see lock_free_skiplist_set_reclaim
+typedef enum {
+    SKIPLIST_RECLAIM_NONE,    // the caller frees them, see skiplist_wait_for_free
+    SKIPLIST_RECLAIM_EPOCH,   // after every operation running at erase time ended
+    SKIPLIST_RECLAIM_HAZARD,  // once no thread announces them as a hazard
+} skiplist_reclaim_mode;
+
+// Called with an erased node once no thread can reach it and no reference
+// returned by a find or taken with skiplist_grab_node is held. Users with
+// embedded nodes get their containing struct back with _get_entry.
+typedef void skiplist_retire_fn(skiplist_node *node, void *ctx);
+
+// Called by lock_free_skiplist_insert_key for a node holding 'key' and
+// 'data', set up with lock_free_skiplist_init_node or taken from the pool
+// with lock_free_skiplist_pool_alloc('top_layer'). 'top_layer' is the
+// height the insert drew. Returns NULL if out of memory.
+typedef skiplist_node *skiplist_alloc_fn(uint8_t top_layer, skey_t key, void *data, void *ctx);
+
+// Shards of the node count. Threads add the nodes they link and subtract
+// those they unlink in their own shard, skiplist_get_size sums them up.
+#define SKIPLIST_COUNTER_SHARDS (64)
+
+// One cache line per shard, so counting does not write a line all
+// threads share. A shard can go negative, only the sum is a size.
+typedef struct {
+    int64_t nodes;
+} __attribute__((aligned(64))) skiplist_counter_shard;
+
+// Pools keep free nodes per thread, a free list for every tower height.
+// A thread whose list grows to twice SKIPLIST_POOL_BATCH moves a batch to
+// the shared depot, one that runs dry takes a batch from there, so nodes
+// freed by one thread are reused by others. Running threads beyond
+// SKIPLIST_POOL_THREADS go through the depot for every node, a thread
+// that takes over the slot of an exited one also takes over its nodes.
+#define SKIPLIST_POOL_THREADS (64)
+#define SKIPLIST_POOL_BATCH (64)
+
+// Bytes requested from malloc at once for new blocks
+#define SKIPLIST_POOL_CHUNK (64 * 1024)
+
+// Free nodes of one thread. While free a node links to the next one
+// through `next`.
+typedef struct {
+    skiplist_node *free[SKIPLIST_max_levels]; // by top layer
+    uint32_t count[SKIPLIST_max_levels];
+    uint8_t *bump;                            // unused part of the last chunk
+    uint8_t *end;
+} __attribute__((aligned(64))) skiplist_pool_thread;
+
+// Blocks holding a user struct of 'node_size' bytes followed by the tower
+// of its skiplist_node, so a node takes a single allocation
+typedef struct {
+    size_t node_size;
+    ptrdiff_t node_offset;    // of the skiplist_node in the user struct
+    size_t tower_offset;      // of the tower in a block
+    skiplist_pool_thread *threads;
+
+    // Batches threads gave away by top layer. The first node of a batch
+    // keeps the next batch in its tower and the batch length in
+    // `accessing_next`. 'lock' guards them, the chunks and 'guest'
+    skiplist_node *depot[SKIPLIST_max_levels];
+    uint8_t lock;
+    void *chunks;             // every chunk, linked through their first word
+    skiplist_pool_thread guest; // chunk space of threads without a slot
+} skiplist_pool;
+
 typedef struct {
     skiplist_node head;
     skiplist_node tail;
     skiplist_cmp_t *cmp_func;
     void *aux;
-    atm_uint32_t total_nodes;
-    atm_uint32_t* layer_entries;
-    atm_uint8_t top_layer;
-    uint8_t prob;
+    skiplist_counter_shard *counters; // SKIPLIST_COUNTER_SHARDS of them
+    atm_uint8_t top_layer;    // highest tower linked so far, it never shrinks
+    double prob;
+    uint8_t height_shift; // log2(1/prob) if prob is a power of two
     uint8_t levels;
+    tower_mode towers;        // HASHED_TOWERS once a keyed list was built with it
+    epoch_domain *reclaim;    // NULL with SKIPLIST_RECLAIM_NONE
+    skiplist_retire_fn *retire_func;
+    void *retire_ctx;
+    bool keyed;               // compare by the skey_t at 'key_offset', see lock_free_skiplist_set_key
+    ptrdiff_t key_offset;
+    skiplist_alloc_fn *alloc_func;
+    void *alloc_ctx;
+    skiplist_pool *pool;      // NULL unless lock_free_skiplist_set_pool
+    wait_policy wait;         // YIELD_WAIT unless lock_free_skiplist_set_wait
 } skiplist_raw;
 
+// Retried operations of the calling thread. A pass that ran into a node
+// being changed resumes from the lowest level whose recorded predecessor
+// is still linked instead of the head.
+typedef struct {
+    uint64_t retries;         // passes of inserts, finds and erases that were repeated
+    uint64_t retry_levels;    // levels the repeated passes descended
+    uint64_t skipped_levels;  // levels they saved compared to a restart from the head
+    uint64_t waits;           // waits for node locks and flags, and before repeated passes
+    uint64_t wait_ns;         // time they took
+    uint64_t max_wait_ns;     // longest of them
+} skiplist_retry_stats;
+
 #ifndef _get_entry
 #define _get_entry(ELEM, STRUCT, MEMBER)                              \
         ((STRUCT *) ((uint8_t *) (ELEM) - offsetof (STRUCT, MEMBER)))
 #endif
 
-skiplist_raw* lock_free_skiplist_init(uint8_t levels, uint8_t prob, skiplist_cmp_t* cmp_func);
+skiplist_raw* lock_free_skiplist_init(uint8_t levels, double prob, skiplist_cmp_t* cmp_func);
+// Frees the list. Nodes still linked stay with the caller, erased nodes
+// not handed back yet are passed to the retire function.
 void lock_free_skiplist_destroy(skiplist_raw* slist);
 
+// Retire erased nodes instead of leaving them to the caller. They are
+// collected per thread and handed to 'retire_func' in batches once they
+// are unreachable, see skiplist_reclaim_mode. Traversals then read next
+// pointers with plain loads and take no reference or read lock on the
+// nodes they pass, only nodes returned to the caller are referenced.
+// Call before the list is shared. Returns 0, or -1 if the reclamation
+// state cannot be allocated.
+int lock_free_skiplist_set_reclaim(skiplist_raw* slist, skiplist_reclaim_mode mode,
+                                   skiplist_retire_fn* retire_func, void* ctx);
+
+// Compare nodes by the skey_t 'key_offset' bytes from their skiplist_node,
+// e.g. offsetof(STRUCT, key) - offsetof(STRUCT, snode), with the inlined
+// comparisons of skiplist_key.h instead of the comparison function, and
+// allow the key based calls below. 'alloc_func' makes the nodes
+// lock_free_skiplist_insert_key links, NULL if only lookups and erases go
+// by key. Call before the list is shared.
+void lock_free_skiplist_set_key(skiplist_raw* slist, ptrdiff_t key_offset,
+                                skiplist_alloc_fn* alloc_func, void* ctx);
+
+// How threads wait for node locks and flags held by others and before
+// they repeat a pass, see wait_policy. With PARK_WAIT threads sleep on
+// the word of the lock or flag they wait for, waits without one spin and
+// then yield. Call before the list is shared.
+void lock_free_skiplist_set_wait(skiplist_raw* slist, wait_policy wait);
+
+// Give the list a node pool for user structs of 'node_size' bytes with
+// their skiplist_node at 'node_offset', offsetof(STRUCT, snode). Erased
+// pool nodes go back to it after the retire function returned, which
+// must not free them. Nodes still linked are released with the list.
+// Call before the list is shared. Returns 0, or -1 if out of memory.
+int lock_free_skiplist_set_pool(skiplist_raw* slist, size_t node_size, ptrdiff_t node_offset);
+
+// Get a node with a tower for 'top_layer' from the pool of the calling
+// thread, set up like lock_free_skiplist_init_node. Its user struct is
+// at `_get_entry` and not cleared. Inserts link it with that height.
+// Returns NULL if out of memory.
+skiplist_node* lock_free_skiplist_pool_alloc(skiplist_raw* slist, uint8_t top_layer);
+
+// Return a pool node that is not linked and no thread can reach anymore
+void lock_free_skiplist_pool_free(skiplist_raw* slist, skiplist_node* node);
+
+// Height an insert would draw for a node, e.g. to take one from the pool
+uint8_t lock_free_skiplist_random_layer(skiplist_raw* slist, rng_state* random_state);
+
+// Link 'n' nodes sorted ascending by the comparison function into the
+// empty list 'slist' in a single pass. Nodes that do not compare larger
+// than their predecessor are skipped and left untouched.
+// towers: RANDOM_TOWERS draws heights from 'random_state' like an insert,
+// DETERMINISTIC_TOWERS builds a perfectly balanced list. HASHED_TOWERS
+// derives them from the keys of a keyed list, see lock_free_skiplist_set_key,
+// and later inserts keep doing so. Without a key it draws them like RANDOM_TOWERS.
+// Pool nodes keep the height they were taken with.
+// Returns the number of nodes linked.
+size_t lock_free_skiplist_build_sorted(skiplist_raw* slist, skiplist_node** nodes, size_t n,
+                                       tower_mode towers, rng_state* random_state);
+
 void lock_free_skiplist_init_node(skiplist_node* node);
 void lock_free_skiplist_destroy_node(skiplist_node* node);
 
+// Number of nodes linked. Sums the counter shards, so it is only exact
+// while no update runs.
 size_t skiplist_get_size(skiplist_raw* slist);
 
+// Reset and read the retry statistics of the calling thread
+void lock_free_skiplist_stats_reset(void);
+skiplist_retry_stats lock_free_skiplist_stats_get(void);
+
 skiplist_raw_config skiplist_get_default_config();
 skiplist_raw_config skiplist_get_config(skiplist_raw* slist);
 
@@ -65,7 +223,7 @@ void skiplist_set_config(skiplist_raw* slist,
                          skiplist_raw_config config);
 
 int lock_free_skiplist_insert(skiplist_raw* slist,
-                    skiplist_node* node,unsigned short int random_state[3]);
+                    skiplist_node* node,rng_state* random_state);
 int skiplist_insert_unique(skiplist_raw *slist,
                           skiplist_node *node);
 
@@ -83,9 +241,25 @@ int skiplist_erase_node(skiplist_raw *slist,
 int lock_free_skiplist_erase(skiplist_raw* slist,
                    skiplist_node* query);
 
+// Key based lock_free_skiplist_find, skiplist_find_greater_or_equal and
+// lock_free_skiplist_erase for lists set up with lock_free_skiplist_set_key.
+// The query is a key on the stack, no node is allocated for it.
+skiplist_node* lock_free_skiplist_find_key(skiplist_raw* slist, skey_t key);
+skiplist_node* skiplist_find_key_greater_or_equal(skiplist_raw* slist, skey_t key);
+int lock_free_skiplist_erase_key(skiplist_raw* slist, skey_t key);
+
+// Insert 'key' with 'data' in a node made by the allocation function. It
+// is only called once a search found the key missing, and the insert
+// resumes from the predecessors that search recorded. A node made for an
+// insert that then loses to another one of the same key is handed to the
+// retire function unlinked. Returns 0, -2 if the key is in the list, or -1
+// without allocation or retire function or if allocation failed.
+int lock_free_skiplist_insert_key(skiplist_raw* slist, skey_t key, void* data,
+                                  rng_state* random_state);
+
 int skiplist_is_valid_node(skiplist_node* node);
 int skiplist_is_safe_to_free(skiplist_node* node);
-void skiplist_wait_for_free(skiplist_node* node);
+void skiplist_wait_for_free(skiplist_raw* slist, skiplist_node* node);
 
 void skiplist_grab_node(skiplist_node* node);
 void lock_free_skiplist_release_node(skiplist_node* node);
@@ -0,0 +1,57 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <stddef.h>
+
+/* Every request is rounded up to a multiple of ARENA_ALIGN bytes,
+  which also is the distance between two size classes. Blocks are
+  aligned to it as well, it has to be at least NODE_ALIGN */
+#define ARENA_ALIGN (32)
+
+/* Number of size classes, the largest node the arena hands out
+  is ARENA_ALIGN * ARENA_CLASSES bytes */
+#define ARENA_CLASSES (128)
+
+/* Default amount of memory requested from malloc at once */
+#define ARENA_CHUNK_SIZE (1 << 20)
+
+typedef struct _arena_chunk {
+  /* chunks are kept in a singly linked list so they can be
+  released all at once */
+  struct _arena_chunk* next;
+} arena_chunk;
+
+typedef struct _node_arena {
+  /* all chunks requested so far, most recent first */
+  arena_chunk* chunks;
+
+  /* unused part of the most recent chunk */
+  char* bump;
+  char* end;
+
+  /* bytes requested from malloc per chunk */
+  size_t chunk_size;
+
+  /* recycled blocks, free_lists[i] holds blocks of (i+1)*ARENA_ALIGN bytes.
+  The first word of a free block links to the next free block */
+  void* free_lists[ARENA_CLASSES];
+} node_arena;
+
+/* Create an arena that requests memory in chunks of 'chunk_size' bytes,
+  0 selects ARENA_CHUNK_SIZE.
+  The arena is not thread safe, concurrent users have to serialize access */
+node_arena* node_arena_init(size_t chunk_size);
+
+/* Release every chunk of the arena at once, all blocks handed
+  out by it become invalid */
+void node_arena_destroy(node_arena* arena);
+
+/* Get a block of at least 'size' bytes, a recycled one of the same
+  size class if available. Returns NULL if out of memory or if 'size'
+  exceeds the largest size class */
+void* node_arena_alloc(node_arena* arena, size_t size);
+
+/* Return a block obtained with node_arena_alloc('size') for reuse */
+void node_arena_free(node_arena* arena, void* block, size_t size);
+
+#endif // NODE_ARENA_H
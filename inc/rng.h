@@ -0,0 +1,68 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-thread pseudo random number generator (wyrand). The whole state is
+  one counter, so it can live on the stack or inside a list, and every
+  draw is one multiply. Each thread needs its own */
+typedef struct _rng_state {
+  uint64_t s;
+} rng_state;
+
+/* Next 64 random bits */
+static inline uint64_t rng_next(rng_state* rng) {
+    rng->s += 0xa0761d6478bd642fULL;
+    __uint128_t t = (__uint128_t)rng->s * (rng->s ^ 0xe7037ed1a0b428dbULL);
+    return (uint64_t)(t >> 64) ^ (uint64_t)t;
+}
+
+/* Seed 'rng', generators seeded with nearby values still
+  produce unrelated sequences */
+static inline void rng_seed(rng_state* rng, uint64_t seed) {
+    rng->s = seed;
+    rng->s = rng_next(rng);
+}
+
+/* Uniform double in [0, 1) */
+static inline double rng_double(rng_state* rng) {
+    return (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+/* log2(1/prob) if prob is 2^-k for some k >= 1, 0 otherwise */
+static inline uint8_t height_shift(double prob) {
+    double p = 1.0;
+    for (uint8_t k = 1; k < 64; k++) {
+        p *= 0.5;
+        if (prob == p) return k;
+    }
+    return 0;
+}
+
+/* Height of a new tower between 1 and 'levels', every level above the
+  first is reached with probability 'prob'. With 'shift' = height_shift(prob)
+  set the height comes from a single draw: each 'shift' trailing zero bits
+  of a random word, which occur with probability prob, add a level. Other
+  probabilities draw once per level */
+static inline uint8_t geometric_height(rng_state* rng, double prob, uint8_t shift, uint8_t levels) {
+    uint8_t height = 1;
+    if (shift) {
+        /* the top bit bounds the count for an all zero word */
+        size_t extra = (size_t)__builtin_ctzll(rng_next(rng) | (1ULL << 63)) / shift;
+        height += extra < levels ? extra : levels;
+    } else {
+        while (height < levels && rng_double(rng) < prob) height++;
+    }
+    return height < levels ? height : levels;
+}
+
+/* Height chosen like geometric_height but from 'hash' of a key instead of
+  a random draw, so a key gets the same tower whenever it is inserted
+  while the list has the same number of levels */
+static inline uint8_t hashed_height(uint64_t hash, double prob, uint8_t shift, uint8_t levels) {
+    rng_state state = {hash};
+    return geometric_height(&state, prob, shift, levels);
+}
+
+#endif // RNG_H
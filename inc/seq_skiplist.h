@@ -1,64 +1,185 @@
 #ifndef SEQ_SKIPLIST_H
 #define SEQ_SKIPLIST_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+#include "node_arena.h"
 
+/* Keys are skey_t, the list is built for the key type selected with
+  SKIPLIST_KEY, see skiplist_key.h */
 typedef struct _seq_node {
-  /* array of next pointers, next[0] holds next element
-  in level 0, next[1] the next element in level 1 if it
-  exists or null if this node is not present in level 1
-  and above */
-  struct _seq_node** next;
-
   /* the key this node is identified with */
-  int key;
+  skey_t key;
+
+  /* number of levels the node is linked in, length of next */
+  uint8_t height;
+
   void* data;
+
+  /* tower of next pointers stored inline, next[0] holds next
+  element in level 0, next[1] the next element in level 1.
+  Only the first 'height' entries exist */
+  struct _seq_node* next[];
 } seq_node;
 
 typedef struct _seq_list {
   /* Head node of the skip list */
   seq_node* head;
 
-  /* Number of levels in the skip list */
+  /* Number of levels in use, grows with the list up to SKIPLIST_MAX_LEVELS */
   uint8_t levels;
 
+  /* Number of keys in the list */
+  size_t size;
+
+  /* Keys the current levels are sized for, see level_capacity */
+  size_t capacity;
+
   /* Probability of a node being present in higher levels */
   double prob;
 
+  /* log2(1/prob) if prob is a power of two, see geometric_height */
+  uint8_t height_shift;
+
+  /* RANDOM_TOWERS or HASHED_TOWERS, how inserts choose tower heights */
+  tower_mode towers;
+
   /* Key range for the skip list */
-  keyrange_t keyrange;
+  skey_range_t keyrange;
 
   /* Random state for probabilistic decisions */
-  struct drand48_data* random_state;
+  rng_state random_state;
+
+  /* Arena the nodes are carved from, NULL if every node
+  and tower is allocated with malloc */
+  node_arena* arena;
+
+  /* Number of nodes removed so far, fingers remember it to
+  detect that one of their nodes may have been freed */
+  uint64_t removals;
 } seq_list;
 
+/* Cached predecessors of the key last operated on, searches for nearby
+  keys start from here instead of the head. Each user needs its own */
+typedef struct _seq_finger {
+  /* predecessors for each level */
+  seq_node** preds;
+
+  /* list->removals when the finger was last known to be valid */
+  uint64_t removals;
+} seq_finger;
+
+/* Position in the list for ordered iteration */
+typedef struct _seq_cursor {
+  /* key and data of the element the cursor is on, only meaningful if valid */
+  skey_t key;
+  void* data;
+
+  /* false once the cursor moved past the last element */
+  bool valid;
+
+  /* node of the element the cursor is on */
+  seq_node* node;
+} seq_cursor;
+
 /* Initialize an instance of a sequential skip list 
-    levels -> number of levels of express lanes
+    levels -> initial number of levels of express lanes, more are added
+      once the list outgrows them, up to SKIPLIST_MAX_LEVELS
     prob -> probability that an element is inserted in levels > 0
     keyrange -> range for keys to be used
     random_seed -> seed for the random number generator
+    allocator -> HEAP_ALLOC to malloc every node, ARENA_ALLOC to carve
+      nodes from a per-list arena and recycle removed nodes
+*/
+seq_list* seq_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange,
+  long int random_seed, node_allocator allocator);
+
+/* Create a list like seq_skiplist_init holding the 'n' keys in 'keys'
+  with data 'values' (may be NULL), linking all towers in a single pass.
+  'keys' has to be sorted ascending, keys out of range or not larger than
+  their predecessor are skipped.
+    towers -> RANDOM_TOWERS to draw heights like seq_skiplist_add,
+      DETERMINISTIC_TOWERS for a perfectly balanced list, HASHED_TOWERS
+      to derive them from the keys, which later inserts keep doing
 */
-seq_list* seq_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange,
-  long int random_seed);
+seq_list* seq_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+  uint8_t levels, double prob, skey_range_t keyrange, long int random_seed,
+  node_allocator allocator, tower_mode towers);
+
+/* Number of keys in the list */
+size_t seq_skiplist_size(seq_list* list);
 
-/* Reclaim memory used by the skip list */
+/* Number of bytes taken by the nodes in the list, not counting the
+  head. Writes the number of keys in the list to 'n_keys' */
+size_t seq_skiplist_memory(seq_list* list, size_t* n_keys);
+
+/* Reclaim memory used by the skip list, with ARENA_ALLOC this
+  releases the arena chunks without visiting the nodes */
 void seq_skiplist_destroy(seq_list* list);
 
 /* Search for an element in the list.
   Return a node pointer to the element if key is found in list,
   otherwise return NULL */
-seq_node* seq_skiplist_contains(seq_list* list, int key);
+seq_node* seq_skiplist_contains(seq_list* list, skey_t key);
 
 /* Add an element with key and data to the list.
   Return TRUE if inserted or FALSE if insertion failed */
-bool seq_skiplist_add(seq_list* list, int key, void* data);
+bool seq_skiplist_add(seq_list* list, skey_t key, void* data);
 
 /* Remove a node with the specified 'key' from 'list'.
   Returns true if removal was successful and sets 'data_out'
   to the data element it contained.
   Returns false if key was not found. */
-bool seq_skiplist_remove(seq_list* list, int key, void** data_out);
+bool seq_skiplist_remove(seq_list* list, skey_t key, void** data_out);
+
+/* Batch variants of contains, add and remove for 'n' keys sorted
+  ascending. The predecessors found for one key are the starting point
+  for the next, so a batch does not restart at the head for every key.
+  Unsorted keys are handled correctly, but without the speedup */
+
+/* Search for every key in 'keys', writing the node or NULL to
+  'results[i]' if 'results' is not NULL. Returns the number of keys found */
+size_t seq_skiplist_contains_batch(seq_list* list, const skey_t* keys, size_t n, seq_node** results);
+
+/* Add every key in 'keys' with the data in 'values' (may be NULL).
+  Returns the number of keys inserted */
+size_t seq_skiplist_add_batch(seq_list* list, const skey_t* keys, void** values, size_t n);
+
+/* Remove every key in 'keys', writing the data of a removed element
+  or NULL to 'data_out[i]' if 'data_out' is not NULL.
+  Returns the number of keys removed */
+size_t seq_skiplist_remove_batch(seq_list* list, const skey_t* keys, size_t n, void** data_out);
+
+/* Create a finger for 'list' that starts at the head */
+seq_finger* seq_skiplist_finger_init(seq_list* list);
+
+/* Reclaim memory used by the finger */
+void seq_skiplist_finger_destroy(seq_finger* finger);
+
+/* Variants of contains, add and remove that start searching from
+  'finger' and leave it at the predecessors of 'key'. Keys close to the
+  previous one are found in expected O(1). Falls back to a search from
+  the head if 'key' lies before the finger or any other remove happened
+  since the finger was last used */
+seq_node* seq_skiplist_finger_contains(seq_list* list, seq_finger* finger, skey_t key);
+bool seq_skiplist_finger_add(seq_list* list, seq_finger* finger, skey_t key, void* data);
+bool seq_skiplist_finger_remove(seq_list* list, seq_finger* finger, skey_t key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order until it returns false. The callback must not modify the list.
+  Returns the number of elements visited */
+size_t seq_skiplist_range_scan(seq_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx);
+
+/* Place 'cursor' on the first element with a key not smaller than 'key'.
+  Returns false if there is no such element */
+bool seq_skiplist_cursor_seek(seq_list* list, seq_cursor* cursor, skey_t key);
+
+/* Move 'cursor' to the next element. Returns false if it moved past
+  the last one. The element the cursor is on must not be removed */
+bool seq_skiplist_cursor_next(seq_list* list, seq_cursor* cursor);
 
 #endif // SEQ_SKIPLIST_H
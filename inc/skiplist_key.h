@@ -0,0 +1,97 @@
+#ifndef SKIPLIST_KEY_H
+#define SKIPLIST_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "common.h"
+
+/* Key types the seq, coarse and fine lists can be generated for. Their
+  sources are written against skey_t and the KEY_* macros below and are
+  compiled once per key type, selected with -DSKIPLIST_KEY=KEY_UINT64 etc.
+  All comparisons are inlined, there are no comparison callbacks */
+#define KEY_INT32  (1)
+#define KEY_UINT64 (2)
+#define KEY_STRING (3)
+
+#ifndef SKIPLIST_KEY
+#define SKIPLIST_KEY KEY_INT32
+#endif
+
+/* Bytes of a string key stored inline in the key itself */
+#define KEY_PREFIX_LEN (8)
+
+/* Byte string key. The first KEY_PREFIX_LEN bytes are kept inline as a
+  big endian integer, so keys that differ in them are ordered without
+  touching 'str'. The bytes are owned by the caller and have to outlive
+  the key in any list */
+typedef struct _str_key {
+  /* leading bytes, zero padded, compares like memcmp */
+  uint64_t prefix;
+
+  /* length of 'str' in bytes */
+  uint32_t len;
+
+  /* all bytes of the key, only read if the prefixes are equal */
+  const char* str;
+} str_key;
+
+/* Make a key for the 'len' bytes at 'str' */
+static inline str_key str_key_make(const char* str, uint32_t len) {
+    str_key key = {0, len, str};
+    for (uint32_t i = 0; i < KEY_PREFIX_LEN; i++) {
+        key.prefix = (key.prefix << 8) | (i < len ? (uint8_t)str[i] : 0);
+    }
+    return key;
+}
+
+/* Order of 'a' and 'b' like memcmp, a shorter key orders
+  before a longer one that starts with it */
+static inline int str_key_cmp(str_key a, str_key b) {
+    if (a.prefix != b.prefix) return a.prefix < b.prefix ? -1 : 1;
+    if (a.len > KEY_PREFIX_LEN && b.len > KEY_PREFIX_LEN) {
+        uint32_t n = (a.len < b.len ? a.len : b.len) - KEY_PREFIX_LEN;
+        int order = memcmp(a.str + KEY_PREFIX_LEN, b.str + KEY_PREFIX_LEN, n);
+        if (order) return order;
+    }
+    return (a.len > b.len) - (a.len < b.len);
+}
+
+#if SKIPLIST_KEY == KEY_INT32
+typedef int skey_t;
+typedef keyrange_t skey_range_t;
+#define KEY_LT(a, b) ((a) < (b))
+#define KEY_EQ(a, b) ((a) == (b))
+#define KEY_HASH(k) ((uint64_t)(uint32_t)(k))
+
+#elif SKIPLIST_KEY == KEY_UINT64
+typedef uint64_t skey_t;
+typedef struct { skey_t min; skey_t max; } skey_range_t;
+#define KEY_LT(a, b) ((a) < (b))
+#define KEY_EQ(a, b) ((a) == (b))
+#define KEY_HASH(k) ((uint64_t)(k))
+
+#elif SKIPLIST_KEY == KEY_STRING
+typedef str_key skey_t;
+typedef struct { skey_t min; skey_t max; } skey_range_t;
+#define KEY_LT(a, b) (str_key_cmp((a), (b)) < 0)
+#define KEY_EQ(a, b) ((a).prefix == (b).prefix && str_key_cmp((a), (b)) == 0)
+#define KEY_HASH(k) ((k).prefix ^ ((uint64_t)(k).len << 56))
+
+#else
+#error "unknown SKIPLIST_KEY"
+#endif
+
+/* Orderings derived from KEY_LT */
+#define KEY_GT(a, b) KEY_LT((b), (a))
+#define KEY_LE(a, b) (!KEY_LT((b), (a)))
+#define KEY_GE(a, b) (!KEY_LT((a), (b)))
+
+/* true if min <= k <= max for the skey_range_t 'range' */
+#define KEY_IN_RANGE(k, range) (KEY_LE((range).min, (k)) && KEY_LE((k), (range).max))
+
+/* Callback of a range scan over keys of type skey_t, see range_callback */
+typedef bool (*skey_callback)(skey_t key, void* data, void* ctx);
+
+#endif // SKIPLIST_KEY_H
@@ -0,0 +1,53 @@
+#ifndef SKIPLIST_LEVELS_H
+#define SKIPLIST_LEVELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "skiplist_key.h"
+#include "rng.h"
+
+/* Levels of the lists that add them while other threads search and update
+  them (fine, harris). 'levels' is the number of levels in use, read and
+  raised atomically up to SKIPLIST_MAX_LEVELS, it never shrinks. 'size' is
+  the number of keys, 'capacity' the keys the current levels are sized
+  for, see level_capacity */
+
+/* Number of levels currently in use. Levels are only ever added,
+  so a search covering them finds every node linked so far */
+static inline int levels_in_use(uint8_t* levels) {
+    return __atomic_load_n(levels, __ATOMIC_ACQUIRE);
+}
+
+/* Add levels until they are sized for 'size' keys. The heads span
+  SKIPLIST_MAX_LEVELS, so a new level is usable as soon as 'levels' is
+  raised. Concurrent callers race with a CAS and every level is added once */
+static inline void levels_grow(uint8_t* levels, size_t* capacity, double prob, size_t size) {
+    uint8_t current = levels_in_use(levels);
+    while (current < SKIPLIST_MAX_LEVELS && size > level_capacity(prob, current)) {
+        if (__atomic_compare_exchange_n(levels, &current, current + 1,
+            false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            current++;
+            __atomic_store_n(capacity, level_capacity(prob, current), __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Count a key that was just linked, and add a level if the list outgrew them */
+static inline void levels_count_add(uint8_t* levels, size_t* size, size_t* capacity, double prob) {
+    size_t n = __atomic_add_fetch(size, 1, __ATOMIC_RELAXED);
+    if (n > __atomic_load_n(capacity, __ATOMIC_RELAXED)) levels_grow(levels, capacity, prob, n);
+}
+
+/* Highest level a new node for 'key' is linked in among the 'levels'
+  in use, it is present in level i+1 with probability 'prob' if it is in
+  level i. 'shift' is height_shift(prob) */
+static inline int levels_draw(int levels, tower_mode towers, double prob, uint8_t shift,
+    skey_t key, rng_state* random_state) {
+    if (towers == HASHED_TOWERS)
+        return hashed_height(KEY_HASH(key), prob, shift, levels) - 1;
+    return geometric_height(random_state, prob, shift, levels) - 1;
+}
+
+#endif // SKIPLIST_LEVELS_H
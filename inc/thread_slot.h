@@ -0,0 +1,23 @@
+#ifndef THREAD_SLOT_H
+#define THREAD_SLOT_H
+
+/* Per-thread slots, the index a thread uses for its own cache line in
+  the per-thread arrays of the lists, locks and reclamation domains.
+  A thread claims the lowest free slot when it first asks for one and
+  hands it back when it exits, so only threads that are alive at the
+  same time compete for them. The next thread to claim a slot takes
+  over whatever a module left in it, e.g. free lists or retired nodes */
+
+/* Number of slots. Threads beyond that run without one until a slot
+  is handed back */
+#define THREAD_SLOTS (64)
+
+/* Slot of the calling thread in [0, THREAD_SLOTS), -1 while every
+  slot is taken by another thread */
+int thread_slot_get(void);
+
+/* One more than the highest slot any thread claimed so far, slots from
+  there on were never used */
+int thread_slot_bound(void);
+
+#endif
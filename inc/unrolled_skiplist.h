@@ -0,0 +1,93 @@
+#ifndef UNROLLED_SKIPLIST_H
+#define UNROLLED_SKIPLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "common.h"
+#include "rng.h"
+
+/* Number of keys a node can hold, 16 ints fill one cache line */
+#define UNROLLED_BLOCK (16)
+
+/* Nodes are aligned to a cache line so that 'keys' occupies exactly one */
+#define UNROLLED_ALIGN (64)
+
+typedef struct _unrolled_node {
+  /* data element for each key */
+  void* data[UNROLLED_BLOCK];
+
+  /* sorted keys of this node, keys[0] is the key the node is indexed by
+  in the levels above. Unused slots hold INT_MAX so a block can be
+  searched without looking at 'count' */
+  int keys[UNROLLED_BLOCK];
+
+  /* number of keys in use */
+  uint8_t count;
+
+  /* number of levels the node is linked in, length of next */
+  uint8_t height;
+
+  /* tower of next pointers stored inline, only the
+  first 'height' entries exist */
+  struct _unrolled_node* next[];
+} unrolled_node;
+
+typedef struct _unrolled_list {
+  /* Head sentinel, holds no keys */
+  unrolled_node* head;
+
+  /* Number of levels in the skip list */
+  uint8_t levels;
+
+  /* Probability of a node being present in higher levels */
+  double prob;
+
+  /* log2(1/prob) if prob is a power of two, see geometric_height */
+  uint8_t height_shift;
+
+  /* Key range for the skip list */
+  keyrange_t keyrange;
+
+  /* Random state for probabilistic decisions */
+  rng_state random_state;
+} unrolled_list;
+
+/* Initialize an instance of an unrolled skip list, every node
+  holds up to UNROLLED_BLOCK consecutive keys
+    levels -> number of levels of express lanes, at most SKIPLIST_MAX_LEVELS
+    prob -> probability that a node is inserted in levels > 0
+    keyrange -> range for keys to be used
+    random_seed -> seed for the random number generator
+*/
+unrolled_list* unrolled_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange,
+  long int random_seed);
+
+/* Number of bytes taken by the nodes in the list, not counting the
+  head. Writes the number of keys in the list to 'n_keys' */
+size_t unrolled_skiplist_memory(unrolled_list* list, size_t* n_keys);
+
+/* Reclaim memory used by the skip list */
+void unrolled_skiplist_destroy(unrolled_list* list);
+
+/* Search for an element in the list.
+  Return true and set 'data_out' to the data of the element if key
+  is found in list, otherwise return false */
+bool unrolled_skiplist_contains(unrolled_list* list, int key, void** data_out);
+
+/* Add an element with key and data to the list.
+  Return TRUE if inserted or FALSE if insertion failed */
+bool unrolled_skiplist_add(unrolled_list* list, int key, void* data);
+
+/* Remove the element with the specified 'key' from 'list'.
+  Returns true if removal was successful and sets 'data_out'
+  to the data element it contained.
+  Returns false if key was not found. */
+bool unrolled_skiplist_remove(unrolled_list* list, int key, void** data_out);
+
+/* Call 'callback' for every element with lo <= key <= hi in ascending
+  order until it returns false. The callback must not modify the list.
+  Returns the number of elements visited */
+size_t unrolled_skiplist_range_scan(unrolled_list* list, int lo, int hi, range_callback callback, void* ctx);
+
+#endif // UNROLLED_SKIPLIST_H
@@ -12,18 +12,31 @@ class cBenchCounters(ctypes.Structure):
                  ("failed_removes", ctypes.c_int),
                  ("successfull_removes", ctypes.c_int),
                  ("failed_contains", ctypes.c_int),
-                 ("successfull_contains", ctypes.c_int) ]
+                 ("successfull_contains", ctypes.c_int),
+                 ("failed_ranges", ctypes.c_int),
+                 ("successfull_ranges", ctypes.c_int) ]
 
 class cBenchResult(ctypes.Structure):
     '''
     This has to match the returned struct in library.c
     '''
     _fields_ = [ ("cpu_time", ctypes.c_float),
-                 ("counters", cBenchCounters) ]
+                 ("counters", cBenchCounters),
+                 ("bytes_per_key", ctypes.c_float),
+                 ("keys_per_range", ctypes.c_float),
+                 ("lock_wait_ns", ctypes.c_float),
+                 ("max_lock_wait_ns", ctypes.c_float),
+                 ("fairness", ctypes.c_float),
+                 ("resident_mb", ctypes.c_float),
+                 ("retries", ctypes.c_float),
+                 ("spins", ctypes.c_float),
+                 ("retry_depth", ctypes.c_float),
+                 ("retry_skipped", ctypes.c_float) ]
     
 class cOperationsMix(ctypes.Structure):
     _fields_ = [ ("insert_p", ctypes.c_float),
-                 ("contains_p", ctypes.c_float) ]
+                 ("contains_p", ctypes.c_float),
+                 ("range_p", ctypes.c_float) ]
     
 class cKeyrange(ctypes.Structure):
     _fields_ = [ ("min", ctypes.c_int),
@@ -48,7 +61,56 @@ class cImplementation(CtypesEnum):
     SEQUENTIAL = 0,
     COARSE = 1,
     FINE = 2,
-    LOCK_FREE = 3
+    LOCK_FREE = 3,
+    UNROLLED = 4,
+    COARSE_RW = 5,
+    COARSE_SEQ = 6,
+    FLAT_COMBINING = 7,
+    HARRIS = 8
+
+class cNodeAllocator(CtypesEnum):
+    HEAP_ALLOC = 0,
+    ARENA_ALLOC = 1
+
+class cTowerMode(CtypesEnum):
+    RANDOM_TOWERS = 0,
+    DETERMINISTIC_TOWERS = 1,
+    HASHED_TOWERS = 2
+
+class cLockKind(CtypesEnum):
+    OMP_LOCK = 0,
+    TICKET_LOCK = 1,
+    MCS_LOCK = 2
+
+class cBackoffPolicy(CtypesEnum):
+    NO_BACKOFF = 0,
+    EXPONENTIAL_BACKOFF = 1,
+    CONTENTION_BACKOFF = 2
+
+class cWaitPolicy(CtypesEnum):
+    YIELD_WAIT = 0,
+    SPIN_WAIT = 1,
+    PARK_WAIT = 2
+
+class cBenchOptions(ctypes.Structure):
+    '''
+    This has to match bench_options_t in common.h
+    '''
+    _fields_ = [ ("allocator", ctypes.c_int),
+                 ("towers", ctypes.c_int),
+                 ("batch_size", ctypes.c_int),
+                 ("use_finger", ctypes.c_int),
+                 ("range_size", ctypes.c_int),
+                 ("lock", ctypes.c_int),
+                 ("backoff", ctypes.c_int),
+                 ("wait", ctypes.c_int) ]
+
+
+# Library built for each key type of the seq, coarse and fine lists,
+# see inc/skiplist_key.h. Keys are drawn as ints and mapped in order
+KEY_TYPE_BINARIES = { "int32": "benchmark.so",
+                      "uint64": "benchmark_u64.so",
+                      "string": "benchmark_str.so" }
 
 
 class Benchmark:
@@ -58,9 +120,12 @@ class Benchmark:
     averages the results over the given amount of repetitions.
     '''
     def __init__(self, binary, parameters,
-                 threads, repetitions_per_point, basedir, graph_name):
+                 threads, repetitions_per_point, basedir, graph_name,
+                 options=cBenchOptions(cNodeAllocator.HEAP_ALLOC, cTowerMode.RANDOM_TOWERS, 1, False, 100,
+                                             cLockKind.OMP_LOCK, cBackoffPolicy.NO_BACKOFF, cWaitPolicy.YIELD_WAIT)):
         self.binary = binary
         self.parameters = parameters
+        self.options = options
         self.seq_parameters = tuple(x for x in parameters if not(type(x) is cKeyOverlap))
         self.threads = threads
         self.repetitions_per_point = repetitions_per_point
@@ -80,26 +145,49 @@ class Benchmark:
         print(f"Starting Benchmark run at {self.now}")
 
         tmp = []
-        print("SEQUENTIAL", end=" ", flush=True)
-        for r in range(0, self.repetitions_per_point):
-            result = self.binary.seq_skiplist_benchmark(*self.seq_parameters)
-            tmp.append( result )
-            print(".", end=" ", flush=True)
-        self.data[1] = tmp
-        self.write_avg_data("SEQUENTIAL")
-        self.data.clear()
-        print()
-    
-        for impl in [cImplementation.COARSE, cImplementation.FINE, cImplementation.LOCK_FREE]:
+        for impl in [cImplementation.SEQUENTIAL, cImplementation.UNROLLED]:
             print(f"{impl.name}", end=" ", flush=True)
+            tmp.clear()
+            for r in range(0, self.repetitions_per_point):
+                result = self.binary.seq_skiplist_benchmark(*self.seq_parameters, impl, self.options)
+                tmp.append( result )
+                print(".", end=" ", flush=True)
+            self.data[1] = tmp.copy()
+            self.write_avg_data(impl.name)
+            self.data.clear()
+            print()
+    
+        # the coarse list once with every exclusive lock, the fine list once with
+        # every backoff policy, the lock-free list once with every wait policy,
+        # the others with the configured ones
+        lock = cLockKind(self.options.lock)
+        backoff = cBackoffPolicy(self.options.backoff)
+        wait = cWaitPolicy(self.options.wait)
+        runs = [(cImplementation.COARSE, l, backoff, wait) for l in cLockKind] + \
+               [(impl, lock, backoff, wait) for impl in
+                [cImplementation.COARSE_RW, cImplementation.COARSE_SEQ, cImplementation.FLAT_COMBINING]] + \
+               [(cImplementation.FINE, lock, b, wait) for b in cBackoffPolicy] + \
+               [(cImplementation.LOCK_FREE, lock, backoff, w) for w in cWaitPolicy] + \
+               [(cImplementation.HARRIS, lock, backoff, wait)]
+        for impl, lock, backoff, wait in runs:
+            options = cBenchOptions.from_buffer_copy(self.options)
+            options.lock = lock
+            options.backoff = backoff
+            options.wait = wait
+            name = impl.name if lock == cLockKind.OMP_LOCK else f"{impl.name}_{lock.name}"
+            if backoff != cBackoffPolicy.NO_BACKOFF:
+                name = f"{name}_{backoff.name}"
+            if wait != cWaitPolicy.YIELD_WAIT:
+                name = f"{name}_{wait.name}"
+            print(f"{name}", end=" ", flush=True)
             for x in self.threads:
                 tmp.clear()
                 for r in range(0, self.repetitions_per_point):
-                    result = self.binary.parallel_skiplist_benchmark(ctypes.c_uint16(x), *self.parameters, impl)
+                    result = self.binary.parallel_skiplist_benchmark(ctypes.c_uint16(x), *self.parameters, impl, options)
                     tmp.append( result )
                     print(".", end=" ", flush=True)
                 self.data[x] = tmp.copy()
-            self.write_avg_data(impl.name)
+            self.write_avg_data(name)
             self.data.clear()
             print()
         
@@ -122,7 +210,10 @@ class Benchmark:
                 as datafile:
             datafile.write(f"n_threads succesfull_adds failed_adds succesfull_contains "
                            "failed_contains successfull_removes failed_removes "
-                           "total_operations max_thread_time throughput\n")
+                           "successfull_ranges failed_ranges "
+                           "total_operations max_thread_time throughput bytes_per_key keys_per_range "
+                           "lock_wait_ns max_lock_wait_ns fairness resident_mb retries spins "
+                           "retry_depth retry_skipped\n")
             for x, box in self.data.items():
                 
                 times = [p.contents.cpu_time for p in box]
@@ -143,30 +234,64 @@ class Benchmark:
                 f_contains = [p.contents.counters.failed_contains for p in box]
                 avg_f_contains = sum(f_contains)/len(f_contains)
 
-                total_ops = [s_a+f_a+s_r+f_r+s_c+f_c for s_a,f_a,s_r,f_r,s_c,f_c in
-                             zip(s_adds, f_adds, s_removes, f_removes, s_contains, f_contains)]
+                s_ranges = [p.contents.counters.successfull_ranges for p in box]
+                avg_s_ranges = sum(s_ranges)/len(s_ranges)
+                f_ranges = [p.contents.counters.failed_ranges for p in box]
+                avg_f_ranges = sum(f_ranges)/len(f_ranges)
+
+                total_ops = [s_a+f_a+s_r+f_r+s_c+f_c+s_g+f_g for s_a,f_a,s_r,f_r,s_c,f_c,s_g,f_g in
+                             zip(s_adds, f_adds, s_removes, f_removes, s_contains, f_contains, s_ranges, f_ranges)]
                 avg_total_ops = sum(total_ops)/len(total_ops)
 
                 avg_throughput = avg_total_ops/avg_time
+
+                bytes_per_key = [p.contents.bytes_per_key for p in box]
+                avg_bytes_per_key = sum(bytes_per_key)/len(bytes_per_key)
+
+                keys_per_range = [p.contents.keys_per_range for p in box]
+                avg_keys_per_range = sum(keys_per_range)/len(keys_per_range)
+
+                lock_wait = [p.contents.lock_wait_ns for p in box]
+                avg_lock_wait = sum(lock_wait)/len(lock_wait)
+                max_lock_wait = max(p.contents.max_lock_wait_ns for p in box)
+                fairness = [p.contents.fairness for p in box]
+                avg_fairness = sum(fairness)/len(fairness)
+
+                resident = [p.contents.resident_mb for p in box]
+                avg_resident = sum(resident)/len(resident)
+                retries = [p.contents.retries for p in box]
+                avg_retries = sum(retries)/len(retries)
+                spins = [p.contents.spins for p in box]
+                avg_spins = sum(spins)/len(spins)
+                retry_depth = [p.contents.retry_depth for p in box]
+                avg_retry_depth = sum(retry_depth)/len(retry_depth)
+                retry_skipped = [p.contents.retry_skipped for p in box]
+                avg_retry_skipped = sum(retry_skipped)/len(retry_skipped)
                 
                 datafile.write(f"{x} {avg_s_adds} {avg_f_adds} {avg_s_contains} "
                                f"{avg_f_contains} {avg_s_removes} {avg_f_removes} "
-                               f"{avg_total_ops} {avg_time} {avg_throughput}\n")
+                               f"{avg_s_ranges} {avg_f_ranges} "
+                               f"{avg_total_ops} {avg_time} {avg_throughput} {avg_bytes_per_key} "
+                               f"{avg_keys_per_range} {avg_lock_wait} {max_lock_wait} {avg_fairness} "
+                               f"{avg_resident} {avg_retries} {avg_spins} {avg_retry_depth} "
+                               f"{avg_retry_skipped}\n")
 
-def benchmark():
+def benchmark(key_type="int32"):
     '''
     Requires the binary to also be present as a shared library.
+    key_type selects the build of it, see KEY_TYPE_BINARIES.
     '''
     basedir = os.path.dirname(os.path.abspath(__file__))
-    benchmark_binary = ctypes.CDLL( f"{basedir}/build/benchmark.so" )
+    benchmark_binary = ctypes.CDLL( f"{basedir}/build/{KEY_TYPE_BINARIES[key_type]}" )
     # Set the types for each benchmark function
     benchmark_binary.seq_skiplist_benchmark.argtypes = [ctypes.c_uint16, ctypes.c_uint16, 
-        cOperationsMix, cSelectionStrategy, ctypes.c_uint, cKeyrange, ctypes.c_uint8, ctypes.c_double ]
+        cOperationsMix, cSelectionStrategy, ctypes.c_uint, cKeyrange, ctypes.c_uint8, ctypes.c_double,
+        cImplementation, cBenchOptions ]
     benchmark_binary.seq_skiplist_benchmark.restype = ctypes.POINTER(cBenchResult)
 
     benchmark_binary.parallel_skiplist_benchmark.argtypes = \
     [ctypes.c_uint16, ctypes.c_uint16, ctypes.c_uint16, cOperationsMix, cSelectionStrategy, cKeyOverlap,
-    ctypes.c_uint, cKeyrange, ctypes.c_uint8, ctypes.c_double, cImplementation]
+    ctypes.c_uint, cKeyrange, ctypes.c_uint8, ctypes.c_double, cImplementation, cBenchOptions]
     benchmark_binary.parallel_skiplist_benchmark.restype = ctypes.POINTER(cBenchResult)
 
     # The number of threads. This is the x-axis in the benchmark, i.e., the
@@ -204,4 +329,4 @@ def benchmark():
     
 
 if __name__ == "__main__":
-    benchmark()
+    benchmark(os.environ.get("KEY_TYPE", "int32"))
@@ -3,6 +3,9 @@
 #include "../inc/coarse_skiplist.h"
 #include "../inc/fine_skiplist.h"
 #include "../inc/lock_free_skiplist.h"
+#include "../inc/unrolled_skiplist.h"
+#include "../inc/fc_skiplist.h"
+#include "../inc/harris_skiplist.h"
 
 
 #include <unistd.h>
@@ -15,7 +18,34 @@
 
 //#define DEBUG
 
-const char *implementation_strings[] = {"sequential skiplist", "coarse lock skiplist"};
+const char *implementation_strings[] = {"sequential skiplist", "coarse lock skiplist", "fine lock skiplist",
+                                        "lock free skiplist", "unrolled skiplist", "coarse rw-lock skiplist",
+                                        "coarse seqlock skiplist", "flat combining skiplist",
+                                        "harris lock free skiplist"};
+
+/* Lock of a coarse list, COARSE_RW and COARSE_SEQ benchmark it
+  with the reader-writer lock and with optimistic reads */
+static inline coarse_lock_mode coarse_lock(implementation imp)
+{
+    if (imp == COARSE_RW)
+        return COARSE_RWLOCK;
+    if (imp == COARSE_SEQ)
+        return COARSE_SEQLOCK;
+    return COARSE_MUTEX;
+}
+
+/* Resident set size of the process in MiB, 0 if it cannot be read */
+float resident_mb(void)
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0.0;
+    long pages, resident;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return 1.0 * resident * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
 
 /* Execute a benchmark with the following parameters:
     time_interval -> time to do throughput measurement (in seconds)
@@ -29,10 +59,13 @@ const char *implementation_strings[] = {"sequential skiplist", "coarse lock skip
     num_threads -> Number of threads for concurrent execution
     repetitions -> Number of repetitions of the benchmark
     range_type -> Key range type (COMMON, DISJOINT, PER_THREAD)
+    imp -> Sequential implementation to benchmark (SEQUENTIAL, UNROLLED)
+    options -> Settings of the implementation, e.g. the node allocator
 */
 struct bench_result *seq_skiplist_benchmark(uint16_t time_interval, uint16_t n_prefill,
                                             operations_mix_t operations_mix, selection_strategy strat,
-                                            unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob);
+                                            unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob,
+                                            implementation imp, bench_options_t options);
 
 /* Execute a benchmark with the following parameters:
     time_interval -> time to do throughput measurement (in seconds)
@@ -46,18 +79,21 @@ struct bench_result *seq_skiplist_benchmark(uint16_t time_interval, uint16_t n_p
     num_threads -> Number of threads for concurrent execution
     repetitions -> Number of repetitions of the benchmark
     range_type -> Key range type (COMMON, DISJOINT, PER_THREAD)
+    imp -> Implementation to benchmark
+    options -> Settings of the implementation, e.g. the node allocator
 */
 struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t time_interval, uint16_t n_prefill,
                                                  operations_mix_t operations_mix, selection_strategy strat, key_overlap overlap,
-                                                 unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob, implementation imp);
+                                                 unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob, implementation imp,
+                                                 bench_options_t options);
 
 /* Definitions for lock free skiplist */
 // Define a node that contains key and value pair.
 struct my_node {
     // Metadata for skiplist node.
     skiplist_node snode;
-    // My data here: {int, int} pair.
-    int key;
+    // My data here: {skey_t, void*} pair.
+    skey_t key;
     void* value;
 };
 
@@ -71,11 +107,129 @@ static int my_cmp(skiplist_node* a, skiplist_node* b, void* aux) {
     // aa  < bb: return neg
     // aa == bb: return 0
     // aa  > bb: return pos
-    if (aa->key < bb->key) return -1;
-    if (aa->key > bb->key) return 1;
+    if (KEY_LT(aa->key, bb->key)) return -1;
+    if (KEY_LT(bb->key, aa->key)) return 1;
     return 0;
 }
 
+// Free an erased `my_node` once the list hands it back. Pool nodes
+// go back to the pool by themselves.
+static void my_retire(skiplist_node* node, void* ctx) {
+    (void)ctx;
+    if (node->embedded) return;
+    lock_free_skiplist_destroy_node(node);
+    free(_get_entry(node, struct my_node, snode));
+}
+
+// Take a `my_node` from the pool of the list in `ctx` for a key it found missing.
+static skiplist_node* my_alloc(uint8_t top_layer, skey_t key, void* data, void* ctx) {
+    skiplist_node* snode = lock_free_skiplist_pool_alloc((skiplist_raw*)ctx, top_layer);
+    if (!snode) return NULL;
+    struct my_node* node = _get_entry(snode, struct my_node, snode);
+    node->key = key;
+    node->value = data;
+    return snode;
+}
+
+// Create a lock free list that compares `my_node` keys inline, takes nodes
+// from its pool with `my_alloc`, hands erased nodes to `my_retire` and
+// waits on conflicts as `wait` says.
+static skiplist_raw* my_list_init(uint8_t levels, double prob, wait_policy wait) {
+    skiplist_raw* slist = lock_free_skiplist_init(levels, prob, my_cmp);
+    if (!slist) return NULL;
+    if (lock_free_skiplist_set_pool(slist, sizeof(struct my_node), offsetof(struct my_node, snode)) != 0) {
+        lock_free_skiplist_destroy(slist);
+        return NULL;
+    }
+    lock_free_skiplist_set_key(slist, (ptrdiff_t)offsetof(struct my_node, key) - (ptrdiff_t)offsetof(struct my_node, snode),
+                               my_alloc, slist);
+    if (lock_free_skiplist_set_reclaim(slist, SKIPLIST_RECLAIM_EPOCH, my_retire, NULL) != 0) {
+        lock_free_skiplist_destroy(slist);
+        return NULL;
+    }
+    lock_free_skiplist_set_wait(slist, wait);
+    return slist;
+}
+
+/* The benchmark draws int keys, the seq, coarse and fine lists take them
+  as skey_t. bench_key maps them in order, so sorted batches and ranges
+  stay sorted */
+#if SKIPLIST_KEY == KEY_STRING
+/* Characters of a string key, the decimal digits of the shifted int */
+#define KEY_STRING_LEN (10)
+
+/* Strings of all keys in [key_strings_min, key_strings_max], KEY_STRING_LEN
+  characters each without terminator. The lists point into it */
+static char *key_strings = NULL;
+static int key_strings_min = 0;
+static int key_strings_max = 0;
+#endif
+
+/* Prepare the keys of 'keyrange' and up to 'slack' keys above it,
+  selection strategies and ranges may overshoot the range a little */
+static bool key_strings_init(keyrange_t keyrange, int slack)
+{
+#if SKIPLIST_KEY == KEY_STRING
+    /* one extra key at each end, keys outside are clamped onto them */
+    key_strings_min = (keyrange.min < 0 ? keyrange.min : 0) - 1;
+    key_strings_max = keyrange.max + slack + 1;
+    size_t n = (size_t)(key_strings_max - key_strings_min) + 1;
+    key_strings = (char *)malloc(n * KEY_STRING_LEN + 1);
+    if (!key_strings)
+        return false;
+    for (size_t i = 0; i < n; i++)
+    {
+        int key = key_strings_min + (int)i;
+        snprintf(key_strings + i * KEY_STRING_LEN, KEY_STRING_LEN + 1, "%010u", (uint32_t)key ^ 0x80000000u);
+    }
+#else
+    (void)keyrange;
+    (void)slack;
+#endif
+    return true;
+}
+
+static void key_strings_destroy(void)
+{
+#if SKIPLIST_KEY == KEY_STRING
+    free(key_strings);
+    key_strings = NULL;
+#endif
+}
+
+static inline skey_t bench_key(int key)
+{
+#if SKIPLIST_KEY == KEY_INT32
+    return key;
+#elif SKIPLIST_KEY == KEY_UINT64
+    return (uint64_t)((uint32_t)key ^ 0x80000000u) << 32;
+#else
+    /* clamped keys stay outside the key range of the lists */
+    if (key < key_strings_min)
+        key = key_strings_min;
+    if (key > key_strings_max)
+        key = key_strings_max;
+    return str_key_make(key_strings + (size_t)(key - key_strings_min) * KEY_STRING_LEN, KEY_STRING_LEN);
+#endif
+}
+
+static inline skey_range_t bench_keyrange(keyrange_t keyrange)
+{
+    skey_range_t range = {bench_key(keyrange.min), bench_key(keyrange.max)};
+    return range;
+}
+
+/* Copy of the 'n' keys as skey_t, NULL if out of memory */
+static skey_t *bench_keys(const int *keys, size_t n)
+{
+    skey_t *skeys = (skey_t *)malloc(sizeof(skey_t) * (n ? n : 1));
+    if (!skeys)
+        return NULL;
+    for (size_t i = 0; i < n; i++)
+        skeys[i] = bench_key(keys[i]);
+    return skeys;
+}
+
 unique_keyarray_t *unique_keys_init(int max)
 {
     unique_keyarray_t *keys = (unique_keyarray_t *)malloc(sizeof(unique_keyarray_t));
@@ -97,7 +251,7 @@ unique_keyarray_t *unique_keys_init(int max)
     return keys;
 }
 
-int unique_keys_next(unique_keyarray_t *keys, struct drand48_data *random_state)
+int unique_keys_next(unique_keyarray_t *keys, rng_state *random_state)
 {
     int *array = keys->array;
     int *current = keys->current;
@@ -113,9 +267,7 @@ int unique_keys_next(unique_keyarray_t *keys, struct drand48_data *random_state)
     {
         assert(current == shuffled);
         int range = keys->size - (shuffled - array);
-        double die;
-        drand48_r(random_state, &die);
-        int swapi = (int)(die * range);
+        int swapi = (int)(rng_double(random_state) * range);
         int *swap = shuffled + swapi;
         int tmp = *current;
         *current = *swap;
@@ -140,144 +292,257 @@ void unique_keys_destroy(unique_keyarray_t *keys)
     free(keys);
 }
 
-struct bench_result *seq_skiplist_benchmark(uint16_t time_interval, uint16_t n_prefill,
-                                            operations_mix_t operations_mix, selection_strategy strat,
-                                            unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob)
+void *skiplist_init(uint8_t levels, double prob, keyrange_t keyrange, implementation imp, bench_options_t options,
+                    unsigned int r_seed)
 {
-#ifdef DEBUG
-    printf("Executing benchmark of sequential skiplist\n");
-    printf("Parameters\n");
-    printf("> Time interval for measurment: %u\n", time_interval);
-    printf("> Number of prefilled items: %u\n", n_prefill);
-    printf("> Operations mix:\n>\t>Insertions: %f\n>\t>Contains: %f\n", operations_mix.insert_p, operations_mix.contain_p);
-    printf("> Selection strategy: %d\n", strat);
-    printf("> Random seed: %u\n", r_seed);
-    printf("> Keyrange:\n>\t>Min: %d\n>\t>Max: %d\n", keyrange.min, keyrange.max);
-    printf("> Levels of skiplist: %d\n", levels);
-    printf("> Probability for levels: %f\n", prob);
-#endif
-    int range = keyrange.max - keyrange.min;
-    struct bench_result *result = malloc(sizeof(struct bench_result));
-    memset(&result->counters, 0, sizeof(result->counters));
-    result->cpu_time = 0.0;
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        return (void *)seq_skiplist_init(levels, prob, bench_keyrange(keyrange), r_seed, options.allocator);
+        break;
 
-    seq_list *skiplist = seq_skiplist_init(levels, prob, keyrange, r_seed);
-    if (!skiplist)
-        return NULL;
+    case UNROLLED:
+        return (void *)unrolled_skiplist_init(levels, prob, keyrange, r_seed);
+        break;
 
-    /* initialize random state for key selection */
-    struct drand48_data *random_state = (struct drand48_data *)malloc(6);
-    srand48_r(r_seed + 1, random_state);
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return (void *)coarse_skiplist_init(levels, prob, bench_keyrange(keyrange), options.allocator,
+                                                coarse_lock(imp), options.lock);
+        break;
 
-    /* prefill the skiplist */
-    double die;
-    int key = n_prefill + 1;
+    case FINE:
+        return (void *)fine_skiplist_init(levels, prob, bench_keyrange(keyrange), options.allocator,
+                                              options.backoff);
 
-    unique_keyarray_t *unique_keys;
+    case FLAT_COMBINING:
+        return (void *)fc_skiplist_init(levels, prob, bench_keyrange(keyrange), options.allocator);
 
-    /* Prefill list */
-    if (strat == UNIQUE)
-    {
-        unique_keys = unique_keys_init(range);
-        if (unique_keys == NULL)
-            return NULL;
-        for (size_t i = 0; i < n_prefill; i++)
-        {
-            seq_skiplist_add(skiplist,
-                             keyrange.min + unique_keys_next(unique_keys, random_state), NULL);
-        }
+    case HARRIS:
+        return (void *)harris_skiplist_init(levels, prob, bench_keyrange(keyrange));
+
+    case LOCK_FREE:
+        return (void *)my_list_init(levels, prob, options.wait);
+        break;
+
+    default:
+        return NULL;
+        break;
     }
-    else if (strat == RANDOM)
+}
+/* Single key operations, they start searching from 'finger'
+  if it is not NULL and the implementation supports fingers */
+bool skiplist_add(void *skiplist, int key, void *data, implementation imp, rng_state *r_state, void *finger)
+{
+    switch (imp)
     {
-        unique_keys = unique_keys_init(range);
-        if (unique_keys == NULL)
-            return NULL;
-        for (size_t i = 0; i < n_prefill; i++)
-        {
-            seq_skiplist_add(skiplist,
-                             keyrange.min + unique_keys_next(unique_keys, random_state), NULL);
-        }
-        unique_keys_destroy(unique_keys);
+    case SEQUENTIAL:
+        if (finger)
+            return seq_skiplist_finger_add((seq_list *)skiplist, (seq_finger *)finger, bench_key(key), data);
+        return seq_skiplist_add((seq_list *)skiplist, bench_key(key), data);
+        break;
+
+    case UNROLLED:
+        return unrolled_skiplist_add((unrolled_list *)skiplist, key, data);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        if (finger)
+            return coarse_skiplist_finger_add((coarse_list *)skiplist, (coarse_finger *)finger, bench_key(key), data, r_state);
+        return coarse_skiplist_add((coarse_list *)skiplist, bench_key(key), data, r_state);
+        break;
+
+    case FINE:
+        if (finger)
+            return fine_skiplist_finger_add((fine_list *)skiplist, (fine_finger *)finger, bench_key(key), data, r_state);
+        return fine_skiplist_add((fine_list*)skiplist, bench_key(key), data, r_state);
+        break;
+
+    case FLAT_COMBINING:
+        return fc_skiplist_add((fc_list *)skiplist, bench_key(key), data, r_state);
+        break;
+
+    case HARRIS:
+        return harris_skiplist_add((harris_list *)skiplist, bench_key(key), data, r_state);
+        break;
+
+
+    case LOCK_FREE:
+        ;
+        return lock_free_skiplist_insert_key((skiplist_raw*)skiplist, bench_key(key), data, r_state) == 0;
+        break;
+
+    default:
+        return false;
+        break;
     }
-    else
+}
+static int compare_keys(const void *a, const void *b)
+{
+    int ka = *(const int *)a;
+    int kb = *(const int *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+/* Keys to prefill a list with according to the selection strategy, sorted
+  ascending. RANDOM and UNIQUE draw from 'unique_keys', SUCCESSIVE uses
+  the first 'n_prefill' keys above keyrange.min */
+int *prefill_keys(uint16_t n_prefill, selection_strategy strat, keyrange_t keyrange,
+                  unique_keyarray_t *unique_keys, rng_state *random_state)
+{
+    int *keys = (int *)malloc(sizeof(int) * (n_prefill ? n_prefill : 1));
+    if (!keys)
+        return NULL;
+    for (int i = 0; i < n_prefill; i++)
     {
-        for (int i = 0; i < n_prefill; i++)
-        {
-            seq_skiplist_add(skiplist, keyrange.min + i + 1, NULL);
-        }
+        if ((strat == RANDOM || strat == UNIQUE) && unique_keys)
+            keys[i] = keyrange.min + unique_keys_next(unique_keys, random_state);
+        else
+            keys[i] = keyrange.min + i + 1;
     }
+    qsort(keys, n_prefill, sizeof(int), compare_keys);
+    return keys;
+}
 
-    clock_t endtime = clock() + time_interval * CLOCKS_PER_SEC;
-    clock_t interval;
-    bool res;
-    while (clock() < endtime)
+/* Create a list holding the 'n' sorted 'keys', linked in a single pass
+  where the implementation supports it. Heights are drawn from 'r_state'
+  (or the seed for SEQUENTIAL) unless options.towers is DETERMINISTIC_TOWERS */
+void *skiplist_build(const int *keys, size_t n, uint8_t levels, double prob, keyrange_t keyrange,
+                     implementation imp, bench_options_t options, unsigned int r_seed, rng_state *r_state)
+{
+    switch (imp)
     {
-        /* determine next key */
-        if (strat == RANDOM)
+    case SEQUENTIAL:
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+    case FINE:
+    case FLAT_COMBINING:
+    case HARRIS:
+        ;
+        skey_t *skeys = bench_keys(keys, n);
+        if (!skeys)
+            return NULL;
+        void *list;
+        if (imp == SEQUENTIAL)
+            list = (void *)seq_skiplist_build_sorted(skeys, NULL, n, levels, prob, bench_keyrange(keyrange), r_seed,
+                                                     options.allocator, options.towers);
+        else if (imp == COARSE || imp == COARSE_RW || imp == COARSE_SEQ)
+            list = (void *)coarse_skiplist_build_sorted(skeys, NULL, n, levels, prob, bench_keyrange(keyrange),
+                                                        options.allocator, coarse_lock(imp), options.lock, options.towers, r_state);
+        else if (imp == FLAT_COMBINING)
+            list = (void *)fc_skiplist_build_sorted(skeys, NULL, n, levels, prob, bench_keyrange(keyrange),
+                                                    options.allocator, options.towers, r_state);
+        else if (imp == HARRIS)
+            list = (void *)harris_skiplist_build_sorted(skeys, NULL, n, levels, prob, bench_keyrange(keyrange),
+                                                        options.towers, r_state);
+        else
+            list = (void *)fine_skiplist_build_sorted(skeys, NULL, n, levels, prob, bench_keyrange(keyrange),
+                                                      options.allocator, options.backoff, options.towers, r_state);
+        free(skeys);
+        return list;
+        break;
+
+    case LOCK_FREE:
+        ;
+        skiplist_raw *slist = my_list_init(levels, prob, options.wait);
+        if (!slist)
+            return NULL;
+        skiplist_node **nodes = (skiplist_node **)malloc(sizeof(skiplist_node *) * (n ? n : 1));
+        if (!nodes)
         {
-            drand48_r(random_state, &die);
-            key = (int)(die * range + keyrange.min);
+            lock_free_skiplist_destroy(slist);
+            return NULL;
         }
-        else if (strat == UNIQUE)
+        for (size_t i = 0; i < n; i++)
         {
-            key = unique_keys_next(unique_keys, random_state);
+            struct my_node *node = (struct my_node *)malloc(sizeof(struct my_node));
+            if (!node)
+            {
+                /* nothing is linked yet */
+                while (i--)
+                    free(_get_entry(nodes[i], struct my_node, snode));
+                free(nodes);
+                lock_free_skiplist_destroy(slist);
+                return NULL;
+            }
+            node->key = bench_key(keys[i]);
+            node->value = NULL;
+            lock_free_skiplist_init_node(&node->snode);
+            nodes[i] = &node->snode;
         }
-        else if (strat == SUCCESSIVE)
+        lock_free_skiplist_build_sorted(slist, nodes, n, options.towers, r_state);
+        /* nodes that were skipped as duplicates were not linked */
+        for (size_t i = 0; i < n; i++)
         {
-            key++;
-            if (key > keyrange.max)
-                key = keyrange.min;
+            if (!nodes[i]->is_fully_linked)
+                free(_get_entry(nodes[i], struct my_node, snode));
         }
+        free(nodes);
+        return (void *)slist;
+        break;
 
-        /* determine next operation */
-        drand48_r(random_state, &die);
-        if (die < operations_mix.insert_p)
-        {
-            interval = clock();
-            res = seq_skiplist_add(skiplist, key, NULL);
-            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
-            result->counters.successfull_adds += res;
-            result->counters.failed_adds += !res;
-        }
-        else if (die < operations_mix.insert_p + operations_mix.contain_p)
-        {
-            interval = clock();
-            res = seq_skiplist_contains(skiplist, key) != NULL;
-            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
-            result->counters.successfull_contains += res;
-            result->counters.failed_contains += !res;
-        }
-        else
+    default:
+        /* no bulk load, insert the keys one by one */
+        ;
+        void *skiplist = skiplist_init(levels, prob, keyrange, imp, options, r_seed);
+        if (!skiplist)
+            return NULL;
+        for (size_t i = 0; i < n; i++)
         {
-            interval = clock();
-            res = seq_skiplist_remove(skiplist, key, NULL);
-            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
-            result->counters.successfull_removes += res;
-            result->counters.failed_removes += !res;
+            skiplist_add(skiplist, keys[i], NULL, imp, r_state, NULL);
         }
+        return skiplist;
+        break;
     }
-
-    if (strat == UNIQUE)
-        unique_keys_destroy(unique_keys);
-    seq_skiplist_destroy(skiplist);
-    return result;
 }
 
-
-
-void *skiplist_init(uint8_t levels, double prob, keyrange_t keyrange, implementation imp)
+bool skiplist_contains(void *skiplist, int key, implementation imp, void *finger)
 {
     switch (imp)
     {
+    case SEQUENTIAL:
+        if (finger)
+            return seq_skiplist_finger_contains((seq_list *)skiplist, (seq_finger *)finger, bench_key(key)) != NULL;
+        return seq_skiplist_contains((seq_list *)skiplist, bench_key(key)) != NULL;
+        break;
+
+    case UNROLLED:
+        return unrolled_skiplist_contains((unrolled_list *)skiplist, key, NULL);
+        break;
+
     case COARSE:
-        return (void *)coarse_skiplist_init(levels, prob, keyrange);
+    case COARSE_RW:
+    case COARSE_SEQ:
+        if (finger)
+            return coarse_skiplist_finger_contains((coarse_list *)skiplist, (coarse_finger *)finger, bench_key(key)) != NULL;
+        return coarse_skiplist_contains((coarse_list *)skiplist, bench_key(key)) != NULL;
         break;
 
     case FINE:
-        return (void *)fine_skiplist_init(levels, prob, keyrange);
+        if (finger)
+            return fine_skiplist_finger_contains((fine_list *)skiplist, (fine_finger *)finger, bench_key(key)) != NULL;
+        return fine_skiplist_contains((fine_list*)skiplist, bench_key(key)) != NULL;
+        break;
+
+    case FLAT_COMBINING:
+        return fc_skiplist_contains((fc_list *)skiplist, bench_key(key), NULL);
+        break;
+
+    case HARRIS:
+        return harris_skiplist_contains((harris_list *)skiplist, bench_key(key), NULL);
+        break;
 
     case LOCK_FREE:
-        return (void *)lock_free_skiplist_init(levels, prob, my_cmp);
+        ;
+        skiplist_node* found = lock_free_skiplist_find_key((skiplist_raw*)skiplist, bench_key(key));
+        if (found == NULL)
+            return false;
+        lock_free_skiplist_release_node(found);
+        return true;
         break;
 
     default:
@@ -285,30 +550,45 @@ void *skiplist_init(uint8_t levels, double prob, keyrange_t keyrange, implementa
         break;
     }
 }
-bool skiplist_add(void *skiplist, int key, void *data, implementation imp, unsigned short int r_state[3])
+bool skiplist_remove(void *skiplist, int key, implementation imp, void *finger)
 {
     switch (imp)
     {
+    case SEQUENTIAL:
+        if (finger)
+            return seq_skiplist_finger_remove((seq_list *)skiplist, (seq_finger *)finger, bench_key(key), NULL);
+        return seq_skiplist_remove((seq_list *)skiplist, bench_key(key), NULL);
+        break;
+
+    case UNROLLED:
+        return unrolled_skiplist_remove((unrolled_list *)skiplist, key, NULL);
+        break;
+
     case COARSE:
-        return coarse_skiplist_add((coarse_list *)skiplist, key, data, r_state);
+    case COARSE_RW:
+    case COARSE_SEQ:
+        if (finger)
+            return coarse_skiplist_finger_remove((coarse_list *)skiplist, (coarse_finger *)finger, bench_key(key), NULL);
+        return coarse_skiplist_remove((coarse_list *)skiplist, bench_key(key), NULL);
         break;
 
     case FINE:
-        return fine_skiplist_add((fine_list*)skiplist, key, data, r_state);
+        if (finger)
+            return fine_skiplist_finger_remove((fine_list *)skiplist, (fine_finger *)finger, bench_key(key), NULL);
+        return fine_skiplist_remove((fine_list*)skiplist, bench_key(key), NULL);
         break;
 
+    case FLAT_COMBINING:
+        return fc_skiplist_remove((fc_list *)skiplist, bench_key(key), NULL);
+        break;
+
+    case HARRIS:
+        return harris_skiplist_remove((harris_list *)skiplist, bench_key(key), NULL);
+        break;
 
     case LOCK_FREE:
         ;
-        struct my_node* node = (struct my_node*)malloc(sizeof(struct my_node));
-        node->key = key;
-        node->value = data;
-        lock_free_skiplist_init_node(&node->snode);
-        int result = lock_free_skiplist_insert((skiplist_raw*)skiplist, &node->snode, r_state);
-        if (result < 0) {
-            free(node);
-            return false;
-        } else return true;
+        return lock_free_skiplist_erase_key((skiplist_raw*)skiplist, bench_key(key)) == 0;
         break;
 
     default:
@@ -316,31 +596,94 @@ bool skiplist_add(void *skiplist, int key, void *data, implementation imp, unsig
         break;
     }
 }
-bool skiplist_contains(void *skiplist, int key, implementation imp)
+
+/* Range scan callbacks counting the elements visited */
+static bool count_element(int key, void *data, void *ctx)
+{
+    (void)key;
+    (void)data;
+    (*(size_t *)ctx)++;
+    return true;
+}
+
+static bool count_skey(skey_t key, void *data, void *ctx)
+{
+    (void)key;
+    (void)data;
+    (*(size_t *)ctx)++;
+    return true;
+}
+
+/* Scan all keys in [lo, hi], returns the number of keys visited */
+size_t skiplist_range(void *skiplist, int lo, int hi, implementation imp)
 {
+    size_t visited = 0;
     switch (imp)
     {
+    case SEQUENTIAL:
+        seq_skiplist_range_scan((seq_list *)skiplist, bench_key(lo), bench_key(hi), count_skey, &visited);
+        break;
+
+    case UNROLLED:
+        unrolled_skiplist_range_scan((unrolled_list *)skiplist, lo, hi, count_element, &visited);
+        break;
+
     case COARSE:
-        return coarse_skiplist_contains((coarse_list *)skiplist, key) != NULL;
+    case COARSE_RW:
+    case COARSE_SEQ:
+        coarse_skiplist_range_scan((coarse_list *)skiplist, bench_key(lo), bench_key(hi), count_skey, &visited);
         break;
 
     case FINE:
-        return fine_skiplist_contains((fine_list*)skiplist, key) != NULL;
+        fine_skiplist_range_scan((fine_list *)skiplist, bench_key(lo), bench_key(hi), count_skey, &visited);
+        break;
+
+    case FLAT_COMBINING:
+        fc_skiplist_range_scan((fc_list *)skiplist, bench_key(lo), bench_key(hi), count_skey, &visited);
+        break;
+
+    case HARRIS:
+        harris_skiplist_range_scan((harris_list *)skiplist, bench_key(lo), bench_key(hi), count_skey, &visited);
         break;
 
     case LOCK_FREE:
         ;
-        struct my_node* node = (struct my_node*)malloc(sizeof(struct my_node));
-        node->key = key;
-        lock_free_skiplist_init_node(&node->snode);
-        skiplist_node* found = lock_free_skiplist_find((skiplist_raw*)skiplist, &node->snode);
-        bool result = false;
-        if (found != NULL) {
-            result = true;
-            lock_free_skiplist_release_node(found);
+        skey_t hi_key = bench_key(hi);
+        skiplist_node *current = skiplist_find_key_greater_or_equal((skiplist_raw *)skiplist, bench_key(lo));
+        while (current && !KEY_LT(hi_key, _get_entry(current, struct my_node, snode)->key))
+        {
+            visited++;
+            skiplist_node *next = skiplist_next((skiplist_raw *)skiplist, current);
+            lock_free_skiplist_release_node(current);
+            current = next;
         }
-        free(node);
-        return result;
+        if (current)
+            lock_free_skiplist_release_node(current);
+        break;
+
+    default:
+        break;
+    }
+    return visited;
+}
+
+/* Search finger for the calling thread, NULL if the implementation has none */
+void *skiplist_finger_init(void *skiplist, implementation imp)
+{
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        return (void *)seq_skiplist_finger_init((seq_list *)skiplist);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return (void *)coarse_skiplist_finger_init((coarse_list *)skiplist);
+        break;
+
+    case FINE:
+        return (void *)fine_skiplist_finger_init((fine_list *)skiplist);
         break;
 
     default:
@@ -348,30 +691,174 @@ bool skiplist_contains(void *skiplist, int key, implementation imp)
         break;
     }
 }
-bool skiplist_remove(void *skiplist, int key, implementation imp)
+
+void skiplist_finger_destroy(void *finger, implementation imp)
+{
+    if (!finger)
+        return;
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        seq_skiplist_finger_destroy((seq_finger *)finger);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        coarse_skiplist_finger_destroy((coarse_finger *)finger);
+        break;
+
+    case FINE:
+        fine_skiplist_finger_destroy((fine_finger *)finger);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Batch operations on 'n' sorted keys, returning the number of successful
+  operations. Implementations without a batch API do one key at a time */
+static inline bool batch_api(implementation imp)
+{
+    return imp == SEQUENTIAL || imp == COARSE || imp == COARSE_RW || imp == COARSE_SEQ;
+}
+
+static void to_skeys(const int *keys, size_t n, skey_t *skeys)
+{
+    for (size_t i = 0; i < n; i++)
+        skeys[i] = bench_key(keys[i]);
+}
+
+size_t skiplist_add_batch(void *skiplist, const int *keys, size_t n, implementation imp, rng_state *r_state)
+{
+    size_t done = 0;
+    skey_t skeys[batch_api(imp) ? n : 1];
+    if (batch_api(imp))
+        to_skeys(keys, n, skeys);
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        return seq_skiplist_add_batch((seq_list *)skiplist, skeys, NULL, n);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return coarse_skiplist_add_batch((coarse_list *)skiplist, skeys, NULL, n, r_state);
+        break;
+
+    default:
+        for (size_t i = 0; i < n; i++)
+            done += skiplist_add(skiplist, keys[i], NULL, imp, r_state, NULL);
+        return done;
+        break;
+    }
+}
+
+size_t skiplist_contains_batch(void *skiplist, const int *keys, size_t n, implementation imp)
+{
+    size_t done = 0;
+    skey_t skeys[batch_api(imp) ? n : 1];
+    if (batch_api(imp))
+        to_skeys(keys, n, skeys);
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        return seq_skiplist_contains_batch((seq_list *)skiplist, skeys, n, NULL);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return coarse_skiplist_contains_batch((coarse_list *)skiplist, skeys, n, NULL);
+        break;
+
+    default:
+        for (size_t i = 0; i < n; i++)
+            done += skiplist_contains(skiplist, keys[i], imp, NULL);
+        return done;
+        break;
+    }
+}
+
+size_t skiplist_remove_batch(void *skiplist, const int *keys, size_t n, implementation imp)
+{
+    size_t done = 0;
+    skey_t skeys[batch_api(imp) ? n : 1];
+    if (batch_api(imp))
+        to_skeys(keys, n, skeys);
+    switch (imp)
+    {
+    case SEQUENTIAL:
+        return seq_skiplist_remove_batch((seq_list *)skiplist, skeys, n, NULL);
+        break;
+
+    case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return coarse_skiplist_remove_batch((coarse_list *)skiplist, skeys, n, NULL);
+        break;
+
+    default:
+        for (size_t i = 0; i < n; i++)
+            done += skiplist_remove(skiplist, keys[i], imp, NULL);
+        return done;
+        break;
+    }
+}
+
+/* Number of bytes taken by the nodes of 'skiplist', writes the number of keys to 'n_keys'.
+    Must not run concurrently with updates */
+size_t skiplist_memory(void *skiplist, implementation imp, size_t *n_keys)
 {
     switch (imp)
     {
+    case SEQUENTIAL:
+        return seq_skiplist_memory((seq_list *)skiplist, n_keys);
+        break;
+
+    case UNROLLED:
+        return unrolled_skiplist_memory((unrolled_list *)skiplist, n_keys);
+        break;
+
     case COARSE:
-        return coarse_skiplist_remove((coarse_list *)skiplist, key, NULL);
+    case COARSE_RW:
+    case COARSE_SEQ:
+        return coarse_skiplist_memory((coarse_list *)skiplist, n_keys);
         break;
 
     case FINE:
-        return fine_skiplist_remove((fine_list*)skiplist, key, NULL);
+        return fine_skiplist_memory((fine_list *)skiplist, n_keys);
+        break;
+
+    case FLAT_COMBINING:
+        return fc_skiplist_memory((fc_list *)skiplist, n_keys);
+        break;
+
+    case HARRIS:
+        return harris_skiplist_memory((harris_list *)skiplist, n_keys);
         break;
 
     case LOCK_FREE:
         ;
-        struct my_node* node = (struct my_node*)malloc(sizeof(struct my_node));
-        node->key = key;
-        lock_free_skiplist_init_node(&node->snode);
-        bool result = (lock_free_skiplist_erase((skiplist_raw*)skiplist, &node->snode) == 0);
-        free(node);
-        return result;
+        size_t bytes = 0;
+        *n_keys = 0;
+        skiplist_node *current = skiplist_begin((skiplist_raw *)skiplist);
+        while (current)
+        {
+            bytes += sizeof(struct my_node) + sizeof(atm_node_ptr) * (current->top_layer + 1);
+            (*n_keys)++;
+            skiplist_node *next = skiplist_next((skiplist_raw *)skiplist, current);
+            lock_free_skiplist_release_node(current);
+            current = next;
+        }
+        return bytes;
         break;
 
     default:
-        return false;
+        *n_keys = 0;
+        return 0;
         break;
     }
 }
@@ -379,7 +866,17 @@ void skiplist_destroy(void *skiplist, implementation imp)
 {
     switch (imp)
     {
+    case SEQUENTIAL:
+        seq_skiplist_destroy((seq_list *)skiplist);
+        break;
+
+    case UNROLLED:
+        unrolled_skiplist_destroy((unrolled_list *)skiplist);
+        break;
+
     case COARSE:
+    case COARSE_RW:
+    case COARSE_SEQ:
         coarse_skiplist_destroy((coarse_list *)skiplist);
         break;
 
@@ -387,13 +884,208 @@ void skiplist_destroy(void *skiplist, implementation imp)
         fine_skiplist_destroy((fine_list*)skiplist);
         break;
 
+    case FLAT_COMBINING:
+        fc_skiplist_destroy((fc_list *)skiplist);
+        break;
+
+    case HARRIS:
+        harris_skiplist_destroy((harris_list *)skiplist);
+        break;
+
     case LOCK_FREE:
-        lock_free_skiplist_destroy((skiplist_raw*)skiplist);
+        ;
+        /* linked nodes of the bulk load stay with us, pool nodes go with the
+          list and erased ones are handed to my_retire */
+        skiplist_raw *slist = (skiplist_raw *)skiplist;
+        skiplist_node *node = slist->head.next[0];
+        while (node != &slist->tail)
+        {
+            skiplist_node *next = node->next[0];
+            my_retire(node, NULL);
+            node = next;
+        }
+        lock_free_skiplist_destroy(slist);
+        break;
 
     default:
         break;
     }
 }
+struct bench_result *seq_skiplist_benchmark(uint16_t time_interval, uint16_t n_prefill,
+                                            operations_mix_t operations_mix, selection_strategy strat,
+                                            unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob,
+                                            implementation imp, bench_options_t options)
+{
+#ifdef DEBUG
+    printf("Executing benchmark of %s\n", implementation_strings[imp]);
+    printf("Parameters\n");
+    printf("> Time interval for measurment: %u\n", time_interval);
+    printf("> Number of prefilled items: %u\n", n_prefill);
+    printf("> Operations mix:\n>\t>Insertions: %f\n>\t>Contains: %f\n>\t>Ranges: %f\n",
+           operations_mix.insert_p, operations_mix.contain_p, operations_mix.range_p);
+    printf("> Selection strategy: %d\n", strat);
+    printf("> Random seed: %u\n", r_seed);
+    printf("> Keyrange:\n>\t>Min: %d\n>\t>Max: %d\n", keyrange.min, keyrange.max);
+    printf("> Levels of skiplist: %d\n", levels);
+    printf("> Probability for levels: %f\n", prob);
+    printf("> Node allocator: %d\n", options.allocator);
+    printf("> Prefill towers: %d\n", options.towers);
+    printf("> Batch size: %d\n", options.batch_size);
+    printf("> Search fingers: %d\n", options.use_finger);
+    printf("> Range size: %d\n", options.range_size);
+#endif
+    if (imp != SEQUENTIAL && imp != UNROLLED)
+        return NULL;
+
+    /* prefill keys and ranges may reach past keyrange.max */
+    if (!key_strings_init(keyrange, n_prefill + (options.range_size > 1 ? options.range_size : 1)))
+        return NULL;
+
+    int range = keyrange.max - keyrange.min;
+    struct bench_result *result = malloc(sizeof(struct bench_result));
+    memset(&result->counters, 0, sizeof(result->counters));
+    result->cpu_time = 0.0;
+    result->bytes_per_key = 0.0;
+    result->keys_per_range = 0.0;
+    result->lock_wait_ns = 0.0;
+    result->max_lock_wait_ns = 0.0;
+    result->fairness = 1.0;
+    result->retries = 0.0;
+    result->spins = 0.0;
+    result->retry_depth = 0.0;
+    result->retry_skipped = 0.0;
+
+    /* initialize random state for key selection */
+    rng_state random_state;
+    rng_seed(&random_state, r_seed + 1);
+
+    double die;
+    int key = n_prefill + 1;
+
+    unique_keyarray_t *unique_keys = NULL;
+    if (strat == UNIQUE || strat == RANDOM)
+    {
+        unique_keys = unique_keys_init(range);
+        if (unique_keys == NULL)
+            return NULL;
+    }
+
+    /* Prefill list, built from the sorted keys in a single pass */
+    int *keys = prefill_keys(n_prefill, strat, keyrange, unique_keys, &random_state);
+    if (!keys)
+        return NULL;
+    void *skiplist = skiplist_build(keys, n_prefill, levels, prob, keyrange, imp, options, r_seed, NULL);
+    free(keys);
+    if (!skiplist)
+        return NULL;
+    if (strat == RANDOM)
+    {
+        unique_keys_destroy(unique_keys);
+        unique_keys = NULL;
+    }
+
+    /* keys of one batch, options.batch_size consecutive keys of
+      the selection strategy are sorted and applied with one operation */
+    int batch = options.batch_size > 1 ? options.batch_size : 1;
+    int *batch_keys = (int *)malloc(sizeof(int) * batch);
+    if (!batch_keys)
+        return NULL;
+
+    void *finger = options.use_finger ? skiplist_finger_init(skiplist, imp) : NULL;
+
+    /* keys a RANGE operation covers, starting at the selected key */
+    int range_size = options.range_size > 1 ? options.range_size : 1;
+    uint64_t scanned_keys = 0;
+
+    clock_t endtime = clock() + time_interval * CLOCKS_PER_SEC;
+    clock_t interval;
+    size_t res;
+    while (clock() < endtime)
+    {
+        for (int b = 0; b < batch; b++)
+        {
+            /* determine next key */
+            if (strat == RANDOM)
+            {
+                key = (int)(rng_double(&random_state) * range + keyrange.min);
+            }
+            else if (strat == UNIQUE)
+            {
+                key = unique_keys_next(unique_keys, &random_state);
+            }
+            else if (strat == SUCCESSIVE)
+            {
+                key++;
+                if (key > keyrange.max)
+                    key = keyrange.min;
+            }
+            batch_keys[b] = key;
+        }
+        if (batch > 1)
+            qsort(batch_keys, batch, sizeof(int), compare_keys);
+
+        /* determine next operation */
+        die = rng_double(&random_state);
+        if (die < operations_mix.insert_p)
+        {
+            interval = clock();
+            res = batch > 1 ? skiplist_add_batch(skiplist, batch_keys, batch, imp, NULL)
+                            : skiplist_add(skiplist, key, NULL, imp, NULL, finger);
+            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
+            result->counters.successfull_adds += res;
+            result->counters.failed_adds += batch - res;
+        }
+        else if (die < operations_mix.insert_p + operations_mix.contain_p)
+        {
+            interval = clock();
+            res = batch > 1 ? skiplist_contains_batch(skiplist, batch_keys, batch, imp)
+                            : skiplist_contains(skiplist, key, imp, finger);
+            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
+            result->counters.successfull_contains += res;
+            result->counters.failed_contains += batch - res;
+        }
+        else if (die < operations_mix.insert_p + operations_mix.contain_p + operations_mix.range_p)
+        {
+            interval = clock();
+            for (int b = 0; b < batch; b++)
+            {
+                res = skiplist_range(skiplist, batch_keys[b], batch_keys[b] + range_size - 1, imp);
+                scanned_keys += res;
+                result->counters.successfull_ranges += res > 0;
+                result->counters.failed_ranges += res == 0;
+            }
+            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
+        }
+        else
+        {
+            interval = clock();
+            res = batch > 1 ? skiplist_remove_batch(skiplist, batch_keys, batch, imp)
+                            : skiplist_remove(skiplist, key, imp, finger);
+            result->cpu_time += (float)(clock() - interval) / CLOCKS_PER_SEC;
+            result->counters.successfull_removes += res;
+            result->counters.failed_removes += batch - res;
+        }
+    }
+    free(batch_keys);
+    skiplist_finger_destroy(finger, imp);
+
+    int ranges = result->counters.successfull_ranges + result->counters.failed_ranges;
+    result->keys_per_range = ranges ? 1.0 * scanned_keys / ranges : 0.0;
+
+    size_t n_keys;
+    size_t bytes = skiplist_memory(skiplist, imp, &n_keys);
+    result->bytes_per_key = n_keys ? 1.0 * bytes / n_keys : 0.0;
+    result->resident_mb = resident_mb();
+
+    if (strat == UNIQUE)
+        unique_keys_destroy(unique_keys);
+    skiplist_destroy(skiplist, imp);
+    key_strings_destroy();
+    return result;
+}
+
+
+
 struct timespec;
 
 bool time1_bigger(struct timespec* time1, struct timespec* time2) {
@@ -411,7 +1103,8 @@ uint64_t time_diff(struct timespec* start, struct timespec* finish) {
 
 struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t time_interval, uint16_t n_prefill,
                                                  operations_mix_t operations_mix, selection_strategy strat, key_overlap overlap,
-                                                 unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob, implementation imp)
+                                                 unsigned int r_seed, keyrange_t keyrange, uint8_t levels, double prob, implementation imp,
+                                                 bench_options_t options)
 {
 
 #ifdef DEBUG
@@ -419,51 +1112,55 @@ struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t
     printf("Parameters\n");
     printf("> Time interval for measurment: %u\n", time_interval);
     printf("> Number of prefilled items: %u\n", n_prefill);
-    printf("> Operations mix:\n>\t>Insertions: %f\n>\t>Contains: %f\n", operations_mix.insert_p, operations_mix.contain_p);
+    printf("> Operations mix:\n>\t>Insertions: %f\n>\t>Contains: %f\n>\t>Ranges: %f\n",
+           operations_mix.insert_p, operations_mix.contain_p, operations_mix.range_p);
     printf("> Selection strategy: %d\n", strat);
     printf("> Key overlap option: %d\n", overlap);
     printf("> Random seed: %u\n", r_seed);
     printf("> Keyrange:\n>\t>Min: %d\n>\t>Max: %d\n", keyrange.min, keyrange.max);
     printf("> Levels of skiplist: %d\n", levels);
     printf("> Probability for levels: %f\n", prob);
+    printf("> Node allocator: %d\n", options.allocator);
+    printf("> Prefill towers: %d\n", options.towers);
+    printf("> Batch size: %d\n", options.batch_size);
+    printf("> Search fingers: %d\n", options.use_finger);
+    printf("> Range size: %d\n", options.range_size);
+    printf("> Coarse lock: %d\n", options.lock);
+    printf("> Fine backoff: %d\n", options.backoff);
+    printf("> Lock-free wait: %d\n", options.wait);
 #endif
 
-    void *skiplist = skiplist_init(levels, prob, keyrange, imp);
-    if (!skiplist) return NULL;
+    /* the sequential implementations can only be driven by one thread */
+    if ((imp == SEQUENTIAL || imp == UNROLLED) && num_threads > 1) return NULL;
+
+    /* prefill keys and ranges may reach past keyrange.max */
+    if (!key_strings_init(keyrange, n_prefill + (options.range_size > 1 ? options.range_size : 1)))
+        return NULL;
 
     int range = keyrange.max - keyrange.min;
 
     /* initialize random state for key selection */
-    unsigned short int *random_state = (unsigned short int*)malloc(6);
-    if (!random_state) return NULL;
-    srand48_r(r_seed + 1, (struct drand48_data *)random_state);
+    rng_state random_state;
+    rng_seed(&random_state, r_seed + 1);
 
     /* prefill the skiplist */
     double die;
 
-    unique_keyarray_t *unique_keys;
-
-    /* Prefill list */
+    unique_keyarray_t *unique_keys = NULL;
     if (strat == RANDOM || strat == UNIQUE)
     {
         unique_keys = unique_keys_init(range);
         if (unique_keys == NULL)
             return NULL;
-        for (size_t i = 0; i < n_prefill; i++)
-        {
-            skiplist_add(skiplist,
-                         keyrange.min + unique_keys_next(unique_keys, (struct drand48_data *)random_state), NULL, imp, random_state);
-        }
-        unique_keys_destroy(unique_keys);
-    }
-    else
-    {
-        for (int i = 0; i < n_prefill; i++)
-        {
-            skiplist_add(skiplist, keyrange.min + i + 1, NULL, imp, random_state);
-        }
     }
-    free(random_state);
+
+    /* Prefill list, built from the sorted keys in a single pass */
+    int *keys = prefill_keys(n_prefill, strat, keyrange, unique_keys, &random_state);
+    unique_keys_destroy(unique_keys);
+    if (!keys) return NULL;
+    void *skiplist = skiplist_build(keys, n_prefill, levels, prob, keyrange, imp, options, r_seed, &random_state);
+    free(keys);
+    if (!skiplist) return NULL;
 
     int successfull_adds = 0;
     int failed_adds = 0;
@@ -471,20 +1168,42 @@ struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t
     int failed_contains = 0;
     int successfull_removes = 0;
     int failed_removes = 0;
+    int successfull_ranges = 0;
+    int failed_ranges = 0;
+    uint64_t scanned_keys = 0;
     uint64_t thread_time_ns = 0;
+    /* operations per thread, summed and squared for the fairness index */
+    int active_threads = 0;
+    double thread_ops = 0.0;
+    double thread_ops_squared = 0.0;
+    uint64_t lock_acquisitions = 0;
+    uint64_t lock_wait_ns = 0;
+    uint64_t max_lock_wait_ns = 0;
+    uint64_t retries = 0;
+    uint64_t spins = 0;
+    uint64_t retry_levels = 0;
+    uint64_t skipped_levels = 0;
 
 #pragma omp parallel default(none) num_threads(num_threads)                         \
     shared(skiplist) \
-    firstprivate(keyrange, range, strat, imp, overlap, time_interval, num_threads, r_seed, operations_mix, n_prefill) \
+    firstprivate(keyrange, range, strat, imp, overlap, time_interval, num_threads, r_seed, operations_mix, n_prefill, options) \
     private(die)                      \
     reduction(+ : successfull_adds, failed_adds, successfull_contains, failed_contains) \
-    reduction(+: successfull_removes, failed_removes) \
-    reduction(max: thread_time_ns)
+    reduction(+: successfull_removes, failed_removes, successfull_ranges, failed_ranges, scanned_keys) \
+    reduction(+: active_threads, thread_ops, thread_ops_squared, lock_acquisitions, lock_wait_ns) \
+    reduction(+: retries, spins, retry_levels, skipped_levels) \
+    reduction(max: thread_time_ns, max_lock_wait_ns)
     {
         int thread_num = omp_get_thread_num();
+        lock_stats_reset();
+        fine_stats_reset();
+        harris_stats_reset();
+        lock_free_skiplist_stats_reset();
+        /* batches count as one operation, like in the counters */
+        uint64_t ops = 0;
         /* initialize random state for thread */
-        unsigned short int* thread_random = (unsigned short int*)malloc(6);
-        srand48_r(r_seed + thread_num, (struct drand48_data *)thread_random);
+        rng_state thread_random;
+        rng_seed(&thread_random, r_seed + thread_num);
 
         int thread_range;
         switch (overlap)
@@ -503,64 +1222,122 @@ struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t
         unique_keyarray_t* thread_keys;
         if (strat == UNIQUE) thread_keys = unique_keys_init(thread_range);
 
+        /* keys of one batch, options.batch_size consecutive keys of
+          the selection strategy are sorted and applied with one operation */
+        int batch = options.batch_size > 1 ? options.batch_size : 1;
+        int *batch_keys = (int *)malloc(sizeof(int) * batch);
+
+        /* search finger of this thread */
+        void *finger = options.use_finger ? skiplist_finger_init(skiplist, imp) : NULL;
+
+        /* keys a RANGE operation covers, starting at the selected key */
+        int range_size = options.range_size > 1 ? options.range_size : 1;
+
         struct timespec start, end, endtime, now;
         clock_gettime(CLOCK_REALTIME, &endtime);
         endtime.tv_sec += time_interval;
         clock_gettime(CLOCK_REALTIME, &now);
-        bool res;
+        size_t res;
         int key = n_prefill;
 
         while (time1_bigger(&endtime, &now))
         {
-            /* determine next key */
-            if (strat == RANDOM)
-            {
-                drand48_r((struct drand48_data *)thread_random, &die);
-                key = (int)(die * thread_range + keyrange.min);
-            }
-            else if (strat == UNIQUE)
-            {
-                key = unique_keys_next(thread_keys, (struct drand48_data *)thread_random);
-            }
-            else if (strat == SUCCESSIVE)
+            for (int b = 0; b < batch; b++)
             {
-                key++;
-                if (key > keyrange.max)
-                    key = keyrange.min;
+                /* determine next key */
+                if (strat == RANDOM)
+                {
+                    key = (int)(rng_double(&thread_random) * thread_range + keyrange.min);
+                }
+                else if (strat == UNIQUE)
+                {
+                    key = unique_keys_next(thread_keys, &thread_random);
+                }
+                else if (strat == SUCCESSIVE)
+                {
+                    key++;
+                    if (key > keyrange.max)
+                        key = keyrange.min;
+                }
+                batch_keys[b] = key;
             }
+            if (batch > 1)
+                qsort(batch_keys, batch, sizeof(int), compare_keys);
 
             /* determine next operation */
-            drand48_r((struct drand48_data *)thread_random, &die);
+            die = rng_double(&thread_random);
             if (die < operations_mix.insert_p)
             {
                 clock_gettime(CLOCK_REALTIME, &start);
-                res = skiplist_add(skiplist, key, NULL, imp, thread_random);
+                res = batch > 1 ? skiplist_add_batch(skiplist, batch_keys, batch, imp, &thread_random)
+                                : skiplist_add(skiplist, key, NULL, imp, &thread_random, finger);
                 clock_gettime(CLOCK_REALTIME, &end);
                 thread_time_ns += time_diff(&start, &end);
                 successfull_adds += res;
-                failed_adds += !res;
+                failed_adds += batch - res;
             }
             else if (die < operations_mix.insert_p + operations_mix.contain_p)
             {
                 clock_gettime(CLOCK_REALTIME, &start);
-                res = skiplist_contains(skiplist, key, imp);
+                res = batch > 1 ? skiplist_contains_batch(skiplist, batch_keys, batch, imp)
+                                : skiplist_contains(skiplist, key, imp, finger);
                 clock_gettime(CLOCK_REALTIME, &end);
                 thread_time_ns += time_diff(&start, &end);
                 successfull_contains += res;
-                failed_contains += !res;
+                failed_contains += batch - res;
+            }
+            else if (die < operations_mix.insert_p + operations_mix.contain_p + operations_mix.range_p)
+            {
+                clock_gettime(CLOCK_REALTIME, &start);
+                for (int b = 0; b < batch; b++)
+                {
+                    res = skiplist_range(skiplist, batch_keys[b], batch_keys[b] + range_size - 1, imp);
+                    scanned_keys += res;
+                    successfull_ranges += res > 0;
+                    failed_ranges += res == 0;
+                }
+                clock_gettime(CLOCK_REALTIME, &end);
+                thread_time_ns += time_diff(&start, &end);
             }
             else
             {
                 clock_gettime(CLOCK_REALTIME, &start);
-                res = skiplist_remove(skiplist, key, imp);
+                res = batch > 1 ? skiplist_remove_batch(skiplist, batch_keys, batch, imp)
+                                : skiplist_remove(skiplist, key, imp, finger);
                 clock_gettime(CLOCK_REALTIME, &end);
                 thread_time_ns += time_diff(&start, &end);
                 successfull_removes += res;
-                failed_removes += !res;
+                failed_removes += batch - res;
             }
+            ops += batch;
             clock_gettime(CLOCK_REALTIME, &now);
         }
-        free(thread_random);
+        free(batch_keys);
+        skiplist_finger_destroy(finger, imp);
+
+        active_threads += 1;
+        thread_ops += (double)ops;
+        thread_ops_squared += (double)ops * ops;
+        lock_wait_stats waits = lock_stats_get();
+        lock_acquisitions += waits.acquisitions;
+        lock_wait_ns += waits.wait_ns;
+        max_lock_wait_ns = waits.max_wait_ns;
+        fine_retry_stats fine_waits = fine_stats_get();
+        retries += fine_waits.retries;
+        spins += fine_waits.spins;
+        retry_levels += fine_waits.retry_levels;
+        skipped_levels += fine_waits.skipped_levels;
+        skiplist_retry_stats lock_free_retries = lock_free_skiplist_stats_get();
+        retries += lock_free_retries.retries;
+        retry_levels += lock_free_retries.retry_levels;
+        skipped_levels += lock_free_retries.skipped_levels;
+        lock_acquisitions += lock_free_retries.waits;
+        lock_wait_ns += lock_free_retries.wait_ns;
+        if (lock_free_retries.max_wait_ns > max_lock_wait_ns)
+            max_lock_wait_ns = lock_free_retries.max_wait_ns;
+        harris_retry_stats harris_retries = harris_stats_get();
+        retries += harris_retries.retries;
+        retry_levels += harris_retries.retry_levels;
     }
 
     struct bench_result *result = malloc(sizeof(struct bench_result));
@@ -571,37 +1348,37 @@ struct bench_result *parallel_skiplist_benchmark(uint16_t num_threads, uint16_t
     result->counters.failed_contains=failed_contains;
     result->counters.successfull_removes=successfull_removes;
     result->counters.failed_removes=failed_removes;
+    result->counters.successfull_ranges=successfull_ranges;
+    result->counters.failed_ranges=failed_ranges;
+    result->keys_per_range = successfull_ranges + failed_ranges ?
+        1.0 * scanned_keys / (successfull_ranges + failed_ranges) : 0.0;
     result->cpu_time = 1.0*thread_time_ns/1e9;
+    result->lock_wait_ns = lock_acquisitions ? 1.0 * lock_wait_ns / lock_acquisitions : 0.0;
+    result->max_lock_wait_ns = max_lock_wait_ns;
+    result->fairness = thread_ops_squared > 0.0 ?
+        thread_ops * thread_ops / (active_threads * thread_ops_squared) : 1.0;
+    result->retries = thread_ops > 0.0 ? retries / thread_ops : 0.0;
+    result->spins = thread_ops > 0.0 ? spins / thread_ops : 0.0;
+    result->retry_depth = retries ? 1.0 * retry_levels / retries : 0.0;
+    result->retry_skipped = retries ? 1.0 * skipped_levels / retries : 0.0;
+
+    size_t n_keys;
+    size_t bytes = skiplist_memory(skiplist, imp, &n_keys);
+    result->bytes_per_key = n_keys ? 1.0 * bytes / n_keys : 0.0;
+    result->resident_mb = resident_mb();
 
     skiplist_destroy(skiplist, imp);
+    key_strings_destroy();
     return result;
 }
 
 
-int main(void)
+void print_result(struct bench_result* result)
 {
-    uint16_t num_threads = 4;
-    uint16_t time_interval = 5;
-    uint16_t n_prefill = 10000;
-    operations_mix_t operations_mix = {0.1, 0.8};
-    keyrange_t keyrange = {0, 100000};
-    uint8_t levels = 4;
-    double prob = 0.5;
-    selection_strategy strat = UNIQUE;
-    key_overlap overlap = COMMON;
-    implementation imp = FINE;
-
-    struct bench_result* result = parallel_skiplist_benchmark(num_threads, time_interval, n_prefill, operations_mix,
-        strat, overlap, 12345, keyrange, levels, prob, imp);
-
-    if (!result) {
-        fprintf(stderr, "Error: Benchmark failed.\n");
-        return EXIT_FAILURE;
-    }
-
     float total_ops = result->counters.successfull_adds + result->counters.failed_adds +
                       result->counters.successfull_contains + result->counters.failed_contains +
-                      result->counters.successfull_removes + result->counters.failed_removes;
+                      result->counters.successfull_removes + result->counters.failed_removes +
+                      result->counters.successfull_ranges + result->counters.failed_ranges;
 
     printf("Total CPU time: %.2f seconds\n", result->cpu_time);
     printf("Total Operations: %.0f\n", total_ops);
@@ -611,8 +1388,47 @@ int main(void)
         result->counters.successfull_removes, result->counters.successfull_removes + result->counters.failed_removes);
     printf("Contains: %d successful / %d attempted\n",
         result->counters.successfull_contains, result->counters.successfull_contains + result->counters.failed_contains);
+    printf("Range scans: %d non-empty / %d attempted, %.1f keys per scan\n",
+        result->counters.successfull_ranges, result->counters.successfull_ranges + result->counters.failed_ranges,
+        result->keys_per_range);
     printf("Throughput: %.3e ops/sec\n", total_ops / result->cpu_time);
+    printf("Memory: %.1f bytes per key, %.1f MiB resident\n", result->bytes_per_key, result->resident_mb);
+    printf("Lock wait: %.0f ns average, %.0f ns longest\n", result->lock_wait_ns, result->max_lock_wait_ns);
+    printf("Fairness: %.3f\n", result->fairness);
+    printf("Retries: %.3f per operation, %.1f spins per operation\n", result->retries, result->spins);
+    printf("Retry depth: %.2f levels searched, %.2f levels skipped per retry\n",
+        result->retry_depth, result->retry_skipped);
+}
 
-    free(result);
+int main(void)
+{
+    uint16_t num_threads = 4;
+    uint16_t time_interval = 5;
+    uint16_t n_prefill = 10000;
+    operations_mix_t operations_mix = {0.1, 0.8, 0.0};
+    keyrange_t keyrange = {0, 100000};
+    uint8_t levels = 4;
+    double prob = 0.5;
+    selection_strategy strat = UNIQUE;
+    key_overlap overlap = COMMON;
+    implementation imp = COARSE;
+    const char *allocator_strings[] = {"heap", "arena"};
+
+    /* Compare both node allocators */
+    for (node_allocator allocator = HEAP_ALLOC; allocator <= ARENA_ALLOC; allocator++)
+    {
+        bench_options_t options = {allocator, RANDOM_TOWERS, 1, false, 100, OMP_LOCK, NO_BACKOFF, YIELD_WAIT};
+        struct bench_result* result = parallel_skiplist_benchmark(num_threads, time_interval, n_prefill, operations_mix,
+            strat, overlap, 12345, keyrange, levels, prob, imp, options);
+
+        if (!result) {
+            fprintf(stderr, "Error: Benchmark failed.\n");
+            return EXIT_FAILURE;
+        }
+
+        printf("Node allocator: %s\n", allocator_strings[allocator]);
+        print_result(result);
+        free(result);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include "../inc/bravo_lock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Slot of the calling thread, assigned round robin on first use */
+static __thread int thread_slot = -1;
+static int next_slot = 0;
+
+static inline int my_slot(void) {
+    if (thread_slot < 0) thread_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % BRAVO_SLOTS;
+    return thread_slot;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* Pauses a revoking writer spins for before it yields, a reader
+  holding a slot may have been preempted */
+#define BRAVO_SPINS (1024)
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+bravo_lock* bravo_lock_init(void) {
+    bravo_lock* lock = (bravo_lock*)aligned_alloc(BRAVO_SLOT_SIZE, sizeof(bravo_lock));
+    if (!lock) return NULL;
+    memset(lock->slots, 0, sizeof(lock->slots));
+    lock->read_bias = true;
+    lock->inhibit_until = 0;
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    int error = pthread_rwlock_init(&lock->rwlock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if (error) {
+        free(lock);
+        return NULL;
+    }
+    return lock;
+}
+
+void bravo_lock_destroy(bravo_lock* lock) {
+    pthread_rwlock_destroy(&lock->rwlock);
+    free(lock);
+}
+
+int bravo_read_lock(bravo_lock* lock) {
+    if (__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED)) {
+        int slot = my_slot();
+        __atomic_fetch_add(&lock->slots[slot].readers, 1, __ATOMIC_SEQ_CST);
+        /* a writer turns the bias off before it looks at the slots,
+          so either it waits for this reader or the reader sees it */
+        if (__atomic_load_n(&lock->read_bias, __ATOMIC_SEQ_CST)) return slot;
+        __atomic_fetch_sub(&lock->slots[slot].readers, 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_rwlock_rdlock(&lock->rwlock);
+    /* no writer can be revoking while the underlying lock is held shared */
+    if (!__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED) &&
+        now_ns() >= __atomic_load_n(&lock->inhibit_until, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&lock->read_bias, true, __ATOMIC_RELAXED);
+    }
+    return -1;
+}
+
+void bravo_read_unlock(bravo_lock* lock, int token) {
+    if (token >= 0) __atomic_fetch_sub(&lock->slots[token].readers, 1, __ATOMIC_RELEASE);
+    else pthread_rwlock_unlock(&lock->rwlock);
+}
+
+void bravo_write_lock(bravo_lock* lock) {
+    pthread_rwlock_wrlock(&lock->rwlock);
+    if (!__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED)) return;
+
+    /* revoke the bias and wait for the readers that got in through the slots */
+    uint64_t start = now_ns();
+    __atomic_store_n(&lock->read_bias, false, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < BRAVO_SLOTS; i++) {
+        for (int spins = 0; __atomic_load_n(&lock->slots[i].readers, __ATOMIC_SEQ_CST); spins++) {
+            if (spins < BRAVO_SPINS) cpu_relax();
+            else sched_yield();
+        }
+    }
+    uint64_t end = now_ns();
+    __atomic_store_n(&lock->inhibit_until, end + (end - start) * BRAVO_INHIBIT_FACTOR, __ATOMIC_RELAXED);
+}
+
+void bravo_write_unlock(bravo_lock* lock) {
+    pthread_rwlock_unlock(&lock->rwlock);
+}
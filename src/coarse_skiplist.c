@@ -1,45 +1,298 @@
 #include "../inc/coarse_skiplist.h"
+#include "../inc/thread_slot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
 #include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-coarse_list* coarse_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange) {
+/* Reader slot of the calling thread for COARSE_SEQLOCK, -1 while
+  COARSE_READER_SLOTS other running threads hold one */
+static inline int reader_slot(void) {
+    int index = thread_slot_get();
+    return index < COARSE_READER_SLOTS ? index : -1;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/* Size of a node with a tower of 'height' next pointers,
+  rounded up so consecutive nodes stay NODE_ALIGN aligned */
+static inline size_t node_size(uint8_t height) {
+    size_t size = sizeof(coarse_node) + sizeof(coarse_node*) * height;
+    return ((size + NODE_ALIGN - 1) / NODE_ALIGN) * NODE_ALIGN;
+}
+
+/* Allocate a node with an empty tower of 'height' next pointers.
+  With an arena the caller has to hold the list lock */
+static coarse_node* create_node(coarse_list* list, skey_t key, void* data, uint8_t height) {
+    coarse_node* node;
+    if (list->arena) {
+        node = (coarse_node*)node_arena_alloc(list->arena, node_size(height));
+    } else {
+        node = (coarse_node*)aligned_alloc(NODE_ALIGN, node_size(height));
+    }
+    if (!node) return NULL;
+    memset(node->next, 0, sizeof(coarse_node*) * height);
+    node->key = key;
+    node->height = height;
+    node->data = data;
+    return node;
+}
+
+/* With an arena the caller has to hold the list lock */
+static void destroy_node(coarse_list* list, coarse_node* node) {
+    if (list->arena) {
+        node_arena_free(list->arena, node, node_size(node->height));
+    } else {
+        free(node);
+    }
+}
+
+/* Height of a new node for 'key', it is present in level i+1 with
+  probability list->prob if it is in level i */
+static uint8_t random_height(coarse_list* list, skey_t key, rng_state* random_state) {
+    /* heights are drawn outside the lock, levels may grow meanwhile */
+    uint8_t levels = __atomic_load_n(&list->levels, __ATOMIC_RELAXED);
+    if (list->towers == HASHED_TOWERS)
+        return hashed_height(KEY_HASH(key), list->prob, list->height_shift, levels);
+    return geometric_height(random_state, list->prob, list->height_shift, levels);
+}
+
+/* Add levels until they are sized for 'size' keys, the caller has to
+  hold the list lock. The head already has a tower of SKIPLIST_MAX_LEVELS,
+  new levels start out empty */
+static void grow_levels(coarse_list* list, size_t size) {
+    while (size > list->capacity && list->levels < SKIPLIST_MAX_LEVELS) {
+        __atomic_store_n(&list->levels, list->levels + 1, __ATOMIC_RELAXED);
+        list->capacity = level_capacity(list->prob, list->levels);
+    }
+}
+
+/* Keep the removed 'node' until no optimistic reader can still be looking
+  at it, the caller has to hold the list lock */
+static void retire_node(coarse_list* list, coarse_node* node) {
+    if (list->n_limbo == list->limbo_capacity) {
+        size_t capacity = list->limbo_capacity ? 2 * list->limbo_capacity : COARSE_RECLAIM_BATCH;
+        coarse_retired* limbo = (coarse_retired*)realloc(list->limbo, sizeof(coarse_retired) * capacity);
+        /* leak the node rather than free it too early */
+        if (!limbo) return;
+        list->limbo = limbo;
+        list->limbo_capacity = capacity;
+    }
+    list->limbo[list->n_limbo].node = node;
+    list->limbo[list->n_limbo].epoch = list->epoch;
+    list->n_limbo++;
+}
+
+/* Free the nodes in limbo that were removed before the epoch of every
+  active optimistic reader. The caller has to hold the list lock with
+  'seq' odd, so readers that start meanwhile do not search */
+static void reclaim(coarse_list* list) {
+    /* readers entering from now on cannot reach any node in limbo */
+    uint64_t epoch = list->epoch + 1;
+    __atomic_store_n(&list->epoch, epoch, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint64_t oldest = epoch;
+    for (int i = 0; i < COARSE_READER_SLOTS; i++) {
+        uint64_t reader = __atomic_load_n(&list->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (reader && reader < oldest) oldest = reader;
+    }
+    size_t kept = 0;
+    for (size_t j = 0; j < list->n_limbo; j++) {
+        if (list->limbo[j].epoch < oldest) destroy_node(list, list->limbo[j].node);
+        else list->limbo[kept++] = list->limbo[j];
+    }
+    list->n_limbo = kept;
+    list->reclaim_at = kept + COARSE_RECLAIM_BATCH;
+}
+
+/* Take the list lock for an operation that modifies the list */
+static inline void lock_write(coarse_list* list) {
+    if (list->rw_lock) {
+        bravo_write_lock(list->rw_lock);
+        return;
+    }
+    list_lock_acquire(list->lock);
+    if (list->lock_mode == COARSE_SEQLOCK) {
+        /* optimistic readers that started before fail their validation */
+        __atomic_store_n(&list->seq, list->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+static inline void unlock_write(coarse_list* list) {
+    if (list->rw_lock) {
+        bravo_write_unlock(list->rw_lock);
+        return;
+    }
+    if (list->lock_mode == COARSE_SEQLOCK) {
+        if (list->n_limbo >= list->reclaim_at) reclaim(list);
+        __atomic_store_n(&list->seq, list->seq + 1, __ATOMIC_RELEASE);
+    }
+    list_lock_release(list->lock);
+}
+
+/* Take the list lock for an operation that only reads the list, shared
+  with other readers under COARSE_RWLOCK. Returns the token for unlock_read */
+static inline int lock_read(coarse_list* list) {
+    if (list->rw_lock) return bravo_read_lock(list->rw_lock);
+    list_lock_acquire(list->lock);
+    return 0;
+}
+
+static inline void unlock_read(coarse_list* list, int token) {
+    if (list->rw_lock) bravo_read_unlock(list->rw_lock, token);
+    else list_lock_release(list->lock);
+}
+
+coarse_list* coarse_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+    coarse_lock_mode lock_mode, lock_kind lock) {
     coarse_list* skiplist = (coarse_list*)malloc(sizeof(coarse_list));
     if (!skiplist) return NULL;
+    if (levels < 1) levels = 1;
+    if (levels > SKIPLIST_MAX_LEVELS) levels = SKIPLIST_MAX_LEVELS;
     skiplist->levels = levels;
     skiplist->prob = prob;
+    skiplist->height_shift = height_shift(prob);
+    skiplist->towers = RANDOM_TOWERS;
+    skiplist->size = 0;
+    skiplist->capacity = level_capacity(prob, levels);
     skiplist->keyrange.min = keyrange.min;
     skiplist->keyrange.max = keyrange.max;
 
+    skiplist->removals = 0;
+    skiplist->lock_mode = lock_mode;
+    skiplist->seq = 0;
+    skiplist->epoch = 1;
+    skiplist->readers = NULL;
+    skiplist->limbo = NULL;
+    skiplist->n_limbo = 0;
+    skiplist->limbo_capacity = 0;
+    skiplist->reclaim_at = COARSE_RECLAIM_BATCH;
+    if (lock_mode == COARSE_SEQLOCK) {
+        skiplist->readers = (coarse_reader_slot*)aligned_alloc(64, sizeof(coarse_reader_slot) * COARSE_READER_SLOTS);
+        if (!skiplist->readers) {
+            free(skiplist);
+            return NULL;
+        }
+        memset(skiplist->readers, 0, sizeof(coarse_reader_slot) * COARSE_READER_SLOTS);
+    }
+    skiplist->arena = NULL;
+    if (allocator == ARENA_ALLOC) {
+        skiplist->arena = node_arena_init(ARENA_CHUNK_SIZE);
+        if (!skiplist->arena) {
+            free(skiplist);
+            return NULL;
+        }
+    }
+
     /* Create head node */
-    skiplist->head = (coarse_node*)malloc(sizeof(coarse_node));
+    skiplist->head = create_node(skiplist, skiplist->keyrange.min, NULL, SKIPLIST_MAX_LEVELS);
     if (!skiplist->head) return NULL;
-    skiplist->head->next = (coarse_node**)malloc(sizeof(coarse_node*) * skiplist->levels);
-    for (size_t i = 0; i < skiplist->levels; i++) {
-        skiplist->head->next[i] = NULL;
-    }
-    skiplist->head->key = skiplist->keyrange.min;
 
-    skiplist->lock = (omp_lock_t*)malloc(sizeof(omp_lock_t));
+    skiplist->lock = list_lock_init(lock);
     if (!skiplist->lock) return NULL;
-    omp_init_lock(skiplist->lock);
+    skiplist->rw_lock = NULL;
+    if (lock_mode == COARSE_RWLOCK) {
+        skiplist->rw_lock = bravo_lock_init();
+        if (!skiplist->rw_lock) return NULL;
+    }
 
     return skiplist;
 }
 
+coarse_list* coarse_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+    uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+    coarse_lock_mode lock_mode, lock_kind lock, tower_mode towers, rng_state* random_state) {
+    coarse_list* list = coarse_skiplist_init(levels, prob, keyrange, allocator, lock_mode, lock);
+    if (!list) return NULL;
+    if (towers == HASHED_TOWERS) list->towers = HASHED_TOWERS;
+    /* size the levels for all keys up front, towers are only drawn once */
+    grow_levels(list, n);
+
+    /* Rightmost node of every level, new nodes are appended behind them.
+      The list is not shared yet, so no need for the lock */
+    coarse_node** last = (coarse_node**)malloc(sizeof(coarse_node*) * list->levels);
+    if (!last) {
+        coarse_skiplist_destroy(list);
+        return NULL;
+    }
+    for (size_t i = 0; i < list->levels; i++) {
+        last[i] = list->head;
+    }
+
+    size_t position = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], keyrange)) continue;
+        if (position > 0 && KEY_LE(keys[j], last[0]->key)) continue;
+        position++;
+
+        uint8_t height = towers == DETERMINISTIC_TOWERS ?
+            deterministic_height(position, list->prob, list->levels) : random_height(list, keys[j], random_state);
+        coarse_node* node = create_node(list, keys[j], values ? values[j] : NULL, height);
+        if (!node) {
+            free(last);
+            coarse_skiplist_destroy(list);
+            return NULL;
+        }
+        for (uint8_t i = 0; i < height; i++) {
+            last[i]->next[i] = node;
+            last[i] = node;
+        }
+    }
+    list->size = position;
+    free(last);
+    return list;
+}
+
+size_t coarse_skiplist_size(coarse_list* list) {
+    int token = lock_read(list);
+    size_t size = list->size;
+    unlock_read(list, token);
+    return size;
+}
+
+size_t coarse_skiplist_memory(coarse_list* list, size_t* n_keys) {
+    size_t bytes = 0;
+    size_t keys = 0;
+    int token = lock_read(list);
+    for (coarse_node* current = list->head->next[0]; current; current = current->next[0]) {
+        bytes += node_size(current->height);
+        keys++;
+    }
+    unlock_read(list, token);
+    if (n_keys) *n_keys = keys;
+    return bytes;
+}
+
 void coarse_skiplist_destroy(coarse_list* list) {
-    coarse_node* current = list->head;
-    while (current) {
-        coarse_node* next = current->next[0];
-        if (current->next) free(current->next);
-        free(current);
-        current = next;
-    }
-    omp_destroy_lock(list->lock);
-    free(list->lock);
+    if (list->arena) {
+        /* nodes live in the arena chunks, no need to walk the list */
+        node_arena_destroy(list->arena);
+    } else {
+        coarse_node* current = list->head;
+        while (current) {
+            coarse_node* next = current->next[0];
+            destroy_node(list, current);
+            current = next;
+        }
+        for (size_t j = 0; j < list->n_limbo; j++) {
+            destroy_node(list, list->limbo[j].node);
+        }
+    }
+    free(list->limbo);
+    free(list->readers);
+    list_lock_destroy(list->lock);
+    if (list->rw_lock) bravo_lock_destroy(list->rw_lock);
     free(list);
 }
 
@@ -47,119 +300,514 @@ void coarse_skiplist_destroy(coarse_list* list) {
   If 'key' is contained in 'list', 'pred' will contain a pointer to the node with 
   key = 'key' for each level it was present in
   Returns true if key was found, false otherwise */
-static bool find_predecessors(coarse_list* list, int key, coarse_node** preds) {
+static bool find_predecessors(coarse_list* list, skey_t key, coarse_node** preds) {
     coarse_node* current = list->head;
     for (int i = list->levels - 1; i >= 0; i--) {
         coarse_node* next = current->next[i];
-        while (next && key > next->key) {
+        while (next && KEY_GT(key, next->key)) {
             current = next;
             next = current->next[i];
         }
         preds[i] = current;
     }
-    return preds[0]->next[0] && preds[0]->next[0]->key == key;
+    return preds[0]->next[0] && KEY_EQ(preds[0]->next[0]->key, key);
 }
 
-coarse_node* coarse_skiplist_contains(coarse_list* list, int key) {
-    coarse_node** preds = (coarse_node**)malloc(sizeof(coarse_node*) * list->levels);
+/* Like find_predecessors, but starts from 'preds' left by an earlier search
+  as a finger. Only the levels where the finger lags behind 'key' are walked,
+  from the highest of them down, which is cheap if 'key' is close to the
+  finger. Every node in 'preds' has to be still linked. Falls back to a
+  search from the head if 'key' lies before the finger */
+static bool find_predecessors_from(coarse_list* list, skey_t key, coarse_node** preds) {
+    if (preds[0] != list->head && KEY_GE(preds[0]->key, key)) {
+        return find_predecessors(list, key, preds);
+    }
+    /* above the highest lagging level the finger still holds the predecessors */
+    int level = list->levels - 1;
+    while (level > 0 && !(preds[level]->next[level] && KEY_GT(key, preds[level]->next[level]->key))) {
+        level--;
+    }
+    coarse_node* current = preds[level];
+    for (int i = level; i >= 0; i--) {
+        /* the finger may be ahead at lower levels */
+        if (KEY_GT(preds[i]->key, current->key)) current = preds[i];
+        coarse_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+        preds[i] = current;
+    }
+    return current->next[0] && KEY_EQ(current->next[0]->key, key);
+}
+
+/* Unlink the node following preds[0] and return its data, the caller
+  has to hold the list lock. The predecessors stay linked, so they
+  remain a valid finger */
+static void* unlink_node(coarse_list* list, coarse_node** preds) {
+    coarse_node* target = preds[0]->next[0];
+    for (uint8_t i = 0; i < target->height; i++) {
+        __atomic_store_n(&preds[i]->next[i], target->next[i], __ATOMIC_RELAXED);
+    }
+    void* data = target->data;
+    /* optimistic readers may still be on the node, otherwise
+      recycle it while the arena is still protected */
+    if (list->lock_mode == COARSE_SEQLOCK) retire_node(list, target);
+    else if (list->arena) destroy_node(list, target);
+    list->size--;
+    list->removals++;
+    return data;
+}
+
+/* Link 'new_node' behind 'preds' in every level of its tower, the
+  caller has to hold the list lock */
+static void link_node(coarse_list* list, coarse_node** preds, coarse_node* new_node) {
+    for (uint8_t i = 0; i < new_node->height; i++) {
+        new_node->next[i] = preds[i]->next[i];
+        /* optimistic readers find the node initialized */
+        __atomic_store_n(&preds[i]->next[i], new_node, __ATOMIC_RELEASE);
+    }
+    grow_levels(list, ++list->size);
+}
+
+/* Predecessor array for a batch or finger, every level starts at the head.
+  It covers all levels the list may grow to while it is in use */
+static coarse_node** batch_preds(coarse_list* list) {
+    coarse_node** preds = (coarse_node**)malloc(sizeof(coarse_node*) * SKIPLIST_MAX_LEVELS);
     if (!preds) return NULL;
+    for (size_t i = 0; i < SKIPLIST_MAX_LEVELS; i++) {
+        preds[i] = list->head;
+    }
+    return preds;
+}
+
+/* Search 'key' without the lock for COARSE_SEQLOCK. Nodes in the
+  list always point to larger keys and removed nodes stay readable
+  while the reader is registered, so the search ends even if writers
+  interfere. Returns false if it failed validation on every attempt */
+static bool optimistic_contains(coarse_list* list, skey_t key, coarse_node** result) {
+    int slot = reader_slot();
+    if (slot < 0) return false;
+    coarse_reader_slot* reader = &list->readers[slot];
+    /* has to be visible before the counter is read, see reclaim */
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&list->epoch, __ATOMIC_RELAXED), __ATOMIC_SEQ_CST);
 
+    bool valid = false;
+    for (int attempt = 0; attempt < COARSE_OPTIMISTIC_RETRIES && !valid; attempt++) {
+        uint64_t seq = __atomic_load_n(&list->seq, __ATOMIC_SEQ_CST);
+        if (seq & 1) {
+            cpu_relax();
+            continue;
+        }
+        coarse_node* current = list->head;
+        coarse_node* next = NULL;
+        for (int i = __atomic_load_n(&list->levels, __ATOMIC_RELAXED) - 1; i >= 0; i--) {
+            next = __atomic_load_n(&current->next[i], __ATOMIC_ACQUIRE);
+            while (next && KEY_GT(key, next->key)) {
+                current = next;
+                next = __atomic_load_n(&current->next[i], __ATOMIC_ACQUIRE);
+            }
+        }
+        *result = next && KEY_EQ(next->key, key) ? next : NULL;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        valid = __atomic_load_n(&list->seq, __ATOMIC_RELAXED) == seq;
+    }
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    return valid;
+}
+
+coarse_node* coarse_skiplist_contains(coarse_list* list, skey_t key) {
     coarse_node* result = NULL;
-    omp_set_lock(list->lock);
+    if (list->lock_mode == COARSE_SEQLOCK && optimistic_contains(list, key, &result)) return result;
+
+    coarse_node** preds = (coarse_node**)malloc(sizeof(coarse_node*) * SKIPLIST_MAX_LEVELS);
+    if (!preds) return NULL;
+
+    int token = lock_read(list);
     if (find_predecessors(list, key, preds)) {
         result = preds[0]->next[0];
     }
-    omp_unset_lock(list->lock);
+    unlock_read(list, token);
     free(preds);
     return result;
 }
 
-bool coarse_skiplist_add(coarse_list* list, int key, void* data, unsigned short int random_state[3]) {
-    if (key < list->keyrange.min || key > list->keyrange.max) return false;
+bool coarse_skiplist_add(coarse_list* list, skey_t key, void* data, rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
 
-    coarse_node** preds = (coarse_node**)malloc(sizeof(coarse_node*) * list->levels);
+    coarse_node** preds = (coarse_node**)malloc(sizeof(coarse_node*) * SKIPLIST_MAX_LEVELS);
     if (!preds) return false;
 
-    /* Create new node */
-    coarse_node* new_node = (coarse_node*)malloc(sizeof(coarse_node));
-    if (!new_node) {
-        free(preds);
-        return false;
-    }
-    new_node->next = (coarse_node**)malloc(sizeof(coarse_node*) * list->levels);
-    if (!new_node->next) {
-        free(new_node);
-        free(preds);
-        return false;
-    }
-    memset(new_node->next, 0, sizeof(coarse_node*) * list->levels);
-    new_node->key = key;
-    new_node->data = data;
+    uint8_t linking_levels = random_height(list, key, random_state);
 
-    uint8_t linking_levels = 1;
-    /* Cast die until it decides against more levels */
-    for (size_t i = 1; i < list->levels; i++) {
-        double die;
-        drand48_r((struct drand48_data*)random_state, &die);
-        if (die > list->prob) break;
-        linking_levels++;
+    /* Create new node, the arena is protected by the list lock
+      so it has to wait for the critical section */
+    coarse_node* new_node = NULL;
+    if (!list->arena) {
+        new_node = create_node(list, key, data, linking_levels);
+        if (!new_node) {
+            free(preds);
+            return false;
+        }
     }
 
-    omp_set_lock(list->lock);
+    lock_write(list);
     if (find_predecessors(list, key, preds)) {
-        omp_unset_lock(list->lock);
-        free(new_node->next);
-        free(new_node);
+        unlock_write(list);
+        if (new_node) destroy_node(list, new_node);
         free(preds);        
         return false; /* Key already exists */
     }
-    
-    /* Link up to pre-computed level */
-    for (uint8_t i = 0; i < linking_levels; i++) {
-        new_node->next[i] = preds[i]->next[i];
-        preds[i]->next[i] = new_node;
+    if (!new_node) {
+        new_node = create_node(list, key, data, linking_levels);
+        if (!new_node) {
+            unlock_write(list);
+            free(preds);
+            return false;
+        }
     }
-    omp_unset_lock(list->lock);
+
+    /* Link up to pre-computed level */
+    link_node(list, preds, new_node);
+    unlock_write(list);
 
     free(preds);
     return true;
 }
 
-bool coarse_skiplist_remove(coarse_list* list, int key, void** data_out) {
-    coarse_node* target;
+bool coarse_skiplist_remove(coarse_list* list, skey_t key, void** data_out) {
     coarse_node** preds;
 
-    preds = (coarse_node**)malloc(sizeof(coarse_node*) * list->levels);
+    preds = (coarse_node**)malloc(sizeof(coarse_node*) * SKIPLIST_MAX_LEVELS);
 
     /* Critical Section */
-    omp_set_lock(list->lock);
+    lock_write(list);
     if (!find_predecessors(list, key, preds)) {
-        omp_unset_lock(list->lock);
+        unlock_write(list);
         free(preds);
         return false; /* Key not found */
     }
 
     /* Unlink */
-    target = preds[0]->next[0];
-    for (size_t i = 0; i < list->levels; i++) {
-        if (preds[i]->next[i] == target) {
-            preds[i]->next[i] = target->next[i];
-        }
-    }
-    omp_unset_lock(list->lock);
+    void* data = unlink_node(list, preds);
+    if (data_out) *data_out = data;
+    unlock_write(list);
     
-    if (data_out) *data_out = target->data;
     //free(target->next);
     //free(target);
     free(preds);
     return true;
 }
 
+size_t coarse_skiplist_contains_batch(coarse_list* list, const skey_t* keys, size_t n, coarse_node** results) {
+    coarse_node** preds = batch_preds(list);
+    if (!preds) return 0;
+
+    size_t found = 0;
+    int token = lock_read(list);
+    for (size_t j = 0; j < n; j++) {
+        coarse_node* result = NULL;
+        if (find_predecessors_from(list, keys[j], preds)) {
+            result = preds[0]->next[0];
+            found++;
+        }
+        if (results) results[j] = result;
+    }
+    unlock_read(list, token);
+    free(preds);
+    return found;
+}
+
+size_t coarse_skiplist_add_batch(coarse_list* list, const skey_t* keys, void** values, size_t n,
+    rng_state* random_state) {
+    coarse_node** preds = batch_preds(list);
+    if (!preds) return 0;
+
+    /* Draw the heights and, without an arena, create the nodes before
+      entering the critical section like coarse_skiplist_add */
+    coarse_node** nodes = (coarse_node**)calloc(n ? n : 1, sizeof(coarse_node*));
+    uint8_t* heights = (uint8_t*)malloc(n ? n : 1);
+    if (!nodes || !heights) {
+        free(nodes);
+        free(heights);
+        free(preds);
+        return 0;
+    }
+    for (size_t j = 0; j < n; j++) {
+        heights[j] = random_height(list, keys[j], random_state);
+        if (!list->arena && KEY_IN_RANGE(keys[j], list->keyrange)) {
+            nodes[j] = create_node(list, keys[j], values ? values[j] : NULL, heights[j]);
+        }
+    }
+
+    size_t added = 0;
+    lock_write(list);
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], list->keyrange)) continue;
+        if (find_predecessors_from(list, keys[j], preds)) continue; /* Key already exists */
+
+        coarse_node* new_node = nodes[j];
+        if (list->arena) new_node = create_node(list, keys[j], values ? values[j] : NULL, heights[j]);
+        if (!new_node) continue;
+
+        /* Link up to pre-computed level */
+        link_node(list, preds, new_node);
+        nodes[j] = NULL;
+        added++;
+    }
+    unlock_write(list);
+
+    /* nodes of keys that already existed were not linked */
+    if (!list->arena) {
+        for (size_t j = 0; j < n; j++) {
+            if (nodes[j]) destroy_node(list, nodes[j]);
+        }
+    }
+    free(heights);
+    free(nodes);
+    free(preds);
+    return added;
+}
+
+size_t coarse_skiplist_remove_batch(coarse_list* list, const skey_t* keys, size_t n, void** data_out) {
+    coarse_node** preds = batch_preds(list);
+    if (!preds) return 0;
+
+    size_t removed = 0;
+    /* Critical Section */
+    lock_write(list);
+    for (size_t j = 0; j < n; j++) {
+        if (data_out) data_out[j] = NULL;
+        if (!find_predecessors_from(list, keys[j], preds)) continue; /* Key not found */
+
+        void* data = unlink_node(list, preds);
+        if (data_out) data_out[j] = data;
+        removed++;
+    }
+    unlock_write(list);
+    free(preds);
+    return removed;
+}
+
+void coarse_skiplist_apply_batch(coarse_list* list, coarse_op* ops, size_t n) {
+    coarse_node** preds = batch_preds(list);
+    if (!preds) {
+        for (size_t j = 0; j < n; j++) ops[j].result = false;
+        return;
+    }
+
+    /* Critical Section */
+    lock_write(list);
+    for (size_t j = 0; j < n; j++) {
+        coarse_op* op = &ops[j];
+        bool found = KEY_IN_RANGE(op->key, list->keyrange) && find_predecessors_from(list, op->key, preds);
+        op->result = false;
+        switch (op->type) {
+        case COARSE_OP_CONTAINS:
+            op->data = found ? preds[0]->next[0]->data : NULL;
+            op->result = found;
+            break;
+        case COARSE_OP_ADD:
+            if (found || !KEY_IN_RANGE(op->key, list->keyrange)) break; /* Key already exists */
+            coarse_node* new_node = create_node(list, op->key, op->data,
+                random_height(list, op->key, op->random_state));
+            if (!new_node) break;
+            link_node(list, preds, new_node);
+            op->result = true;
+            break;
+        case COARSE_OP_REMOVE:
+            op->data = found ? unlink_node(list, preds) : NULL;
+            op->result = found;
+            break;
+        }
+    }
+    unlock_write(list);
+    free(preds);
+}
+
+coarse_finger* coarse_skiplist_finger_init(coarse_list* list) {
+    coarse_finger* finger = (coarse_finger*)malloc(sizeof(coarse_finger));
+    if (!finger) return NULL;
+    finger->preds = batch_preds(list);
+    if (!finger->preds) {
+        free(finger);
+        return NULL;
+    }
+    int token = lock_read(list);
+    finger->removals = list->removals;
+    unlock_read(list, token);
+    return finger;
+}
+
+void coarse_skiplist_finger_destroy(coarse_finger* finger) {
+    free(finger->preds);
+    free(finger);
+}
+
+/* Search 'key' starting from 'finger', the caller has to hold the list lock.
+  A finger that saw fewer removals than the list may hold unlinked nodes
+  and starts over from the head */
+static bool finger_search(coarse_list* list, coarse_finger* finger, skey_t key) {
+    if (finger->removals != list->removals) {
+        finger->removals = list->removals;
+        return find_predecessors(list, key, finger->preds);
+    }
+    return find_predecessors_from(list, key, finger->preds);
+}
+
+coarse_node* coarse_skiplist_finger_contains(coarse_list* list, coarse_finger* finger, skey_t key) {
+    coarse_node* result = NULL;
+    int token = lock_read(list);
+    if (finger_search(list, finger, key)) {
+        result = finger->preds[0]->next[0];
+    }
+    unlock_read(list, token);
+    return result;
+}
+
+bool coarse_skiplist_finger_add(coarse_list* list, coarse_finger* finger, skey_t key, void* data,
+    rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+
+    uint8_t linking_levels = random_height(list, key, random_state);
+
+    /* Create new node, the arena is protected by the list lock
+      so it has to wait for the critical section */
+    coarse_node* new_node = NULL;
+    if (!list->arena) {
+        new_node = create_node(list, key, data, linking_levels);
+        if (!new_node) return false;
+    }
+
+    lock_write(list);
+    if (finger_search(list, finger, key)) {
+        unlock_write(list);
+        if (new_node) destroy_node(list, new_node);
+        return false; /* Key already exists */
+    }
+    if (!new_node) {
+        new_node = create_node(list, key, data, linking_levels);
+        if (!new_node) {
+            unlock_write(list);
+            return false;
+        }
+    }
+
+    /* Link up to pre-computed level */
+    link_node(list, finger->preds, new_node);
+    unlock_write(list);
+    return true;
+}
+
+bool coarse_skiplist_finger_remove(coarse_list* list, coarse_finger* finger, skey_t key, void** data_out) {
+    lock_write(list);
+    if (!finger_search(list, finger, key)) {
+        unlock_write(list);
+        return false; /* Key not found */
+    }
+    void* data = unlink_node(list, finger->preds);
+    /* the own removal leaves the finger intact */
+    finger->removals = list->removals;
+    unlock_write(list);
+    if (data_out) *data_out = data;
+    return true;
+}
+
+/* First node with a key not smaller than 'key', NULL if there is none.
+  The caller has to hold the list lock */
+static coarse_node* find_first(coarse_list* list, skey_t key) {
+    coarse_node* current = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        coarse_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+    }
+    return current->next[0];
+}
+
+/* First node with a key larger than 'key', NULL if there is none.
+  The caller has to hold the list lock */
+static coarse_node* find_after(coarse_list* list, skey_t key) {
+    coarse_node* node = find_first(list, key);
+    return node && KEY_EQ(node->key, key) ? node->next[0] : node;
+}
+
+size_t coarse_skiplist_range_scan(coarse_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx) {
+    skey_t keys[COARSE_SCAN_CHUNK];
+    void* data[COARSE_SCAN_CHUNK];
+    size_t visited = 0;
+    coarse_node* last = NULL;
+    skey_t last_key = lo;
+    uint64_t removals = 0;
+
+    while (true) {
+        int n = 0;
+        int token = lock_read(list);
+        /* continue behind the previous chunk, unless its last node may be gone */
+        coarse_node* current;
+        if (!last) current = find_first(list, lo);
+        else if (removals == list->removals) current = last->next[0];
+        else current = find_after(list, last_key);
+        for (; current && KEY_LE(current->key, hi) && n < COARSE_SCAN_CHUNK; current = current->next[0]) {
+            keys[n] = current->key;
+            data[n] = current->data;
+            last = current;
+            n++;
+        }
+        bool more = current && KEY_LE(current->key, hi);
+        removals = list->removals;
+        unlock_read(list, token);
+
+        for (int i = 0; i < n; i++) {
+            visited++;
+            if (!callback(keys[i], data[i], ctx)) return visited;
+        }
+        if (!more) return visited;
+        last_key = keys[n - 1];
+    }
+}
+
+/* Move 'cursor' onto 'node', the caller has to hold the list lock */
+static bool cursor_set(coarse_list* list, coarse_cursor* cursor, coarse_node* node) {
+    cursor->node = node;
+    cursor->removals = list->removals;
+    cursor->valid = node != NULL;
+    if (node) {
+        cursor->key = node->key;
+        cursor->data = node->data;
+    }
+    return cursor->valid;
+}
+
+bool coarse_skiplist_cursor_seek(coarse_list* list, coarse_cursor* cursor, skey_t key) {
+    int token = lock_read(list);
+    bool valid = cursor_set(list, cursor, find_first(list, key));
+    unlock_read(list, token);
+    return valid;
+}
+
+bool coarse_skiplist_cursor_next(coarse_list* list, coarse_cursor* cursor) {
+    if (!cursor->valid) return false;
+    int token = lock_read(list);
+    coarse_node* next;
+    if (cursor->removals == list->removals) {
+        next = cursor->node->next[0];
+    } else {
+        /* the node may have been removed, search for its successor */
+        next = find_after(list, cursor->key);
+    }
+    bool valid = cursor_set(list, cursor, next);
+    unlock_read(list, token);
+    return valid;
+}
+
 /*
 int main(int argc, char const *argv[])
 {
     keyrange_t keyrange = {0, 10};
-    coarse_list* list = coarse_skiplist_init(4, 0.5, keyrange);
+    coarse_list* list = coarse_skiplist_init(4, 0.5, keyrange, HEAP_ALLOC);
 
     unsigned short int *random_state = (unsigned short int*)malloc(6);
     if (!random_state) return NULL;
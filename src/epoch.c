@@ -0,0 +1,236 @@
+#include "../inc/epoch.h"
+#include "../inc/thread_slot.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Pauses a thread spins for on the guest lock before it yields */
+#define GUEST_LOCK_SPINS (1024)
+
+/* Slot of the calling thread, the same in every domain.
+  EPOCH_THREAD_SLOTS or more if it has none */
+static inline int slot_index(void) {
+    int index = thread_slot_get();
+    return index < 0 ? EPOCH_THREAD_SLOTS : index;
+}
+
+static inline void guest_lock(epoch_domain* domain) {
+    int spins = 0;
+    while (__atomic_exchange_n(&domain->guest_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&domain->guest_lock, __ATOMIC_RELAXED)) {
+            if (spins++ < GUEST_LOCK_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+                _mm_pause();
+#endif
+            } else {
+                sched_yield();
+            }
+        }
+    }
+}
+
+static inline void guest_unlock(epoch_domain* domain) {
+    __atomic_store_n(&domain->guest_lock, 0, __ATOMIC_RELEASE);
+}
+
+epoch_domain* epoch_domain_init(epoch_mode mode, epoch_free_fn free_fn, void* ctx) {
+    epoch_domain* domain = (epoch_domain*)malloc(sizeof(epoch_domain));
+    if (!domain) return NULL;
+    domain->slots = (epoch_slot*)aligned_alloc(64, sizeof(epoch_slot) * EPOCH_THREAD_SLOTS);
+    if (!domain->slots) {
+        free(domain);
+        return NULL;
+    }
+    memset(domain->slots, 0, sizeof(epoch_slot) * EPOCH_THREAD_SLOTS);
+    for (int i = 0; i < EPOCH_THREAD_SLOTS; i++) {
+        domain->slots[i].limbo.reclaim_at = EPOCH_RECLAIM_BATCH;
+    }
+    domain->epoch = 1;
+    domain->mode = mode;
+    domain->guests = 0;
+    domain->guest_lock = 0;
+    memset(&domain->guest_limbo, 0, sizeof(epoch_limbo));
+    domain->free_fn = free_fn;
+    domain->ctx = ctx;
+    return domain;
+}
+
+static void limbo_destroy(epoch_domain* domain, epoch_limbo* limbo) {
+    for (size_t j = 0; j < limbo->n; j++) {
+        domain->free_fn(limbo->objects[j].object, domain->ctx);
+    }
+    free(limbo->objects);
+}
+
+void epoch_domain_destroy(epoch_domain* domain) {
+    for (int i = 0; i < EPOCH_THREAD_SLOTS; i++) {
+        limbo_destroy(domain, &domain->slots[i].limbo);
+    }
+    limbo_destroy(domain, &domain->guest_limbo);
+    free(domain->slots);
+    free(domain);
+}
+
+epoch_slot* epoch_enter(epoch_domain* domain) {
+    int index = slot_index();
+    if (index >= EPOCH_THREAD_SLOTS) {
+        __atomic_fetch_add(&domain->guests, 1, __ATOMIC_SEQ_CST);
+        return NULL;
+    }
+    epoch_slot* slot = &domain->slots[index];
+    if (slot->depth++ > 0 || domain->mode != EPOCH_BASED) return slot;
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->epoch, epoch, __ATOMIC_RELAXED);
+    /* the announcement is visible before any object is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return slot;
+}
+
+bool epoch_resume(epoch_domain* domain, epoch_slot** slot, uint64_t* saved) {
+    int index = slot_index();
+    if (index >= EPOCH_THREAD_SLOTS || domain->mode != EPOCH_BASED) {
+        /* nothing keeps objects from being freed between operations */
+        *slot = epoch_enter(domain);
+        *saved = 0;
+        return false;
+    }
+    epoch_slot* self = &domain->slots[index];
+    *slot = self;
+    if (self->depth++ > 0) {
+        /* objects found from now on are kept by the outer operation */
+        *saved = self->epoch;
+        return false;
+    }
+    if (*saved) {
+        /* the kept objects are safe if no attempt to free objects advanced
+          the epoch before this announcement became visible */
+        __atomic_store_n(&self->epoch, *saved, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST) == *saved) return true;
+    }
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&self->epoch, epoch, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    *saved = epoch;
+    return false;
+}
+
+/* Add 'object' to 'limbo' as retired in 'epoch' */
+static void limbo_add(epoch_limbo* limbo, void* object, uint64_t epoch) {
+    if (limbo->n == limbo->capacity) {
+        size_t capacity = limbo->capacity ? 2 * limbo->capacity : EPOCH_RECLAIM_BATCH;
+        epoch_retired* objects = (epoch_retired*)realloc(limbo->objects, sizeof(epoch_retired) * capacity);
+        /* leak the object rather than free it too early */
+        if (!objects) return;
+        limbo->objects = objects;
+        limbo->capacity = capacity;
+    }
+    limbo->objects[limbo->n].object = object;
+    limbo->objects[limbo->n].epoch = epoch;
+    limbo->n++;
+}
+
+void epoch_retire(epoch_domain* domain, epoch_slot* slot, void* object) {
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+    if (slot) {
+        limbo_add(&slot->limbo, object, epoch);
+        return;
+    }
+    guest_lock(domain);
+    limbo_add(&domain->guest_limbo, object, epoch);
+    guest_unlock(domain);
+}
+
+static int compare_pointers(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(void* const*)a;
+    uintptr_t y = (uintptr_t)*(void* const*)b;
+    return (x > y) - (x < y);
+}
+
+/* Objects no running operation can read, those retired before epoch
+  'oldest' with EPOCH_BASED, those not among the 'n' sorted 'hazards'
+  with HAZARD_POINTERS */
+typedef struct _epoch_scan {
+  uint64_t oldest;
+  void** hazards;
+  size_t n;
+} epoch_scan;
+
+static inline bool unreachable(epoch_domain* domain, epoch_scan* scan, epoch_retired* retired) {
+    if (domain->mode == EPOCH_BASED) return retired->epoch < scan->oldest;
+    return !bsearch(&retired->object, scan->hazards, scan->n, sizeof(void*), compare_pointers);
+}
+
+/* Hand the objects in 'limbo' that 'scan' found unreachable to the
+  free callback, keep the others and those it declines */
+static void free_unreachable(epoch_domain* domain, epoch_limbo* limbo, epoch_scan* scan) {
+    size_t kept = 0;
+    for (size_t j = 0; j < limbo->n; j++) {
+        if (!unreachable(domain, scan, &limbo->objects[j]) ||
+            !domain->free_fn(limbo->objects[j].object, domain->ctx)) {
+            limbo->objects[kept++] = limbo->objects[j];
+        }
+    }
+    limbo->n = kept;
+}
+
+/* Free the objects retired by 'slot', and those of the guests, that no
+  running operation can reach. The caller must not be in an operation */
+static void reclaim(epoch_domain* domain, epoch_slot* slot) {
+    void* hazards[EPOCH_THREAD_SLOTS * EPOCH_HAZARDS];
+    epoch_scan scan = {0, hazards, 0};
+    if (domain->mode == EPOCH_BASED) {
+        /* operations that start from now on cannot reach any object in limbo */
+        scan.oldest = __atomic_add_fetch(&domain->epoch, 1, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < EPOCH_THREAD_SLOTS; i++) {
+            uint64_t epoch = __atomic_load_n(&domain->slots[i].epoch, __ATOMIC_SEQ_CST);
+            if (epoch && epoch < scan.oldest) scan.oldest = epoch;
+        }
+    } else {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        for (int i = 0; i < EPOCH_THREAD_SLOTS; i++) {
+            for (int h = 0; h < EPOCH_HAZARDS; h++) {
+                void* object = __atomic_load_n(&domain->slots[i].hazards[h], __ATOMIC_RELAXED);
+                if (object) hazards[scan.n++] = object;
+            }
+        }
+        qsort(hazards, scan.n, sizeof(void*), compare_pointers);
+    }
+    /* a running guest may still read any object in limbo */
+    if (__atomic_load_n(&domain->guests, __ATOMIC_SEQ_CST) == 0) {
+        free_unreachable(domain, &slot->limbo, &scan);
+        if (domain->guest_limbo.n && !__atomic_exchange_n(&domain->guest_lock, 1, __ATOMIC_ACQUIRE)) {
+            free_unreachable(domain, &domain->guest_limbo, &scan);
+            guest_unlock(domain);
+        }
+    }
+    /* objects kept by long operations are not scanned again for every batch */
+    slot->limbo.reclaim_at = slot->limbo.n + slot->limbo.n / 2 + EPOCH_RECLAIM_BATCH;
+}
+
+void epoch_leave(epoch_domain* domain, epoch_slot* slot) {
+    if (!slot) {
+        __atomic_fetch_sub(&domain->guests, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    if (--slot->depth > 0) return;
+    if (domain->mode == EPOCH_BASED) {
+        __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+    } else {
+        for (int h = 0; h < EPOCH_HAZARDS; h++) {
+            if (slot->hazards[h]) __atomic_store_n(&slot->hazards[h], NULL, __ATOMIC_RELEASE);
+        }
+    }
+    if (slot->limbo.n >= slot->limbo.reclaim_at) reclaim(domain, slot);
+}
+
+size_t epoch_retired_count(epoch_domain* domain) {
+    size_t n = domain->guest_limbo.n;
+    for (int i = 0; i < EPOCH_THREAD_SLOTS; i++) {
+        n += domain->slots[i].limbo.n;
+    }
+    return n;
+}
@@ -0,0 +1,161 @@
+#include "../inc/fc_skiplist.h"
+#include "../inc/thread_slot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Pauses a waiting thread spins for before it yields, the
+  combiner may have been preempted */
+#define FC_SPINS (1024)
+
+/* Slot of the calling thread, FC_SLOTS or more if it has none */
+static inline int slot_index(void) {
+    int index = thread_slot_get();
+    return index < 0 ? FC_SLOTS : index;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/* Wrap 'coarse' into a flat-combining list, NULL if out of memory */
+static fc_list* wrap(coarse_list* coarse) {
+    if (!coarse) return NULL;
+    fc_list* list = (fc_list*)malloc(sizeof(fc_list));
+    if (!list) return NULL;
+    list->list = coarse;
+    list->slots = (fc_slot*)aligned_alloc(64, sizeof(fc_slot) * FC_SLOTS);
+    if (!list->slots) {
+        free(list);
+        return NULL;
+    }
+    memset(list->slots, 0, sizeof(fc_slot) * FC_SLOTS);
+    list->combiner = (omp_lock_t*)malloc(sizeof(omp_lock_t));
+    if (!list->combiner) {
+        free(list->slots);
+        free(list);
+        return NULL;
+    }
+    omp_init_lock(list->combiner);
+    return list;
+}
+
+fc_list* fc_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator) {
+    return wrap(coarse_skiplist_init(levels, prob, keyrange, allocator, COARSE_MUTEX, OMP_LOCK));
+}
+
+fc_list* fc_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+    uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+    tower_mode towers, rng_state* random_state) {
+    return wrap(coarse_skiplist_build_sorted(keys, values, n, levels, prob, keyrange, allocator,
+        COARSE_MUTEX, OMP_LOCK, towers, random_state));
+}
+
+void fc_skiplist_destroy(fc_list* list) {
+    coarse_skiplist_destroy(list->list);
+    omp_destroy_lock(list->combiner);
+    free(list->combiner);
+    free(list->slots);
+    free(list);
+}
+
+size_t fc_skiplist_size(fc_list* list) {
+    return coarse_skiplist_size(list->list);
+}
+
+size_t fc_skiplist_memory(fc_list* list, size_t* n_keys) {
+    return coarse_skiplist_memory(list->list, n_keys);
+}
+
+/* Apply the pending requests of all slots, the caller holds the combiner lock */
+static void combine(fc_list* list) {
+    coarse_op ops[FC_SLOTS];
+    fc_slot* owners[FC_SLOTS];
+    int used = thread_slot_bound();
+    if (used > FC_SLOTS) used = FC_SLOTS;
+
+    /* collect the requests, insertion sorted by key */
+    size_t n = 0;
+    for (int i = 0; i < used; i++) {
+        fc_slot* slot = &list->slots[i];
+        if (!__atomic_load_n(&slot->pending, __ATOMIC_ACQUIRE)) continue;
+        size_t j = n++;
+        while (j > 0 && KEY_GT(ops[j - 1].key, slot->op.key)) {
+            ops[j] = ops[j - 1];
+            owners[j] = owners[j - 1];
+            j--;
+        }
+        ops[j] = slot->op;
+        owners[j] = slot;
+    }
+    if (n == 0) return;
+
+    coarse_skiplist_apply_batch(list->list, ops, n);
+
+    /* hand the results back */
+    for (size_t j = 0; j < n; j++) {
+        owners[j]->op.data = ops[j].data;
+        owners[j]->op.result = ops[j].result;
+        __atomic_store_n(&owners[j]->pending, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* Publish 'op' and wait until it was applied, by this thread or by
+  another combiner. The result is written back to 'op' */
+static void execute(fc_list* list, coarse_op* op) {
+    int index = slot_index();
+    if (index >= FC_SLOTS) {
+        /* no slot, the list lock serializes it with the combiner */
+        coarse_skiplist_apply_batch(list->list, op, 1);
+        return;
+    }
+    fc_slot* slot = &list->slots[index];
+    slot->op = *op;
+    __atomic_store_n(&slot->pending, 1, __ATOMIC_RELEASE);
+
+    for (int spins = 0; __atomic_load_n(&slot->pending, __ATOMIC_ACQUIRE); spins++) {
+        if (omp_test_lock(list->combiner)) {
+            combine(list);
+            omp_unset_lock(list->combiner);
+        } else if (spins < FC_SPINS) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+    op->data = slot->op.data;
+    op->result = slot->op.result;
+}
+
+bool fc_skiplist_contains(fc_list* list, skey_t key, void** data_out) {
+    coarse_op op = {COARSE_OP_CONTAINS, key, NULL, NULL, false};
+    execute(list, &op);
+    if (op.result && data_out) *data_out = op.data;
+    return op.result;
+}
+
+bool fc_skiplist_add(fc_list* list, skey_t key, void* data, rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->list->keyrange)) return false;
+    coarse_op op = {COARSE_OP_ADD, key, data, random_state, false};
+    execute(list, &op);
+    return op.result;
+}
+
+bool fc_skiplist_remove(fc_list* list, skey_t key, void** data_out) {
+    coarse_op op = {COARSE_OP_REMOVE, key, NULL, NULL, false};
+    execute(list, &op);
+    if (op.result && data_out) *data_out = op.data;
+    return op.result;
+}
+
+size_t fc_skiplist_range_scan(fc_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx) {
+    return coarse_skiplist_range_scan(list->list, lo, hi, callback, ctx);
+}
@@ -1,66 +1,312 @@
 #include "../inc/fine_skiplist.h"
+#include "../inc/thread_slot.h"
+#include "../inc/skiplist_levels.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
-#include <omp.h>
-
-fine_node* create_node(fine_list* list, int key) {
-    /* allocate memory */
-    fine_node* node = (fine_node*)malloc(sizeof(fine_node));
-    if(!node) return NULL;
-    node->lock = (omp_nest_lock_t*)malloc(sizeof(omp_nest_lock_t));
-    if(!node->lock) {
-        free(node);
-        return NULL;
-    }
-    node->next = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
-    if (!node->next) {
-        free(node->lock);
-        free(node);
-        return NULL;
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Pauses a thread spins for on a node lock before it yields,
+  the holder may have been preempted */
+#define NODE_LOCK_SPINS (1024)
+
+/* Pauses of the first backoff, waits are capped at NODE_LOCK_SPINS
+  after which the thread yields instead */
+#define BACKOFF_MIN (4)
+
+/* Retries and spins of the calling thread, and the generator
+  drawing its backoff jitter */
+static __thread fine_retry_stats thread_stats;
+static __thread rng_state backoff_rng;
+
+/* Size of a node with a tower of k+1 next pointers,
+  rounded up so consecutive nodes stay NODE_ALIGN aligned */
+static inline size_t node_size(uint8_t k) {
+    size_t size = sizeof(fine_node) + sizeof(fine_node*) * (k + 1);
+    return ((size + NODE_ALIGN - 1) / NODE_ALIGN) * NODE_ALIGN;
+}
+
+/* Create a node, taken from 'pool' if it holds one of that height.
+  'pool' is NULL for threads without a slot */
+fine_node* create_node(fine_pool* pool, skey_t key, uint8_t k) {
+    fine_node* node;
+    if (pool && pool->nodes[k]) {
+        node = pool->nodes[k];
+        pool->nodes[k] = node->next[0];
+    } else {
+        /* allocate memory */
+        node = (fine_node*)aligned_alloc(NODE_ALIGN, node_size(k));
+        if(!node) return NULL;
     }
-    memset(node->next, 0, sizeof(fine_node*) * list->levels);
+    memset(node->next, 0, sizeof(fine_node*) * (k + 1));
 
     /* init fields */
     node->fully_linked = false;
     node->marked = false;
-    omp_init_nest_lock(node->lock);
-    node->k = 0;
+    node->lock = 0;
+    node->k = k;
     node->key = key;
     return node;
 }
 
 void destroy_node(fine_node* node) {
-    free(node->next);
-    omp_destroy_nest_lock(node->lock);
-    free(node->lock);
     free(node);
 }
 
-fine_list* fine_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange) {
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/* Test and test-and-set, waiters only read the lock until it looks free */
+static inline void spin_lock(uint8_t* lock) {
+    int spins = 0;
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            thread_stats.spins++;
+            if (spins++ < NODE_LOCK_SPINS) cpu_relax();
+            else sched_yield();
+        }
+    }
+}
+
+static inline void spin_unlock(uint8_t* lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Spin for 'pauses' pauses, long waits yield instead */
+static void pause_for(uint64_t pauses) {
+    if (pauses >= NODE_LOCK_SPINS) {
+        thread_stats.spins++;
+        sched_yield();
+        return;
+    }
+    thread_stats.spins += pauses;
+    for (uint64_t i = 0; i < pauses; i++) cpu_relax();
+}
+
+/* Random bits for backoff jitter, seeded differently in every thread */
+static uint64_t backoff_seeds = 0;
+static inline uint64_t jitter(void) {
+    if (!backoff_rng.s) rng_seed(&backoff_rng, __atomic_add_fetch(&backoff_seeds, 1, __ATOMIC_RELAXED));
+    return rng_next(&backoff_rng);
+}
+
+/* Wait according to the policy of 'list' before attempt 'attempt' (from 1) */
+static void backoff(fine_list* list, int attempt) {
+    switch (list->backoff) {
+    case EXPONENTIAL_BACKOFF: {
+        uint64_t bound = (uint64_t)BACKOFF_MIN << (attempt < 16 ? attempt : 16);
+        pause_for(jitter() % bound);
+        return;
+    }
+    case CONTENTION_BACKOFF: {
+        uint64_t retrying = __atomic_load_n(&list->retrying, __ATOMIC_RELAXED);
+        /* half of it fixed, so waiters do not retry all at once */
+        uint64_t bound = BACKOFF_MIN * (retrying + 1);
+        pause_for(bound / 2 + jitter() % (bound - bound / 2));
+        return;
+    }
+    case NO_BACKOFF:
+    default:
+        return;
+    }
+}
+
+/* Count a failed attempt of an update that failed 'attempts' times
+  before and wait before it retries. Returns the new number of attempts */
+static int retry(fine_list* list, int attempts) {
+    thread_stats.retries++;
+    if (attempts == 0 && list->backoff == CONTENTION_BACKOFF)
+        __atomic_add_fetch(&list->retrying, 1, __ATOMIC_RELAXED);
+    backoff(list, attempts + 1);
+    return attempts + 1;
+}
+
+/* End an update that failed 'attempts' times */
+static inline void retried(fine_list* list, int attempts) {
+    if (attempts > 0 && list->backoff == CONTENTION_BACKOFF)
+        __atomic_sub_fetch(&list->retrying, 1, __ATOMIC_RELAXED);
+}
+
+/* Wait until 'node' is fully linked, its inserter may have been preempted */
+static void wait_linked(fine_list* list, fine_node* node) {
+    for (int spins = 0; !__atomic_load_n(&node->fully_linked, __ATOMIC_ACQUIRE); spins++) {
+        if (list->backoff != NO_BACKOFF) {
+            backoff(list, spins + 1);
+        } else {
+            pause_for(spins < NODE_LOCK_SPINS ? 1 : NODE_LOCK_SPINS);
+        }
+    }
+}
+
+void fine_stats_reset(void) {
+    memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+fine_retry_stats fine_stats_get(void) {
+    return thread_stats;
+}
+
+static inline void lock_node(fine_node* node) {
+    spin_lock(&node->lock);
+}
+
+static inline void unlock_node(fine_node* node) {
+    spin_unlock(&node->lock);
+}
+
+/* Lock the predecessor of level 'l' unless it is the one of level l-1.
+  A node that is the predecessor on several levels fills consecutive
+  entries of 'preds', the predecessor of a level never lies left of the
+  one of the level above */
+static inline void lock_pred(fine_node** preds, int l) {
+    if (l == 0 || preds[l] != preds[l - 1]) lock_node(preds[l]);
+}
+
+/* Unlock the predecessors locked for levels 0 to 'highlock' */
+static inline void unlock_preds(fine_node** preds, int highlock) {
+    for (int l = 0; l <= highlock; l++) {
+        if (l == 0 || preds[l] != preds[l - 1]) unlock_node(preds[l]);
+    }
+}
+
+/* Pool of the calling thread, NULL if it has no slot */
+static inline fine_pool* thread_pool(fine_list* list) {
+    int index = thread_slot_get();
+    return index < 0 ? NULL : &list->pools[index];
+}
+
+/* Free callback of the epoch domain. Nodes are freed by the owner of a
+  slot, with ARENA_ALLOC they go to its pool for its next inserts */
+static bool free_node(void* object, void* ctx) {
+    fine_list* list = (fine_list*)ctx;
+    fine_node* node = (fine_node*)object;
+    fine_pool* pool = list->recycle ? thread_pool(list) : NULL;
+    if (pool) {
+        node->next[0] = pool->nodes[node->k];
+        pool->nodes[node->k] = node;
+    } else {
+        destroy_node(node);
+    }
+    return true;
+}
+
+fine_list* fine_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+    backoff_policy backoff) {
     fine_list* skiplist = (fine_list*)malloc(sizeof(fine_list));
     if (!skiplist) return NULL;
+    if (levels < 1) levels = 1;
+    if (levels > SKIPLIST_MAX_LEVELS) levels = SKIPLIST_MAX_LEVELS;
     skiplist->levels = levels;
     skiplist->prob = prob;
+    skiplist->height_shift = height_shift(prob);
+    skiplist->towers = RANDOM_TOWERS;
+    skiplist->size = 0;
+    skiplist->capacity = level_capacity(prob, levels);
     skiplist->keyrange.min = keyrange.min;
     skiplist->keyrange.max = keyrange.max;
 
-    /* Create head node */
-    skiplist->head = create_node(skiplist, keyrange.min - 1);
-    fine_node* tail = create_node(skiplist, keyrange.max + 1);
+    skiplist->recycle = allocator == ARENA_ALLOC;
+    skiplist->backoff = backoff;
+    skiplist->retrying = 0;
+    skiplist->pools = (fine_pool*)aligned_alloc(64, sizeof(fine_pool) * THREAD_SLOTS);
+    skiplist->reclaim = epoch_domain_init(EPOCH_BASED, free_node, skiplist);
+    if (!skiplist->pools || !skiplist->reclaim) {
+        free(skiplist->pools);
+        if (skiplist->reclaim) epoch_domain_destroy(skiplist->reclaim);
+        free(skiplist);
+        return NULL;
+    }
+    memset(skiplist->pools, 0, sizeof(fine_pool) * THREAD_SLOTS);
+
+    /* Create head node, the sentinels span every level the list may grow to.
+      They carry the bounds of the range, so every key in it is found
+      between them, see holds_key */
+    skiplist->head = create_node(NULL, keyrange.min, SKIPLIST_MAX_LEVELS - 1);
+    fine_node* tail = create_node(NULL, keyrange.max, SKIPLIST_MAX_LEVELS - 1);
     if(!skiplist->head||!tail) {
+        epoch_domain_destroy(skiplist->reclaim);
+        free(skiplist->pools);
         free(skiplist);
         return NULL;
     }
-    for (size_t i = 0; i < skiplist->levels; i++) {
+    for (size_t i = 0; i < SKIPLIST_MAX_LEVELS; i++) {
         skiplist->head->next[i] = tail;
     }
 
     return skiplist;
 }
 
+fine_list* fine_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+    uint8_t levels, double prob, skey_range_t keyrange, node_allocator allocator,
+    backoff_policy backoff, tower_mode towers, rng_state* random_state) {
+    fine_list* list = fine_skiplist_init(levels, prob, keyrange, allocator, backoff);
+    if (!list) return NULL;
+    if (towers == HASHED_TOWERS) list->towers = HASHED_TOWERS;
+    /* size the levels for all keys up front, towers are only drawn once */
+    levels_grow(&list->levels, &list->capacity, list->prob, n);
+
+    /* Rightmost node of every level, new nodes are appended behind them.
+      The list is not shared yet, so no need for locks */
+    fine_node** last = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
+    if (!last) {
+        fine_skiplist_destroy(list);
+        return NULL;
+    }
+    for (size_t i = 0; i < list->levels; i++) {
+        last[i] = list->head;
+    }
+
+    size_t position = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], keyrange)) continue;
+        if (position > 0 && KEY_LE(keys[j], last[0]->key)) continue;
+        position++;
+
+        int k = towers == DETERMINISTIC_TOWERS ?
+            deterministic_height(position, list->prob, list->levels) - 1 :
+            levels_draw(list->levels, list->towers, list->prob, list->height_shift, keys[j], random_state);
+        fine_node* node = create_node(NULL, keys[j], k);
+        if (!node) {
+            free(last);
+            fine_skiplist_destroy(list);
+            return NULL;
+        }
+        node->data = values ? values[j] : NULL;
+        for (int i = 0; i <= k; i++) {
+            node->next[i] = last[i]->next[i];
+            last[i]->next[i] = node;
+            last[i] = node;
+        }
+        node->fully_linked = true;
+    }
+    list->size = position;
+    free(last);
+    return list;
+}
+
+size_t fine_skiplist_size(fine_list* list) {
+    return __atomic_load_n(&list->size, __ATOMIC_RELAXED);
+}
+
+size_t fine_skiplist_memory(fine_list* list, size_t* n_keys) {
+    size_t bytes = 0;
+    size_t keys = 0;
+    for (fine_node* current = list->head->next[0]; current->next[0]; current = current->next[0]) {
+        bytes += node_size(current->k);
+        keys++;
+    }
+    if (n_keys) *n_keys = keys;
+    return bytes;
+}
+
 void fine_skiplist_destroy(fine_list* list) {
     fine_node* current = list->head;
     while (current) {
@@ -68,19 +314,39 @@ void fine_skiplist_destroy(fine_list* list) {
         destroy_node(current);
         current = next;
     }
+    /* removed nodes that were not freed yet are not recycled anymore */
+    list->recycle = false;
+    epoch_domain_destroy(list->reclaim);
+    for (int i = 0; i < THREAD_SLOTS; i++) {
+        fine_pool* pool = &list->pools[i];
+        for (int k = 0; k < SKIPLIST_MAX_LEVELS; k++) {
+            while (pool->nodes[k]) {
+                fine_node* next = pool->nodes[k]->next[0];
+                destroy_node(pool->nodes[k]);
+                pool->nodes[k] = next;
+            }
+        }
+    }
+    free(list->pools);
     free(list);
 }
 
+/* true if 'node' is an element with 'key'. The tail carries keyrange.max
+  as well, it is the only node without a successor */
+static inline bool holds_key(fine_node* node, skey_t key) {
+    return node && KEY_EQ(node->key, key) && node->next[0];
+}
+
 /* Find the predecessors and successors of 'key' for each level in 'list' and writes them to 'preds' and 'succs'.
   If 'key' is contained in 'list', 'preds' will contain a pointer to the node with 
   key = 'key' for each level it was present in, similarly for 'succs'.
   Returns highest level the node was linked in, -1 if it was not found */
-static int find_neighbours(fine_list* list, int key, fine_node** preds, fine_node** succs) {
+static int find_neighbours(fine_list* list, skey_t key, fine_node** preds, fine_node** succs) {
     fine_node* current = list->head;
     int l = -1;
-    for (int i = list->levels - 1; i >= 0; i--) {
+    for (int i = levels_in_use(&list->levels) - 1; i >= 0; i--) {
         fine_node* next = current->next[i];
-        while (next && key > next->key) {
+        while (next && KEY_GT(key, next->key)) {
             current = next;
             next = current->next[i];
         }
@@ -88,55 +354,143 @@ static int find_neighbours(fine_list* list, int key, fine_node** preds, fine_nod
         succs[i] = next;
 
         // check if we found the element if it was not already found in higher level
-        if (next && l < 0 && next->key == key) l = i;
+        if (l < 0 && holds_key(next, key)) l = i;
     }
     return l;
 }
 
-fine_node* fine_skiplist_contains(fine_list* list, int key) {
-    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
+/* Like find_neighbours, but starts from 'preds' left by an earlier search
+  as a finger. Only the levels where the finger lags behind 'key' are walked,
+  from the highest of them down. The caller only passes a finger whose nodes
+  cannot have been freed yet, see epoch_resume. Falls back to a search from the head
+  if 'key' lies before it or one of its nodes has been marked */
+static int find_neighbours_from(fine_list* list, skey_t key, fine_node** preds, fine_node** succs) {
+    if (KEY_GE(preds[0]->key, key)) return find_neighbours(list, key, preds, succs);
+    /* levels added since the finger was last used still hold the head */
+    int levels = levels_in_use(&list->levels);
+    for (int i = 0; i < levels; i++) {
+        if (preds[i]->marked) return find_neighbours(list, key, preds, succs);
+    }
+
+    /* above the highest lagging level the finger still holds the predecessors */
+    int level = levels - 1;
+    while (level > 0 && !(preds[level]->next[level] && KEY_GT(key, preds[level]->next[level]->key))) {
+        level--;
+    }
+    int l = -1;
+    for (int i = levels - 1; i > level; i--) {
+        succs[i] = preds[i]->next[i];
+        if (l < 0 && holds_key(succs[i], key)) l = i;
+    }
+    fine_node* current = preds[level];
+    for (int i = level; i >= 0; i--) {
+        /* the finger may be ahead at lower levels */
+        if (KEY_GT(preds[i]->key, current->key)) current = preds[i];
+        fine_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+        preds[i] = current;
+        succs[i] = next;
+
+        if (l < 0 && holds_key(next, key)) l = i;
+    }
+    return l;
+}
+
+/* Search with 'find_neighbours_from' if 'finger' is set, otherwise from the head */
+static inline int search(fine_list* list, skey_t key, fine_node** preds, fine_node** succs, bool finger) {
+    return finger ? find_neighbours_from(list, key, preds, succs) : find_neighbours(list, key, preds, succs);
+}
+
+/* Search again for 'key' after an update failed validation. 'preds' holds
+  the predecessors of the previous search at the lowest '*levels' levels.
+  Instead of the head the search resumes from the lowest of them at or above
+  'level' that is still in the list, levels above it keep their neighbours.
+  Lower predecessors that are still in the list are jumped to on the way
+  down. Without one it searches from the head and sets '*levels'.
+  Returns like find_neighbours, but only considers levels up to the one
+  it resumed at */
+static int find_neighbours_retry(fine_list* list, skey_t key, fine_node** preds, fine_node** succs,
+    int level, int* levels) {
+    int top = levels_in_use(&list->levels);
+    int start = level;
+    while (start < *levels && preds[start]->marked) start++;
+    if (start >= *levels) {
+        thread_stats.retry_levels += top;
+        *levels = top;
+        return find_neighbours(list, key, preds, succs);
+    }
+    thread_stats.retry_levels += start + 1;
+    thread_stats.skipped_levels += top - (start + 1);
+
+    int l = -1;
+    fine_node* current = preds[start];
+    for (int i = start; i >= 0; i--) {
+        if (!preds[i]->marked && KEY_GT(preds[i]->key, current->key)) current = preds[i];
+        fine_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+        preds[i] = current;
+        succs[i] = next;
+
+        if (l < 0 && holds_key(next, key)) l = i;
+    }
+    return l;
+}
+
+fine_node* fine_skiplist_contains(fine_list* list, skey_t key) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return NULL;
+
+    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
     if (!preds) return NULL;
-    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
+    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
     if (!succs) { free(preds); return NULL;}
 
+    epoch_slot* slot = epoch_enter(list->reclaim);
     fine_node* result = NULL;
     if (find_neighbours(list, key, preds, succs) >= 0) {
         result = preds[0]->next[0];
     }
+    epoch_leave(list->reclaim, slot);
     free(preds);
     free(succs);
     return result;
 }
 
-bool fine_skiplist_add(fine_list* list, int key, void* data, unsigned short int random_state[3]) {
-    if (key < list->keyrange.min || key > list->keyrange.max) return false;
-
-    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
-    if (!preds) return NULL;
-    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
-    if (!succs) { free(preds); return false;}
-
-    int highest_link;
-    /* Cast die until it decides against more levels */
-    for (highest_link = 0; highest_link < list->levels - 1; highest_link++) {
-        double die;
-        drand48_r((struct drand48_data*)random_state, &die);
-        if (die > list->prob) break;
-    }
+/* Insert 'key' using 'preds' and 'succs' as scratch space for the
+  search, which starts from them if 'finger' is set. The caller
+  started the operation with epoch_enter */
+static bool add_internal(fine_list* list, skey_t key, void* data, rng_state* random_state,
+    fine_node** preds, fine_node** succs, bool finger) {
+    int highest_link = levels_draw(levels_in_use(&list->levels), list->towers, list->prob, list->height_shift,
+        key, random_state);
+    int attempts = 0;
+    /* levels 'preds' holds after the first search, retries resume in them */
+    int levels = 0;
 
     while(true) {
-        int f = find_neighbours(list, key, preds, succs);
+        int f;
+        if (levels == 0) {
+            levels = levels_in_use(&list->levels);
+            f = search(list, key, preds, succs, finger);
+        } else {
+            f = find_neighbours_retry(list, key, preds, succs, highest_link, &levels);
+        }
         if (f >= 0)
         {
             /* key already exists */
             fine_node* found = succs[f];
             if(!found->marked) {
-                while(!found->fully_linked);
-                free(preds);
-                free(succs);
+                wait_linked(list, found);
+                retried(list, attempts);
                 return false;
             }
             /* key marked for deletion */
+            attempts = retry(list, attempts);
             continue;
         }
 
@@ -148,63 +502,78 @@ bool fine_skiplist_add(fine_list* list, int key, void* data, unsigned short int
         {
             pred = preds[l];
             succ = succs[l];
-            omp_set_nest_lock(pred->lock);
+            lock_pred(preds, l);
             highlock = l;
             valid = !pred->marked&&!succ->marked&&(pred->next[l] == succ);
         }
         /* failed, retry */
         if (!valid) {
-            for (int l = 0; l <= highlock; l++)
-            {
-                omp_unset_nest_lock(preds[l]->lock);
-            }  
+            unlock_preds(preds, highlock);
+            attempts = retry(list, attempts);
             continue;
         }
         /* Create new node */
-        fine_node* new_node = create_node(list, key);
+        fine_node* new_node = create_node(thread_pool(list), key, highest_link);
         new_node->data = data;
-        new_node->k = highest_link;
 
         /* Link up to pre-computed level */
         for (int i = 0; i <= highest_link; i++) {
             new_node->next[i] = succs[i];
             preds[i]->next[i] = new_node;
         }
-        new_node->fully_linked = true;
-        for (int l = 0; l <= highlock; l++)
-        {
-            omp_unset_nest_lock(preds[l]->lock);
-        }
-        free(preds);
-        free(succs);
+        __atomic_store_n(&new_node->fully_linked, true, __ATOMIC_RELEASE);
+        unlock_preds(preds, highlock);
+        levels_count_add(&list->levels, &list->size, &list->capacity, list->prob);
+        retried(list, attempts);
         return true;
     }
 }
 
-bool fine_skiplist_remove(fine_list* list, int key, void** data_out) {
-    if (key < list->keyrange.min || key > list->keyrange.max) return false;
+bool fine_skiplist_add(fine_list* list, skey_t key, void* data, rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
 
-    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
+    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
     if (!preds) return NULL;
-    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * list->levels);
+    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
     if (!succs) { free(preds); return false;}
 
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    bool added = add_internal(list, key, data, random_state, preds, succs, false);
+    epoch_leave(list->reclaim, slot);
+    free(preds);
+    free(succs);
+    return added;
+}
+
+/* Remove 'key' using 'preds' and 'succs' as scratch space for the
+  search, which starts from them if 'finger' is set. The caller
+  started the operation with epoch_enter, 'slot' is what it returned */
+static bool remove_internal(fine_list* list, epoch_slot* slot, skey_t key, void** data_out,
+    fine_node** preds, fine_node** succs, bool finger) {
     fine_node* victim = NULL;
     bool marked = false;
     int k = -1;
+    int attempts = 0;
+    /* levels 'preds' holds after the first search, retries resume in them */
+    int levels = 0;
 
     while (true) {
-        int f = find_neighbours(list, key, preds, succs);
+        int f;
+        if (levels == 0) {
+            levels = levels_in_use(&list->levels);
+            f = search(list, key, preds, succs, finger);
+        } else {
+            f = find_neighbours_retry(list, key, preds, succs, k, &levels);
+        }
         if (f>=0) victim = succs[f];
         if (marked || 
         ((f >= 0)&&victim->fully_linked&&victim->k==f)) {
             if (!marked) {
                 k = victim->k;
-                omp_set_nest_lock(victim->lock);
+                lock_node(victim);
                 if (victim->marked) {
-                    omp_unset_nest_lock(victim->lock);
-                    free(preds);
-                    free(succs);
+                    unlock_node(victim);
+                    retried(list, attempts);
                     return false;
                 }
                 victim->marked = true;
@@ -216,16 +585,14 @@ bool fine_skiplist_remove(fine_list* list, int key, void** data_out) {
             for (int l = 0; valid&&(l<=k); l++)
             {
                 pred = preds[l];
-                omp_set_nest_lock(pred->lock);
+                lock_pred(preds, l);
                 highlock = l;
                 valid = !pred->marked&&(pred->next[l]==victim);
             }
             /* failed, retry */
             if (!valid) {
-                for (int l = 0; l <= highlock; l++)
-                {
-                    omp_unset_nest_lock(preds[l]->lock);
-                }  
+                unlock_preds(preds, highlock);
+                attempts = retry(list, attempts);
                 continue;
             }
             /* unlink */
@@ -234,23 +601,169 @@ bool fine_skiplist_remove(fine_list* list, int key, void** data_out) {
                 preds[l]->next[l] = victim->next[l];
             }
             /* unlock */
-            omp_unset_nest_lock(victim->lock);
-            for (int l = 0; l <= highlock; l++)
-            {
-                omp_unset_nest_lock(preds[l]->lock);
-            }
+            unlock_node(victim);
+            unlock_preds(preds, highlock);
+            __atomic_sub_fetch(&list->size, 1, __ATOMIC_RELAXED);
             if (data_out) *data_out = victim->data;
-            free(preds);
-            free(succs);
+            epoch_retire(list->reclaim, slot, victim);
+            retried(list, attempts);
             return true;           
         } else {
-                free(preds);
-                free(succs);
+                retried(list, attempts);
                 return false;
         }
     }
 }
 
+bool fine_skiplist_remove(fine_list* list, skey_t key, void** data_out) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+
+    fine_node** preds = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
+    if (!preds) return NULL;
+    fine_node** succs = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
+    if (!succs) { free(preds); return false;}
+
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    bool removed = remove_internal(list, slot, key, data_out, preds, succs, false);
+    epoch_leave(list->reclaim, slot);
+    free(preds);
+    free(succs);
+    return removed;
+}
+
+fine_finger* fine_skiplist_finger_init(fine_list* list) {
+    fine_finger* finger = (fine_finger*)malloc(sizeof(fine_finger));
+    if (!finger) return NULL;
+    /* sized for every level the list may grow to while the finger is used */
+    finger->preds = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
+    finger->succs = (fine_node**)malloc(sizeof(fine_node*) * SKIPLIST_MAX_LEVELS);
+    if (!finger->preds || !finger->succs) {
+        fine_skiplist_finger_destroy(finger);
+        return NULL;
+    }
+    for (size_t i = 0; i < SKIPLIST_MAX_LEVELS; i++) {
+        finger->preds[i] = list->head;
+        finger->succs[i] = list->head->next[i];
+    }
+    finger->epoch = 0;
+    return finger;
+}
+
+void fine_skiplist_finger_destroy(fine_finger* finger) {
+    free(finger->preds);
+    free(finger->succs);
+    free(finger);
+}
+
+fine_node* fine_skiplist_finger_contains(fine_list* list, fine_finger* finger, skey_t key) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return NULL;
+    epoch_slot* slot;
+    bool kept = epoch_resume(list->reclaim, &slot, &finger->epoch);
+    fine_node* result = NULL;
+    if (search(list, key, finger->preds, finger->succs, kept) >= 0) {
+        result = finger->preds[0]->next[0];
+    }
+    epoch_leave(list->reclaim, slot);
+    return result;
+}
+
+bool fine_skiplist_finger_add(fine_list* list, fine_finger* finger, skey_t key, void* data,
+    rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    epoch_slot* slot;
+    bool kept = epoch_resume(list->reclaim, &slot, &finger->epoch);
+    bool added = add_internal(list, key, data, random_state, finger->preds, finger->succs, kept);
+    epoch_leave(list->reclaim, slot);
+    return added;
+}
+
+bool fine_skiplist_finger_remove(fine_list* list, fine_finger* finger, skey_t key, void** data_out) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    epoch_slot* slot;
+    bool kept = epoch_resume(list->reclaim, &slot, &finger->epoch);
+    bool removed = remove_internal(list, slot, key, data_out, finger->preds, finger->succs, kept);
+    epoch_leave(list->reclaim, slot);
+    return removed;
+}
+
+/* First node with a key not smaller than 'key', the tail if there is none */
+static fine_node* find_first(fine_list* list, skey_t key) {
+    fine_node* current = list->head;
+    for (int i = levels_in_use(&list->levels) - 1; i >= 0; i--) {
+        fine_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+    }
+    return current->next[0];
+}
+
+/* First node with a key larger than 'key', NULL if only the tail follows it */
+static fine_node* find_after(fine_list* list, skey_t key) {
+    fine_node* current = list->head;
+    for (int i = levels_in_use(&list->levels) - 1; i >= 0; i--) {
+        fine_node* next = current->next[i];
+        while (next && KEY_GE(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+    }
+    return current->next[0];
+}
+
+/* First node from 'node' on that is in the list, NULL at the tail */
+static fine_node* skip_removed(fine_node* node) {
+    while (node && (node->marked || !node->fully_linked)) {
+        node = node->next[0];
+    }
+    /* the tail is the only node without a successor */
+    return node && node->next[0] ? node : NULL;
+}
+
+size_t fine_skiplist_range_scan(fine_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx) {
+    size_t visited = 0;
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    for (fine_node* node = skip_removed(find_first(list, lo)); node && KEY_LE(node->key, hi);
+        node = skip_removed(node->next[0])) {
+        visited++;
+        if (!callback(node->key, node->data, ctx)) break;
+    }
+    epoch_leave(list->reclaim, slot);
+    return visited;
+}
+
+/* Move 'cursor' onto 'node' */
+static bool cursor_set(fine_cursor* cursor, fine_node* node) {
+    cursor->node = node;
+    cursor->valid = node != NULL;
+    if (node) {
+        cursor->key = node->key;
+        cursor->data = node->data;
+    }
+    return cursor->valid;
+}
+
+bool fine_skiplist_cursor_seek(fine_list* list, fine_cursor* cursor, skey_t key) {
+    epoch_slot* slot;
+    cursor->epoch = 0;
+    epoch_resume(list->reclaim, &slot, &cursor->epoch);
+    bool found = cursor_set(cursor, skip_removed(find_first(list, key)));
+    epoch_leave(list->reclaim, slot);
+    return found;
+}
+
+bool fine_skiplist_cursor_next(fine_list* list, fine_cursor* cursor) {
+    if (!cursor->valid) return false;
+    epoch_slot* slot;
+    /* continue from the node if it cannot have been freed, otherwise search for the next key */
+    bool kept = epoch_resume(list->reclaim, &slot, &cursor->epoch);
+    fine_node* next = kept ? cursor->node->next[0] : find_after(list, cursor->key);
+    bool found = cursor_set(cursor, skip_removed(next));
+    epoch_leave(list->reclaim, slot);
+    return found;
+}
+
 /*
 int main(int argc, char const *argv[])
 {
@@ -0,0 +1,337 @@
+#include "../inc/harris_skiplist.h"
+#include "../inc/skiplist_levels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Lowest bit of a next pointer, set once the node holding it is removed
+  in that level. Nodes are NODE_ALIGN aligned, so the bit is always free */
+#define MARK ((uintptr_t)1)
+
+/* Retries of the calling thread */
+static __thread harris_retry_stats thread_stats;
+
+static inline bool is_marked(uintptr_t next) {
+    return next & MARK;
+}
+
+static inline harris_node* unmarked(uintptr_t next) {
+    return (harris_node*)(next & ~MARK);
+}
+
+static inline uintptr_t load_next(harris_node* node, int level) {
+    return __atomic_load_n(&node->next[level], __ATOMIC_ACQUIRE);
+}
+
+static inline bool cas_next(harris_node* node, int level, uintptr_t expected, uintptr_t desired) {
+    return __atomic_compare_exchange_n(&node->next[level], &expected, desired,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* Size of a node with a tower of k+1 next pointers,
+  rounded up so consecutive nodes stay NODE_ALIGN aligned */
+static inline size_t node_size(uint8_t k) {
+    size_t size = sizeof(harris_node) + sizeof(uintptr_t) * (k + 1);
+    return ((size + NODE_ALIGN - 1) / NODE_ALIGN) * NODE_ALIGN;
+}
+
+static harris_node* create_node(skey_t key, void* data, uint8_t k) {
+    harris_node* node = (harris_node*)aligned_alloc(NODE_ALIGN, node_size(k));
+    if (!node) return NULL;
+    memset(node->next, 0, sizeof(uintptr_t) * (k + 1));
+    node->key = key;
+    node->data = data;
+    node->k = k;
+    node->owners = 2;
+    return node;
+}
+
+/* Free callback of the epoch domain */
+static bool destroy_node(void* node, void* ctx) {
+    (void)ctx;
+    free(node);
+    return true;
+}
+
+/* Let go of 'node', the last of its inserter and remover retires it */
+static inline void release(harris_list* list, epoch_slot* slot, harris_node* node) {
+    if (__atomic_sub_fetch(&node->owners, 1, __ATOMIC_ACQ_REL) == 0)
+        epoch_retire(list->reclaim, slot, node);
+}
+
+void harris_stats_reset(void) {
+    memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+harris_retry_stats harris_stats_get(void) {
+    return thread_stats;
+}
+
+/* Count a search that has to start from the head again */
+static inline void restart(harris_list* list) {
+    thread_stats.retries++;
+    thread_stats.retry_levels += levels_in_use(&list->levels);
+}
+
+harris_list* harris_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange) {
+    harris_list* skiplist = (harris_list*)malloc(sizeof(harris_list));
+    if (!skiplist) return NULL;
+    if (levels < 1) levels = 1;
+    if (levels > SKIPLIST_MAX_LEVELS) levels = SKIPLIST_MAX_LEVELS;
+    skiplist->levels = levels;
+    skiplist->prob = prob;
+    skiplist->height_shift = height_shift(prob);
+    skiplist->towers = RANDOM_TOWERS;
+    skiplist->size = 0;
+    skiplist->capacity = level_capacity(prob, levels);
+    skiplist->keyrange.min = keyrange.min;
+    skiplist->keyrange.max = keyrange.max;
+
+    /* the key of the head is never compared */
+    skiplist->head = create_node(keyrange.min, NULL, SKIPLIST_MAX_LEVELS - 1);
+    skiplist->reclaim = epoch_domain_init(EPOCH_BASED, destroy_node, NULL);
+    if (!skiplist->head || !skiplist->reclaim) {
+        free(skiplist->head);
+        if (skiplist->reclaim) epoch_domain_destroy(skiplist->reclaim);
+        free(skiplist);
+        return NULL;
+    }
+    return skiplist;
+}
+
+harris_list* harris_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+    uint8_t levels, double prob, skey_range_t keyrange, tower_mode towers, rng_state* random_state) {
+    harris_list* list = harris_skiplist_init(levels, prob, keyrange);
+    if (!list) return NULL;
+    if (towers == HASHED_TOWERS) list->towers = HASHED_TOWERS;
+    /* size the levels for all keys up front, towers are only drawn once */
+    levels_grow(&list->levels, &list->capacity, list->prob, n);
+
+    /* Rightmost node of every level, new nodes are appended behind them.
+      The list is not shared yet, so no need for CAS */
+    harris_node* last[SKIPLIST_MAX_LEVELS];
+    for (size_t i = 0; i < list->levels; i++) {
+        last[i] = list->head;
+    }
+
+    size_t position = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], keyrange)) continue;
+        if (position > 0 && KEY_LE(keys[j], last[0]->key)) continue;
+        position++;
+
+        int k = towers == DETERMINISTIC_TOWERS ?
+            deterministic_height(position, list->prob, list->levels) - 1 :
+            levels_draw(list->levels, list->towers, list->prob, list->height_shift, keys[j], random_state);
+        harris_node* node = create_node(keys[j], values ? values[j] : NULL, k);
+        if (!node) {
+            harris_skiplist_destroy(list);
+            return NULL;
+        }
+        /* no inserter to wait for */
+        node->owners = 1;
+        for (int i = 0; i <= k; i++) {
+            last[i]->next[i] = (uintptr_t)node;
+            last[i] = node;
+        }
+    }
+    list->size = position;
+    return list;
+}
+
+size_t harris_skiplist_size(harris_list* list) {
+    return __atomic_load_n(&list->size, __ATOMIC_RELAXED);
+}
+
+size_t harris_skiplist_memory(harris_list* list, size_t* n_keys) {
+    size_t bytes = 0;
+    size_t keys = 0;
+    for (harris_node* current = unmarked(list->head->next[0]); current; current = unmarked(current->next[0])) {
+        if (is_marked(current->next[0])) continue;
+        bytes += node_size(current->k);
+        keys++;
+    }
+    if (n_keys) *n_keys = keys;
+    return bytes;
+}
+
+void harris_skiplist_destroy(harris_list* list) {
+    /* nodes still linked were not retired, removed ones are all unlinked */
+    harris_node* current = list->head;
+    while (current) {
+        harris_node* next = unmarked(current->next[0]);
+        free(current);
+        current = next;
+    }
+    epoch_domain_destroy(list->reclaim);
+    free(list);
+}
+
+/* Find the predecessors and successors of 'key' in every level and write
+  them to 'preds' and 'succs', succs[i] is the first node in level i with a
+  key not smaller than 'key'. Marked nodes met on the way are unlinked, if
+  one of these CAS fails the predecessor changed and the search starts over.
+  Every pair written was adjacent and unmarked when it was read.
+  Returns true if succs[0] holds 'key' */
+static bool find(harris_list* list, skey_t key, harris_node** preds, harris_node** succs) {
+    harris_node* pred;
+retry:
+    pred = list->head;
+    for (int i = levels_in_use(&list->levels) - 1; i >= 0; i--) {
+        harris_node* current = unmarked(load_next(pred, i));
+        while (current) {
+            uintptr_t next = load_next(current, i);
+            if (is_marked(next)) {
+                /* help the remover, the node stays readable until we leave */
+                if (!cas_next(pred, i, (uintptr_t)current, next & ~MARK)) {
+                    restart(list);
+                    goto retry;
+                }
+                current = unmarked(next);
+                continue;
+            }
+            if (!KEY_LT(current->key, key)) break;
+            pred = current;
+            current = unmarked(next);
+        }
+        preds[i] = pred;
+        succs[i] = current;
+    }
+    return succs[0] && KEY_EQ(succs[0]->key, key);
+}
+
+bool harris_skiplist_contains(harris_list* list, skey_t key, void** data_out) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    /* like find, but marked nodes are stepped over instead of unlinked */
+    harris_node* pred = list->head;
+    harris_node* current = NULL;
+    for (int i = levels_in_use(&list->levels) - 1; i >= 0; i--) {
+        current = unmarked(load_next(pred, i));
+        while (current) {
+            uintptr_t next = load_next(current, i);
+            if (!is_marked(next) && !KEY_LT(current->key, key)) break;
+            if (!is_marked(next)) pred = current;
+            current = unmarked(next);
+        }
+    }
+    bool found = current && KEY_EQ(current->key, key);
+    if (found && data_out) *data_out = current->data;
+    epoch_leave(list->reclaim, slot);
+    return found;
+}
+
+bool harris_skiplist_add(harris_list* list, skey_t key, void* data, rng_state* random_state) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    harris_node* preds[SKIPLIST_MAX_LEVELS];
+    harris_node* succs[SKIPLIST_MAX_LEVELS];
+    epoch_slot* slot = epoch_enter(list->reclaim);
+
+    /* the node is created once the key is known to be missing and
+      reused if linking it has to be retried. Its height is drawn first,
+      so every search covers the levels it is linked in */
+    int k = levels_draw(levels_in_use(&list->levels), list->towers, list->prob, list->height_shift,
+        key, random_state);
+    harris_node* node = NULL;
+    while (true) {
+        if (find(list, key, preds, succs)) {
+            /* never published, nobody else can hold it */
+            free(node);
+            epoch_leave(list->reclaim, slot);
+            return false;
+        }
+        if (!node) {
+            node = create_node(key, data, k);
+            if (!node) {
+                epoch_leave(list->reclaim, slot);
+                return false;
+            }
+        }
+        for (int i = 0; i <= node->k; i++) {
+            node->next[i] = (uintptr_t)succs[i];
+        }
+        /* linearization point, the key is in the list once level 0 links it */
+        if (cas_next(preds[0], 0, (uintptr_t)succs[0], (uintptr_t)node)) break;
+        restart(list);
+    }
+    levels_count_add(&list->levels, &list->size, &list->capacity, list->prob);
+
+    /* Link the upper levels. Once a level is marked the node is being
+      removed and is not linked any higher */
+    for (int i = 1; i <= node->k; i++) {
+        while (true) {
+            uintptr_t next = load_next(node, i);
+            if (is_marked(next)) goto linked;
+            /* point the node at the successor found last, unless removal started */
+            if (next != (uintptr_t)succs[i] && !cas_next(node, i, next, (uintptr_t)succs[i])) goto linked;
+            if (cas_next(preds[i], i, (uintptr_t)succs[i], (uintptr_t)node)) break;
+            restart(list);
+            /* the node itself has to be found again, otherwise it was removed */
+            if (!find(list, key, preds, succs) || succs[0] != node) goto linked;
+        }
+    }
+linked:
+    /* a remover that ran before a level was linked did not unlink it there */
+    if (is_marked(load_next(node, node->k))) find(list, key, preds, succs);
+    release(list, slot, node);
+    epoch_leave(list->reclaim, slot);
+    return true;
+}
+
+bool harris_skiplist_remove(harris_list* list, skey_t key, void** data_out) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    harris_node* preds[SKIPLIST_MAX_LEVELS];
+    harris_node* succs[SKIPLIST_MAX_LEVELS];
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    if (!find(list, key, preds, succs)) {
+        epoch_leave(list->reclaim, slot);
+        return false;
+    }
+    harris_node* node = succs[0];
+
+    /* Mark the upper levels top down, so no search can reach the
+      node in a level it is already unlinked from below */
+    for (int i = node->k; i >= 1; i--) {
+        uintptr_t next = load_next(node, i);
+        while (!is_marked(next) && !cas_next(node, i, next, next | MARK)) {
+            next = load_next(node, i);
+        }
+    }
+    /* linearization point, whoever marks level 0 removed the key */
+    uintptr_t next = load_next(node, 0);
+    while (true) {
+        if (is_marked(next)) {
+            epoch_leave(list->reclaim, slot);
+            return false;
+        }
+        if (cas_next(node, 0, next, next | MARK)) break;
+        next = load_next(node, 0);
+    }
+    if (data_out) *data_out = node->data;
+    __atomic_sub_fetch(&list->size, 1, __ATOMIC_RELAXED);
+
+    /* unlink the node in every level it is linked in so far */
+    find(list, key, preds, succs);
+    release(list, slot, node);
+    epoch_leave(list->reclaim, slot);
+    return true;
+}
+
+size_t harris_skiplist_range_scan(harris_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx) {
+    harris_node* preds[SKIPLIST_MAX_LEVELS];
+    harris_node* succs[SKIPLIST_MAX_LEVELS];
+    size_t visited = 0;
+    epoch_slot* slot = epoch_enter(list->reclaim);
+    find(list, lo, preds, succs);
+    for (harris_node* node = succs[0]; node && KEY_LE(node->key, hi); ) {
+        uintptr_t next = load_next(node, 0);
+        if (!is_marked(next)) {
+            visited++;
+            if (!callback(node->key, node->data, ctx)) break;
+        }
+        node = unmarked(next);
+    }
+    epoch_leave(list->reclaim, slot);
+    return visited;
+}
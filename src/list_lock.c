@@ -0,0 +1,151 @@
+#include "../inc/list_lock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Wait statistics and MCS queue nodes of the calling thread, bit i of
+  'mcs_held' is set while thread_nodes[i] is enqueued on a lock */
+static __thread lock_wait_stats thread_stats;
+static __thread mcs_node thread_nodes[MCS_MAX_HELD];
+static __thread unsigned mcs_held = 0;
+
+/* A free queue node of the calling thread. Locks can be released in any
+  order, so the node of each is looked up by the one its holder recorded */
+static mcs_node* mcs_take_node(void) {
+    for (int i = 0; i < MCS_MAX_HELD; i++) {
+        if (!(mcs_held & (1u << i))) {
+            mcs_held |= 1u << i;
+            return &thread_nodes[i];
+        }
+    }
+    mcs_node* node = (mcs_node*)aligned_alloc(64, sizeof(mcs_node));
+    if (!node) abort();
+    return node;
+}
+
+static void mcs_put_node(mcs_node* node) {
+    ptrdiff_t i = node - thread_nodes;
+    if (i >= 0 && i < MCS_MAX_HELD) mcs_held &= ~(1u << i);
+    else free(node);
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* Wait a little longer, yielding once 'spins' gets large */
+static inline void backoff(int spins) {
+    if (spins < LOCK_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+/* Account an acquisition that had to wait since 'start' */
+static inline void record_wait(uint64_t start) {
+    uint64_t wait = now_ns() - start;
+    thread_stats.contended++;
+    thread_stats.wait_ns += wait;
+    if (wait > thread_stats.max_wait_ns) thread_stats.max_wait_ns = wait;
+}
+
+list_lock* list_lock_init(lock_kind kind) {
+    list_lock* lock = (list_lock*)aligned_alloc(64, sizeof(list_lock));
+    if (!lock) return NULL;
+    memset(lock, 0, sizeof(list_lock));
+    lock->kind = kind;
+    if (kind == OMP_LOCK) omp_init_lock(&lock->omp);
+    return lock;
+}
+
+void list_lock_destroy(list_lock* lock) {
+    if (lock->kind == OMP_LOCK) omp_destroy_lock(&lock->omp);
+    free(lock);
+}
+
+void list_lock_acquire(list_lock* lock) {
+    thread_stats.acquisitions++;
+    switch (lock->kind) {
+    case TICKET_LOCK: {
+        uint32_t ticket = __atomic_fetch_add(&lock->next_ticket, 1, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) == ticket) return;
+        uint64_t start = now_ns();
+        for (int spins = 0; __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) != ticket; spins++) {
+            backoff(spins);
+        }
+        record_wait(start);
+        return;
+    }
+    case MCS_LOCK: {
+        mcs_node* node = mcs_take_node();
+        node->next = NULL;
+        node->locked = 1;
+        mcs_node* pred = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+        if (pred) {
+            uint64_t start = now_ns();
+            __atomic_store_n(&pred->next, node, __ATOMIC_RELEASE);
+            for (int spins = 0; __atomic_load_n(&node->locked, __ATOMIC_ACQUIRE); spins++) {
+                backoff(spins);
+            }
+            record_wait(start);
+        }
+        lock->holder = node;
+        return;
+    }
+    case OMP_LOCK:
+    default:
+        if (omp_test_lock(&lock->omp)) return;
+        uint64_t start = now_ns();
+        omp_set_lock(&lock->omp);
+        record_wait(start);
+        return;
+    }
+}
+
+void list_lock_release(list_lock* lock) {
+    switch (lock->kind) {
+    case TICKET_LOCK:
+        __atomic_store_n(&lock->serving, lock->serving + 1, __ATOMIC_RELEASE);
+        return;
+    case MCS_LOCK: {
+        mcs_node* node = lock->holder;
+        mcs_node* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+        if (!next) {
+            /* no successor yet, unless one is just linking itself in */
+            mcs_node* expected = node;
+            if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                mcs_put_node(node);
+                return;
+            }
+            for (int spins = 0; !(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)); spins++) {
+                backoff(spins);
+            }
+        }
+        __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+        mcs_put_node(node);
+        return;
+    }
+    case OMP_LOCK:
+    default:
+        omp_unset_lock(&lock->omp);
+        return;
+    }
+}
+
+void lock_stats_reset(void) {
+    memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+lock_wait_stats lock_stats_get(void) {
+    return thread_stats;
+}
@@ -1,4 +1,5 @@
 #include "../inc/lock_free_skiplist.h"
+#include "../inc/thread_slot.h"
 
 #include <stdlib.h>
 #include <stdint.h>
@@ -8,6 +9,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define YIELD() sched_yield()
 #define MEMORY_ORDER_RELAXED __ATOMIC_RELAXED
@@ -22,6 +34,38 @@
     (var) = (type *)calloc(count, sizeof(type))
 #define FREE_MEMORY(var) free(var)
 
+// Retry statistics of the calling thread
+static __thread skiplist_retry_stats thread_stats;
+
+// Slot of the calling thread, see thread_slot.h. SKIPLIST_POOL_THREADS or
+// more if it has none
+static inline int thread_slot(void)
+{
+    int index = thread_slot_get();
+    return index < 0 ? SKIPLIST_POOL_THREADS : index;
+}
+
+// Counter shard of the calling thread, threads without a slot share one
+static inline int shard_index(void)
+{
+    return thread_slot() % SKIPLIST_COUNTER_SHARDS;
+}
+
+// Predecessors a pass went down from at every level, kept across retries
+// so the next pass resumes below the top.
+typedef struct {
+    skiplist_node *prevs[SKIPLIST_max_levels];
+    int highest; // highest level 'prevs' holds, -1 before the first pass
+    int resume;  // lowest level the next pass has to redo
+    bool retry;  // the next pass repeats one, counted in the statistics
+    epoch_domain *domain; // reclamation of the list, NULL if it has none
+    epoch_slot *slot;
+    uint32_t backoffs;    // waits before repeated passes so far
+    uint32_t referenced;  // layers whose 'prevs' entry holds a reference, without a domain
+} skiplist_path;
+
+_Static_assert(SKIPLIST_max_levels <= 32, "a path references its layers in a 32 bit mask");
+
 // Initialize a skiplist node with the specified top layer
 static inline void skiplist_init_internal(skiplist_node *node, size_t top_layer)
 {
@@ -37,7 +81,10 @@ static inline void skiplist_init_internal(skiplist_node *node, size_t top_layer)
     ATOMIC_STORE(node->being_modified, initial_state);
     ATOMIC_STORE(node->removed, initial_state);
 
-    // Update node's top_layer and allocate memory for next pointers if needed
+    // Update node's top_layer and allocate memory for next pointers if needed,
+    // pool nodes come with a tower of their height
+    if (node->embedded)
+        return;
     if (node->top_layer != top_layer || node->next == NULL)
     {
         node->top_layer = top_layer;
@@ -54,7 +101,7 @@ static inline void skiplist_init_internal(skiplist_node *node, size_t top_layer)
 }
 
 // Initialize a skiplist with the specified comparison function
-skiplist_raw* lock_free_skiplist_init(uint8_t levels, uint8_t prob, skiplist_cmp_t* cmp_func) {
+skiplist_raw* lock_free_skiplist_init(uint8_t levels, double prob, skiplist_cmp_t* cmp_func) {
     skiplist_raw* slist = (skiplist_raw*)malloc(sizeof(skiplist_raw));
     if (!slist) return NULL;
 
@@ -64,13 +111,19 @@ skiplist_raw* lock_free_skiplist_init(uint8_t levels, uint8_t prob, skiplist_cmp
 
     // Set prob and maximum levels values
     slist->prob = prob;
+    slist->height_shift = height_shift(prob);
     slist->levels = levels;
-    slist->total_nodes = 0;
 
-    // Allocate memory for layer entries
-    slist->layer_entries = (atm_uint32_t*)malloc(sizeof(atm_uint32_t) * slist->levels);
-    if (!slist->layer_entries) return NULL;
+    // Allocate zeroed counter shards
+    slist->counters = (skiplist_counter_shard *)aligned_alloc(64, sizeof(skiplist_counter_shard) * SKIPLIST_COUNTER_SHARDS);
+    if (!slist->counters)
+    {
+        FREE_MEMORY(slist);
+        return NULL;
+    }
+    memset(slist->counters, 0, sizeof(skiplist_counter_shard) * SKIPLIST_COUNTER_SHARDS);
     slist->top_layer = 0;
+    slist->towers = RANDOM_TOWERS;
 
     // Initialize head and tail nodes
     lock_free_skiplist_init_node(&slist->head);
@@ -94,20 +147,295 @@ skiplist_raw* lock_free_skiplist_init(uint8_t levels, uint8_t prob, skiplist_cmp
     // Set the comparison function
     slist->cmp_func = cmp_func;
 
+    // Erased nodes are left to the caller until reclamation is set
+    slist->reclaim = NULL;
+    slist->retire_func = NULL;
+    slist->retire_ctx = NULL;
+
+    // Nodes are compared with the comparison function until a key is set
+    slist->keyed = false;
+    slist->key_offset = 0;
+    slist->alloc_func = NULL;
+    slist->alloc_ctx = NULL;
+    slist->pool = NULL;
+    slist->wait = YIELD_WAIT;
+
     return slist;
 }
 
 void lock_free_skiplist_destroy(skiplist_raw *slist)
 {
+    // Hand back the retired nodes, references to them cannot be used anymore
+    if (slist->reclaim)
+    {
+        epoch_domain *reclaim = slist->reclaim;
+        slist->reclaim = NULL;
+        epoch_domain_destroy(reclaim);
+    }
+
+    // Release the pool with every node taken from it
+    if (slist->pool)
+    {
+        void *chunk = slist->pool->chunks;
+        while (chunk)
+        {
+            void *next = *(void **)chunk;
+            FREE_MEMORY(chunk);
+            chunk = next;
+        }
+        FREE_MEMORY(slist->pool->threads);
+        FREE_MEMORY(slist->pool);
+        slist->pool = NULL;
+    }
+
     //Destroy head and tail nodes
     lock_free_skiplist_destroy_node(&slist->head);
     lock_free_skiplist_destroy_node(&slist->tail);
     
-    FREE_MEMORY(slist->layer_entries);
-    slist->layer_entries = NULL;
+    FREE_MEMORY(slist->counters);
+    slist->counters = NULL;
 
     slist->aux = NULL;
     slist->cmp_func = NULL;
+    FREE_MEMORY(slist);
+}
+
+// Free callback of the reclamation domain. A node somebody still holds
+// a reference to is offered again with the next batch, unless the list
+// is being destroyed.
+static bool skiplist_free_retired(void *object, void *ctx)
+{
+    skiplist_raw *slist = (skiplist_raw *)ctx;
+    skiplist_node *node = (skiplist_node *)object;
+    if (slist->reclaim && !skiplist_is_safe_to_free(node))
+    {
+        return false;
+    }
+    // read first, the retire function frees nodes of its own
+    bool embedded = node->embedded;
+    slist->retire_func(node, slist->retire_ctx);
+    if (embedded)
+        lock_free_skiplist_pool_free(slist, node);
+    return true;
+}
+
+int lock_free_skiplist_set_reclaim(skiplist_raw *slist, skiplist_reclaim_mode mode,
+                                   skiplist_retire_fn *retire_func, void *ctx)
+{
+    if (slist->reclaim)
+    {
+        epoch_domain *reclaim = slist->reclaim;
+        slist->reclaim = NULL;
+        epoch_domain_destroy(reclaim);
+    }
+    slist->retire_func = retire_func;
+    slist->retire_ctx = ctx;
+    if (mode == SKIPLIST_RECLAIM_NONE || !retire_func)
+    {
+        return 0;
+    }
+
+    slist->reclaim = epoch_domain_init(mode == SKIPLIST_RECLAIM_HAZARD ? HAZARD_POINTERS : EPOCH_BASED,
+                                       skiplist_free_retired, slist);
+    return slist->reclaim ? 0 : -1;
+}
+
+void lock_free_skiplist_set_key(skiplist_raw *slist, ptrdiff_t key_offset,
+                                skiplist_alloc_fn *alloc_func, void *ctx)
+{
+    slist->keyed = true;
+    slist->key_offset = key_offset;
+    slist->alloc_func = alloc_func;
+    slist->alloc_ctx = ctx;
+}
+
+int lock_free_skiplist_set_pool(skiplist_raw *slist, size_t node_size, ptrdiff_t node_offset)
+{
+    skiplist_pool *pool = (skiplist_pool *)aligned_alloc(64, sizeof(skiplist_pool));
+    if (!pool)
+        return -1;
+    memset(pool, 0, sizeof(skiplist_pool));
+    pool->threads = (skiplist_pool_thread *)aligned_alloc(64, sizeof(skiplist_pool_thread) * SKIPLIST_POOL_THREADS);
+    if (!pool->threads)
+    {
+        FREE_MEMORY(pool);
+        return -1;
+    }
+    memset(pool->threads, 0, sizeof(skiplist_pool_thread) * SKIPLIST_POOL_THREADS);
+    pool->node_size = node_size;
+    pool->node_offset = node_offset;
+    // the tower follows the user struct, aligned for its pointers
+    pool->tower_offset = (node_size + sizeof(atm_node_ptr) - 1) & ~(sizeof(atm_node_ptr) - 1);
+    slist->pool = pool;
+    return 0;
+}
+
+static inline void pool_lock(skiplist_pool *pool)
+{
+    while (__atomic_exchange_n(&pool->lock, 1, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&pool->lock, __ATOMIC_RELAXED))
+            YIELD();
+    }
+}
+
+static inline void pool_unlock(skiplist_pool *pool)
+{
+    __atomic_store_n(&pool->lock, 0, __ATOMIC_RELEASE);
+}
+
+// Tower of the pool node 'node', at the same place for its whole life
+static inline atm_node_ptr *pool_tower(skiplist_pool *pool, skiplist_node *node)
+{
+    return (atm_node_ptr *)((uint8_t *)node - pool->node_offset + pool->tower_offset);
+}
+
+// Take a block for a node with 'top_layer' from the chunk space of
+// 'space', with a new chunk if it is used up. The caller holds the lock
+// for the guest space.
+static skiplist_node *pool_carve(skiplist_pool *pool, skiplist_pool_thread *space, uint8_t top_layer)
+{
+    size_t size = pool->tower_offset + sizeof(atm_node_ptr) * (top_layer + 1);
+    size = (size + 15) & ~(size_t)15;
+    if (!space->bump || (size_t)(space->end - space->bump) < size)
+    {
+        // the first 16 bytes link the chunks
+        size_t chunk_size = SKIPLIST_POOL_CHUNK > size + 16 ? SKIPLIST_POOL_CHUNK : size + 16;
+        uint8_t *chunk = (uint8_t *)malloc(chunk_size);
+        if (!chunk)
+            return NULL;
+        if (space != &pool->guest)
+            pool_lock(pool);
+        *(void **)chunk = pool->chunks;
+        pool->chunks = chunk;
+        if (space != &pool->guest)
+            pool_unlock(pool);
+        space->bump = chunk + 16;
+        space->end = chunk + chunk_size;
+    }
+    uint8_t *block = space->bump;
+    space->bump += size;
+    return (skiplist_node *)(block + pool->node_offset);
+}
+
+skiplist_node *lock_free_skiplist_pool_alloc(skiplist_raw *slist, uint8_t top_layer)
+{
+    skiplist_pool *pool = slist->pool;
+    if (top_layer >= SKIPLIST_max_levels)
+        top_layer = SKIPLIST_max_levels - 1;
+
+    skiplist_node *node = NULL;
+    int index = thread_slot();
+    if (index < SKIPLIST_POOL_THREADS)
+    {
+        skiplist_pool_thread *self = &pool->threads[index];
+        if (!self->free[top_layer])
+        {
+            // refill from the depot, nodes other threads freed
+            pool_lock(pool);
+            skiplist_node *batch = pool->depot[top_layer];
+            if (batch)
+            {
+                pool->depot[top_layer] = pool_tower(pool, batch)[0];
+                self->free[top_layer] = batch;
+                self->count[top_layer] = batch->accessing_next;
+            }
+            pool_unlock(pool);
+        }
+        node = self->free[top_layer];
+        if (node)
+        {
+            self->free[top_layer] = (skiplist_node *)node->next;
+            self->count[top_layer]--;
+        }
+        else
+        {
+            node = pool_carve(pool, self, top_layer);
+        }
+    }
+    else
+    {
+        pool_lock(pool);
+        node = pool->depot[top_layer];
+        if (node)
+        {
+            // split the first node off the batch
+            skiplist_node *rest = (skiplist_node *)node->next;
+            skiplist_node *next_batch = pool_tower(pool, node)[0];
+            if (rest)
+            {
+                pool_tower(pool, rest)[0] = next_batch;
+                rest->accessing_next = node->accessing_next - 1;
+                next_batch = rest;
+            }
+            pool->depot[top_layer] = next_batch;
+        }
+        else
+        {
+            node = pool_carve(pool, &pool->guest, top_layer);
+        }
+        pool_unlock(pool);
+    }
+    if (!node)
+        return NULL;
+
+    lock_free_skiplist_init_node(node);
+    node->next = pool_tower(pool, node);
+    node->top_layer = top_layer;
+    node->embedded = 1;
+    return node;
+}
+
+void lock_free_skiplist_pool_free(skiplist_raw *slist, skiplist_node *node)
+{
+    skiplist_pool *pool = slist->pool;
+    uint8_t top_layer = node->top_layer;
+    int index = thread_slot();
+    if (index >= SKIPLIST_POOL_THREADS)
+    {
+        // a batch of one
+        node->next = NULL;
+        node->accessing_next = 1;
+        pool_lock(pool);
+        pool_tower(pool, node)[0] = pool->depot[top_layer];
+        pool->depot[top_layer] = node;
+        pool_unlock(pool);
+        return;
+    }
+
+    skiplist_pool_thread *self = &pool->threads[index];
+    node->next = (atm_node_ptr *)self->free[top_layer];
+    self->free[top_layer] = node;
+    if (++self->count[top_layer] < 2 * SKIPLIST_POOL_BATCH)
+        return;
+
+    // hand a batch to threads that allocate more than they free
+    skiplist_node *batch = self->free[top_layer];
+    skiplist_node *last = batch;
+    for (int i = 1; i < SKIPLIST_POOL_BATCH; ++i)
+        last = (skiplist_node *)last->next;
+    self->free[top_layer] = (skiplist_node *)last->next;
+    self->count[top_layer] -= SKIPLIST_POOL_BATCH;
+    last->next = NULL;
+    batch->accessing_next = SKIPLIST_POOL_BATCH;
+    pool_lock(pool);
+    pool_tower(pool, batch)[0] = pool->depot[top_layer];
+    pool->depot[top_layer] = batch;
+    pool_unlock(pool);
+}
+
+// Start and end an operation. Nested operations are allowed, nodes the
+// outermost one reaches are not handed back before it ends (epoch mode)
+// or before it drops them from the path (hazard mode).
+static inline epoch_slot *skiplist_enter(skiplist_raw *slist)
+{
+    return slist->reclaim ? epoch_enter(slist->reclaim) : NULL;
+}
+
+static inline void skiplist_leave(skiplist_raw *slist, epoch_slot *slot)
+{
+    if (slist->reclaim)
+        epoch_leave(slist->reclaim, slot);
 }
 
 // Initialize a skiplist node to its default state
@@ -125,26 +453,51 @@ void lock_free_skiplist_init_node(skiplist_node *node)
     // Initialize other node attributes to default values
     node->accessing_next = 0;
     node->top_layer = 0;
+    node->embedded = 0;
     node->ref_count = 0;
 }
 
 void lock_free_skiplist_destroy_node(skiplist_node *node)
 {
-    FREE_MEMORY(node->next);
+    // the tower of a pool node goes back with the node
+    if (!node->embedded)
+        FREE_MEMORY(node->next);
     node->next = NULL;
 }
 
 size_t skiplist_get_size(skiplist_raw *slist)
 {
-    uint32_t val;
-    ATOMIC_LOAD(slist->total_nodes, val);
-    return val;
+    int64_t total = 0;
+    for (int i = 0; i < SKIPLIST_COUNTER_SHARDS; ++i)
+    {
+        int64_t val;
+        ATOMIC_LOAD(slist->counters[i].nodes, val);
+        total += val;
+    }
+    // an erase may be counted before the insert of its node in another shard
+    return total > 0 ? (size_t)total : 0;
+}
+
+// Count a node linked (+1) or unlinked (-1) by the calling thread
+static inline void skiplist_count(skiplist_raw *slist, int64_t delta)
+{
+    ATOMIC_FETCH_ADD(slist->counters[shard_index()].nodes, delta);
+}
+
+// Raise the top layer to 'top_layer' unless it is that high already.
+// Only a new highest tower writes it.
+static inline void skiplist_raise_top_layer(skiplist_raw *slist, uint8_t top_layer)
+{
+    uint8_t cur;
+    ATOMIC_LOAD(slist->top_layer, cur);
+    while (cur < top_layer && !ATOMIC_COMPARE_AND_SWAP(slist->top_layer, cur, top_layer))
+        ;
 }
 
 /* skiplist_raw_config skiplist_get_default_config()
 {
     skiplist_raw_config ret;
-    ret.prob = 3;
+    ret.prob = 0.5;
     ret.maxLayer = 16;
     ret.aux = NULL;
     return ret;
@@ -163,15 +516,27 @@ void skiplist_set_config(skiplist_raw *slist,
                          skiplist_raw_config config)
 {
     slist->prob = config.prob;
+    slist->height_shift = height_shift(config.prob);
 
     slist->levels = config.maxLayer;
-    if (slist->layer_entries)
-        FREE_MEMORY(slist->layer_entries);
-    ALLOCATE_MEMORY(atm_uint32_t, slist->layer_entries, slist->levels);
 
     slist->aux = config.aux;
 }
 
+static inline skey_t skiplist_node_key(skiplist_raw *slist, skiplist_node *node)
+{
+    return *(skey_t *)((uint8_t *)node + slist->key_offset);
+}
+
+static inline int skiplist_key_order(skey_t a, skey_t b)
+{
+#if SKIPLIST_KEY == KEY_STRING
+    return str_key_cmp(a, b);
+#else
+    return KEY_LT(a, b) ? -1 : !KEY_EQ(a, b);
+#endif
+}
+
 static inline int skiplist_compare(skiplist_raw *slist,
                                    skiplist_node *a,
                                    skiplist_node *b)
@@ -182,9 +547,30 @@ static inline int skiplist_compare(skiplist_raw *slist,
         return -1;
     if (a == &slist->tail || b == &slist->head)
         return 1;
+    if (slist->keyed)
+        return skiplist_key_order(skiplist_node_key(slist, a), skiplist_node_key(slist, b));
     return slist->cmp_func(a, b, slist->aux);
 }
 
+// What a search looks for, 'node' or if it is NULL a node holding 'key'
+typedef struct {
+    skiplist_node *node;
+    skey_t key;
+} skiplist_query;
+
+static inline int skiplist_compare_query(skiplist_raw *slist,
+                                         skiplist_query *query,
+                                         skiplist_node *b)
+{
+    if (query->node)
+        return skiplist_compare(slist, query->node, b);
+    if (b == &slist->tail)
+        return -1;
+    if (b == &slist->head)
+        return 1;
+    return skiplist_key_order(query->key, skiplist_node_key(slist, b));
+}
+
 static inline bool skiplist_node_isvalid(skiplist_node *node)
 {
     bool is_fully_linked = false;
@@ -192,19 +578,200 @@ static inline bool skiplist_node_isvalid(skiplist_node *node)
     return is_fully_linked;
 }
 
-static inline void skiplist_read_lock(skiplist_node *node)
+// Pauses of the longest spin, spins double from one up to it
+#define WAIT_MAX_SPINS (1024)
+
+// Polls PARK_WAIT spins for before it sleeps
+#define PARK_SPIN_POLLS (8)
+
+// Longest sleep of a parked thread before it polls again
+#define PARK_TIMEOUT_NS (1000000)
+
+// Threads parked on the words that hash to a bucket. Wakers only make
+// the syscall if somebody is parked.
+#define PARK_BUCKETS (256)
+
+typedef struct {
+    uint32_t parked;
+} __attribute__((aligned(64))) park_bucket;
+
+static park_bucket park_buckets[PARK_BUCKETS];
+
+// The 32 bit word a lock or flag is in, futexes sleep on those
+typedef uint32_t __attribute__((may_alias)) wait_word;
+
+// Progress of a wait of the calling thread
+typedef struct {
+    uint32_t polls; // so far, spins grow with them
+    uint64_t start; // of the wait being timed, 0 if none is
+} skiplist_waiter;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void cpu_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+// Word of the flag at 'flag' and the bits it takes in there
+static inline wait_word *skiplist_flag_word(atm_bool *flag)
+{
+    return (wait_word *)((uintptr_t)flag & ~(uintptr_t)3);
+}
+
+static inline uint32_t skiplist_flag_mask(atm_bool *flag)
+{
+    unsigned byte = (uintptr_t)flag & 3;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    byte = 3 - byte;
+#endif
+    return 0xffu << (8 * byte);
+}
+
+static inline park_bucket *skiplist_park_bucket(wait_word *word)
+{
+    uintptr_t hash = (uintptr_t)word >> 4;
+    return &park_buckets[(hash ^ (hash >> 8)) % PARK_BUCKETS];
+}
+
+static inline void skiplist_waiter_init(skiplist_waiter *waiter)
+{
+    waiter->polls = 0;
+    waiter->start = 0;
+}
+
+// Sleep until 'word', read as 'seen', changes and its writer wakes us,
+// or the timeout passed
+static void skiplist_park(wait_word *word, uint32_t seen)
+{
+#if defined(__linux__)
+    park_bucket *bucket = skiplist_park_bucket(word);
+    __atomic_fetch_add(&bucket->parked, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen)
+    {
+        struct timespec timeout = {0, PARK_TIMEOUT_NS};
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, &timeout, NULL, 0);
+    }
+    __atomic_fetch_sub(&bucket->parked, 1, __ATOMIC_RELAXED);
+#else
+    (void)word;
+    (void)seen;
+    YIELD();
+#endif
+}
+
+// Wake the threads parked on 'word' after it changed
+static inline void skiplist_wake(skiplist_raw *slist, wait_word *word)
+{
+#if defined(__linux__)
+    if (slist->wait != PARK_WAIT)
+        return;
+    // the change is visible before the parked count is read
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&skiplist_park_bucket(word)->parked, __ATOMIC_RELAXED))
+        syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)slist;
+    (void)word;
+#endif
+}
+
+// Wait once more. 'word', read as 'seen', is what the wait is for, NULL
+// if it is not for a single word. PARK_WAIT sleeps on it once spinning
+// took long enough, without one it yields instead. SPIN_WAIT yields too
+// once its spins stop growing, the thread it waits for may not be running.
+static void skiplist_wait_poll(skiplist_raw *slist, skiplist_waiter *waiter, wait_word *word, uint32_t seen)
+{
+    if (!waiter->start)
+        waiter->start = now_ns();
+    uint32_t polls = waiter->polls++;
+    if (slist->wait == YIELD_WAIT)
+    {
+        YIELD();
+        return;
+    }
+    if (slist->wait == SPIN_WAIT || polls < PARK_SPIN_POLLS)
+    {
+        uint32_t spins = polls < 10 ? 1u << polls : WAIT_MAX_SPINS;
+        for (uint32_t i = 0; i < spins; ++i)
+            cpu_pause();
+        if (spins == WAIT_MAX_SPINS)
+            YIELD();
+        return;
+    }
+    if (word)
+        skiplist_park(word, seen);
+    else
+        YIELD();
+}
+
+// Account the time since the first poll of the wait
+static inline void skiplist_wait_done(skiplist_waiter *waiter)
+{
+    if (!waiter->start)
+        return;
+    uint64_t wait = now_ns() - waiter->start;
+    waiter->start = 0;
+    thread_stats.waits++;
+    thread_stats.wait_ns += wait;
+    if (wait > thread_stats.max_wait_ns)
+        thread_stats.max_wait_ns = wait;
+}
+
+// Wait until the bits 'mask' of 'word' are clear, returns the word then
+static inline uint32_t skiplist_wait_clear(skiplist_raw *slist, wait_word *word, uint32_t mask)
+{
+    uint32_t val = __atomic_load_n(word, __ATOMIC_RELAXED);
+    if (!(val & mask))
+        return val;
+    skiplist_waiter waiter;
+    skiplist_waiter_init(&waiter);
+    do
+    {
+        skiplist_wait_poll(slist, &waiter, word, val);
+        val = __atomic_load_n(word, __ATOMIC_RELAXED);
+    } while (val & mask);
+    skiplist_wait_done(&waiter);
+    return val;
+}
+
+// Wait until no thread modifies 'node'
+static inline void skiplist_wait_unmodified(skiplist_raw *slist, skiplist_node *node)
+{
+    skiplist_wait_clear(slist, skiplist_flag_word(&node->being_modified),
+                        skiplist_flag_mask(&node->being_modified));
+}
+
+// Clear the `being_modified` flag of 'node', which was set
+static inline bool skiplist_clear_modified(skiplist_raw *slist, skiplist_node *node)
+{
+    bool exp = true;
+    bool bool_false = false;
+    bool cleared = ATOMIC_COMPARE_AND_SWAP(node->being_modified, exp, bool_false);
+    skiplist_wake(slist, skiplist_flag_word(&node->being_modified));
+    return cleared;
+}
+
+void lock_free_skiplist_set_wait(skiplist_raw *slist, wait_policy wait)
+{
+    slist->wait = wait;
+}
+
+static inline void skiplist_read_lock(skiplist_raw *slist, skiplist_node *node)
 {
     for (;;)
     {
         // Wait for active writer to release the lock
-        uint32_t accessing_next = 0;
-        ATOMIC_LOAD(node->accessing_next, accessing_next);
-        while (accessing_next & 0xfff00000)
-        {
-            YIELD();
-            ATOMIC_LOAD(node->accessing_next, accessing_next);
-        }
+        skiplist_wait_clear(slist, &node->accessing_next, 0xfff00000);
 
+        uint32_t accessing_next = 0;
         ATOMIC_FETCH_ADD(node->accessing_next, 0x1);
         ATOMIC_LOAD(node->accessing_next, accessing_next);
         if ((accessing_next & 0xfff00000) == 0)
@@ -213,66 +780,138 @@ static inline void skiplist_read_lock(skiplist_node *node)
         }
 
         ATOMIC_FETCH_SUB(node->accessing_next, 0x1);
+        skiplist_wake(slist, &node->accessing_next);
     }
 }
 
-static inline void skiplist_read_unlock(skiplist_node *node)
+static inline void skiplist_read_unlock(skiplist_raw *slist, skiplist_node *node)
 {
-    ATOMIC_FETCH_SUB(node->accessing_next, 0x1);
+    // a writer may wait for the readers to leave
+    if (ATOMIC_FETCH_SUB(node->accessing_next, 0x1) & 0xfff00000)
+        skiplist_wake(slist, &node->accessing_next);
 }
 
-static inline void skiplist_write_lock(skiplist_node *node)
+static inline void skiplist_write_lock(skiplist_raw *slist, skiplist_node *node)
 {
     for (;;)
     {
         // Wait for active writer to release the lock
-        uint32_t accessing_next = 0;
-        ATOMIC_LOAD(node->accessing_next, accessing_next);
-        while (accessing_next & 0xfff00000)
-        {
-            YIELD();
-            ATOMIC_LOAD(node->accessing_next, accessing_next);
-        }
+        skiplist_wait_clear(slist, &node->accessing_next, 0xfff00000);
 
+        uint32_t accessing_next = 0;
         ATOMIC_FETCH_ADD(node->accessing_next, 0x100000);
         ATOMIC_LOAD(node->accessing_next, accessing_next);
         if ((accessing_next & 0xfff00000) == 0x100000)
         {
             // Wait until there's no more readers
-            while (accessing_next & 0x000fffff)
-            {
-                YIELD();
-                ATOMIC_LOAD(node->accessing_next, accessing_next);
-            }
+            skiplist_wait_clear(slist, &node->accessing_next, 0x000fffff);
             return;
         }
 
         ATOMIC_FETCH_SUB(node->accessing_next, 0x100000);
+        skiplist_wake(slist, &node->accessing_next);
     }
 }
 
-static inline void skiplist_write_unlock(skiplist_node *node)
+static inline void skiplist_write_unlock(skiplist_raw *slist, skiplist_node *node)
 {
     ATOMIC_FETCH_SUB(node->accessing_next, 0x100000);
+    skiplist_wake(slist, &node->accessing_next);
+}
+
+// Hazard slots of the node a traversal stands on, the one it is about to
+// step to and the one it steps over. Slots below them hold the path.
+#define HAZARD_CUR (SKIPLIST_max_levels)
+#define HAZARD_NEXT (SKIPLIST_max_levels + 1)
+#define HAZARD_SKIP (SKIPLIST_max_levels + 2)
+_Static_assert(HAZARD_SKIP < EPOCH_HAZARDS, "not enough hazard slots for the path");
+
+// Reference counts taken on every node a traversal passes. Lists with a
+// reclamation domain skip them, the domain keeps those nodes readable.
+static inline void skiplist_hop_grab(skiplist_raw *slist, skiplist_node *node)
+{
+    if (!slist->reclaim)
+        ATOMIC_FETCH_ADD(node->ref_count, 1);
+}
+
+static inline void skiplist_hop_release(skiplist_raw *slist, skiplist_node *node)
+{
+    if (!slist->reclaim)
+        ATOMIC_FETCH_SUB(node->ref_count, 1);
+}
+
+// Reference a node found by a traversal for the caller. Without a domain
+// the traversal already holds one.
+static inline skiplist_node *skiplist_hand_out(skiplist_raw *slist, skiplist_node *node)
+{
+    if (slist->reclaim)
+        ATOMIC_FETCH_ADD(node->ref_count, 1);
+    return node;
+}
+
+static inline void skiplist_path_init(skiplist_raw *slist, skiplist_path *path, epoch_slot *slot)
+{
+    path->highest = -1;
+    path->resume = 0;
+    path->retry = false;
+    path->backoffs = 0;
+    path->referenced = 0;
+    path->domain = slist->reclaim;
+    path->slot = slot;
+}
+
+// In hazard mode, announce 'node', which is already protected by a
+// reference or another slot, in slot 'index'
+static inline void skiplist_path_protect(skiplist_path *path, int index, skiplist_node *node)
+{
+    if (path->domain)
+        epoch_protect(path->domain, path->slot, index, node);
+}
+
+// Move the traversal onto 'node'
+static inline void skiplist_path_advance(skiplist_path *path, skiplist_node *node)
+{
+    skiplist_path_protect(path, HAZARD_CUR, node);
+}
+
+// Load `cur_node->next[layer]`. In hazard mode it is announced in 'index'
+// and read again until it did not change, so it was still linked behind
+// `cur_node` once announced. The caller checks `cur_node` is still valid.
+static inline skiplist_node *skiplist_load_next(skiplist_path *path, skiplist_node *cur_node,
+                                                int layer, int index)
+{
+    skiplist_node *next_node;
+    ATOMIC_LOAD(cur_node->next[layer], next_node);
+    if (!path->domain || path->domain->mode != HAZARD_POINTERS)
+        return next_node;
+    for (;;)
+    {
+        skiplist_path_protect(path, index, next_node);
+        skiplist_node *again;
+        ATOMIC_LOAD(cur_node->next[layer], again);
+        if (again == next_node)
+            return next_node;
+        next_node = again;
+    }
 }
 
 // Note: it increases the `ref_count` of returned node.
 //       Caller is responsible to decrease it.
-static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
-                                           skiplist_node *cur_node,
-                                           int layer,
-                                           skiplist_node *node_to_find,
-                                           bool *found)
+static inline skiplist_node *skiplist_next_locked(skiplist_raw *slist,
+                                                  skiplist_node *cur_node,
+                                                  int layer,
+                                                  skiplist_node *node_to_find,
+                                                  bool *found)
 {
     skiplist_node *next_node = NULL;
 
     // Turn on `accessing_next` to ensure `cur_node` is not removable
     // and `cur_node->next` remains consistent until `accessing_next` is cleared.
-    skiplist_read_lock(cur_node);
+    skiplist_read_lock(slist, cur_node);
     {
         if (!skiplist_node_isvalid(cur_node))
         {
-            skiplist_read_unlock(cur_node);
+            skiplist_read_unlock(slist, cur_node);
             return NULL;
         }
 
@@ -281,7 +920,7 @@ static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
         ATOMIC_FETCH_ADD(next_node->ref_count, 1);
 
     }
-    skiplist_read_unlock(cur_node);
+    skiplist_read_unlock(slist, cur_node);
 
     size_t num_nodes = 0;
     skiplist_node *nodes[256];
@@ -294,11 +933,11 @@ static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
         }
 
         skiplist_node *temp = next_node;
-        skiplist_read_lock(temp);
+        skiplist_read_lock(slist, temp);
         {
             if (!skiplist_node_isvalid(temp))
             {
-                skiplist_read_unlock(temp);
+                skiplist_read_unlock(slist, temp);
                 ATOMIC_FETCH_SUB(temp->ref_count, 1);
                 next_node = NULL;
                 break;
@@ -309,7 +948,7 @@ static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
             nodes[num_nodes++] = temp;
 
         }
-        skiplist_read_unlock(temp);
+        skiplist_read_unlock(slist, temp);
     }
 
     for (size_t ii = 0; ii < num_nodes; ++ii)
@@ -320,19 +959,226 @@ static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
     return next_node;
 }
 
-static inline size_t skiplist_determine_top_layer(skiplist_raw *slist, unsigned short int random_state[3])
+// Same as skiplist_next_locked with plain loads and no reference taken,
+// the domain keeps the nodes readable. A node's validity only changes once
+// each way, so if it is valid before and after its next pointer is read,
+// the pointer was read while it was linked.
+static inline skiplist_node *skiplist_next_optimistic(skiplist_path *path,
+                                                      skiplist_node *cur_node,
+                                                      int layer,
+                                                      skiplist_node *node_to_find,
+                                                      bool *found)
+{
+    if (!skiplist_node_isvalid(cur_node))
+        return NULL;
+    skiplist_node *next_node = skiplist_load_next(path, cur_node, layer, HAZARD_NEXT);
+    if (!skiplist_node_isvalid(cur_node))
+        return NULL;
+
+    while ((next_node && !skiplist_node_isvalid(next_node)) || next_node == node_to_find)
+    {
+        if (found && node_to_find == next_node)
+        {
+            *found = true;
+        }
+
+        skiplist_node *temp = next_node;
+        if (!skiplist_node_isvalid(temp))
+            return NULL;
+        skiplist_path_protect(path, HAZARD_SKIP, temp);
+        next_node = skiplist_load_next(path, temp, layer, HAZARD_NEXT);
+        if (!skiplist_node_isvalid(temp))
+            return NULL;
+    }
+    return next_node;
+}
+
+// Successor of `cur_node` in 'layer' that is fully linked, stepping over
+// 'node_to_find'. NULL if `cur_node` or the successor is not valid.
+// Note: without a reclamation domain it increases the `ref_count` of the
+//       returned node, and the caller is responsible to decrease it.
+static inline skiplist_node *skiplist_next_internal(skiplist_raw *slist,
+                                                    skiplist_path *path,
+                                                    skiplist_node *cur_node,
+                                                    int layer,
+                                                    skiplist_node *node_to_find,
+                                                    bool *found)
+{
+    if (slist->reclaim)
+        return skiplist_next_optimistic(path, cur_node, layer, node_to_find, found);
+    return skiplist_next_locked(slist, cur_node, layer, node_to_find, found);
+}
+
+// Record 'node', the node the traversal stands on, as the predecessor at
+// 'layer'. In hazard mode it is announced in the slot for 'layer', without
+// a domain it is referenced, so a later pass can still resume from it
+// once the traversal moved on.
+static inline void skiplist_path_set(skiplist_path *path, int layer, skiplist_node *node)
+{
+    if (!path->domain)
+    {
+        uint32_t bit = 1u << layer;
+        if (path->referenced & bit)
+        {
+            if (path->prevs[layer] == node)
+                return;
+            ATOMIC_FETCH_SUB(path->prevs[layer]->ref_count, 1);
+        }
+        ATOMIC_FETCH_ADD(node->ref_count, 1);
+        path->referenced |= bit;
+    }
+    path->prevs[layer] = node;
+    skiplist_path_protect(path, layer, node);
+}
+
+// End the operation of 'path', dropping the references of its predecessors
+static inline void skiplist_path_done(skiplist_path *path)
+{
+    for (uint32_t held = path->referenced; held; held &= held - 1)
+        ATOMIC_FETCH_SUB(path->prevs[__builtin_ctz(held)]->ref_count, 1);
+    path->referenced = 0;
+}
+
+// Wait before a pass that ran into a change is repeated, longer with
+// every repetition
+static inline void skiplist_backoff(skiplist_raw *slist, skiplist_path *path)
 {
-    size_t layer = 0;
-    for (size_t i = 1; i < slist->levels; i++) {
-        double die;
-        drand48_r((struct drand48_data*)random_state, &die);
-        if (die > slist->prob) break;
-        layer++;
+    skiplist_waiter waiter;
+    skiplist_waiter_init(&waiter);
+    waiter.polls = path->backoffs++;
+    skiplist_wait_poll(slist, &waiter, NULL, 0);
+    skiplist_wait_done(&waiter);
+}
+
+// Record a conflict at 'layer' while on 'cur_node'. The next pass has to
+// redo 'layer' and, if 'redo' is higher, every layer up to 'redo'.
+static inline void skiplist_path_retry(skiplist_path *path, int layer, skiplist_node *cur_node, int redo)
+{
+    skiplist_path_set(path, layer, cur_node);
+    path->resume = layer > redo ? layer : redo;
+    path->retry = true;
+    thread_stats.retries++;
+}
+
+// Start a pass of a search that begins at layer 'top'. A later pass
+// starts from the lowest predecessor recorded from 'resume' up that is
+// still linked, the first one or if there is none from the head. The
+// recorded predecessors stay protected or referenced until the operation
+// ends, so they cannot be freed and reused while they are checked. The
+// node to start from is stored in 'start' and, without a domain,
+// referenced once more. Returns its layer.
+static inline int skiplist_path_start(skiplist_raw *slist, skiplist_path *path, int top,
+                                      skiplist_node **start)
+{
+    bool retry = path->retry;
+    path->retry = false;
+    if (path->highest >= 0)
+    {
+        for (int layer = path->resume; layer <= path->highest; ++layer)
+        {
+            skiplist_node *prev = path->prevs[layer];
+            if (skiplist_node_isvalid(prev))
+            {
+                skiplist_hop_grab(slist, prev);
+                skiplist_path_advance(path, prev);
+                *start = prev;
+                if (retry)
+                {
+                    thread_stats.retry_levels += layer + 1;
+                    thread_stats.skipped_levels += top > layer ? top - layer : 0;
+                }
+                return layer;
+            }
+        }
+        if (retry)
+            thread_stats.retry_levels += top + 1;
+    }
+    skiplist_hop_grab(slist, &slist->head);
+    *start = &slist->head;
+    path->highest = top;
+    return top;
+}
+
+void lock_free_skiplist_stats_reset(void)
+{
+    skiplist_retry_stats zero = {0};
+    thread_stats = zero;
+}
+
+skiplist_retry_stats lock_free_skiplist_stats_get(void)
+{
+    return thread_stats;
+}
+
+static inline size_t skiplist_determine_top_layer(skiplist_raw *slist, rng_state *random_state)
+{
+    return (size_t)geometric_height(random_state, slist->prob, slist->height_shift, slist->levels) - 1;
+}
+
+// Height for a new node holding 'key', derived from the key once a keyed
+// list was built with HASHED_TOWERS
+static inline size_t skiplist_key_top_layer(skiplist_raw *slist, skey_t key, rng_state *random_state)
+{
+    if (slist->towers == HASHED_TOWERS)
+        return (size_t)hashed_height(KEY_HASH(key), slist->prob, slist->height_shift, slist->levels) - 1;
+    return skiplist_determine_top_layer(slist, random_state);
+}
+
+uint8_t lock_free_skiplist_random_layer(skiplist_raw *slist, rng_state *random_state)
+{
+    return (uint8_t)skiplist_determine_top_layer(slist, random_state);
+}
+
+size_t lock_free_skiplist_build_sorted(skiplist_raw *slist, skiplist_node **nodes, size_t n,
+                                       tower_mode towers, rng_state *random_state)
+{
+    if (towers == HASHED_TOWERS && slist->keyed)
+        slist->towers = HASHED_TOWERS;
+
+    // Rightmost node of every layer, new nodes are appended behind them.
+    // The list is not shared yet, so nodes are linked without the flags.
+    skiplist_node *last[SKIPLIST_max_levels];
+    for (size_t layer = 0; layer < slist->levels; ++layer)
+    {
+        last[layer] = &slist->head;
+    }
+
+    size_t linked = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (linked > 0 && skiplist_compare(slist, nodes[i], last[0]) <= 0)
+        {
+            continue;
+        }
+        linked++;
+
+        size_t top_layer = nodes[i]->embedded ? nodes[i]->top_layer :
+            towers == DETERMINISTIC_TOWERS ?
+            (size_t)deterministic_height(linked, slist->prob, slist->levels) - 1 :
+            slist->keyed ? skiplist_key_top_layer(slist, skiplist_node_key(slist, nodes[i]), random_state) :
+            skiplist_determine_top_layer(slist, random_state);
+        skiplist_init_internal(nodes[i], top_layer);
+
+        for (size_t layer = 0; layer <= top_layer; ++layer)
+        {
+            nodes[i]->next[layer] = &slist->tail;
+            last[layer]->next[layer] = nodes[i];
+            last[layer] = nodes[i];
+        }
+        bool fully_linked = true;
+        ATOMIC_STORE(nodes[i]->is_fully_linked, fully_linked);
+
+        if (top_layer > slist->top_layer)
+        {
+            slist->top_layer = top_layer;
+        }
     }
-    return layer;
+    slist->counters[0].nodes += linked;
+    return linked;
 }
 
-static inline void skiplist_reset_flags(skiplist_node **node_arr,
+static inline void skiplist_reset_flags(skiplist_raw *slist,
+                                        skiplist_node **node_arr,
                                         int start_layer,
                                         int top_layer)
 {
@@ -343,9 +1189,7 @@ static inline void skiplist_reset_flags(skiplist_node **node_arr,
             node_arr[layer] != node_arr[layer + 1])
         {
 
-            bool exp = true;
-            bool bool_false = false;
-            if (!ATOMIC_COMPARE_AND_SWAP(node_arr[layer]->being_modified, exp, bool_false))
+            if (!skiplist_clear_modified(slist, node_arr[layer]))
             {
               // Print an error message if the compare-and-swap operation fails
     fprintf(stderr, "Error: Failed to set being_modified flag for node at layer %d\n", layer);
@@ -360,19 +1204,22 @@ static inline bool skiplist_are_adjacent_nodes_valid(skiplist_node *prev,
     return skiplist_node_isvalid(prev) && skiplist_node_isvalid(next);
 }
 
-static inline void initialize_node(skiplist_node *node, int top_layer)
+static inline void initialize_node(skiplist_raw *slist, skiplist_node *node, int top_layer)
 {
     skiplist_init_internal(node, top_layer);
-    skiplist_write_lock(node);
+    skiplist_write_lock(slist, node);
 }
 
 static inline void finalize_insertion(skiplist_raw *slist, skiplist_node *node, int top_layer, skiplist_node **prevs, int tid_hash)
 {
     bool bool_true = true;
 
+    // searches that can find the node start high enough to erase it
+    skiplist_raise_top_layer(slist, top_layer);
+
     for (int layer = 0; layer <= top_layer; ++layer)
     {
-        skiplist_write_lock(prevs[layer]);
+        skiplist_write_lock(slist, prevs[layer]);
         skiplist_node *exp = node->next[layer];
         if (!ATOMIC_COMPARE_AND_SWAP(prevs[layer]->next[layer], exp, node))
         {
@@ -381,26 +1228,17 @@ static inline void finalize_insertion(skiplist_raw *slist, skiplist_node *node,
             (void*)ATOMIC_GET(prevs[layer]->next[layer]), (void*)node->next[layer]);
         }
 
-        skiplist_write_unlock(prevs[layer]);
+        skiplist_write_unlock(slist, prevs[layer]);
     }
 
     ATOMIC_STORE(node->is_fully_linked, bool_true);
-    skiplist_write_unlock(node);
+    skiplist_write_unlock(slist, node);
 
 
 
-    ATOMIC_FETCH_ADD(slist->total_nodes, 1);
-    ATOMIC_FETCH_ADD(slist->layer_entries[node->top_layer], 1);
-    for (int ii = slist->levels - 1; ii >= 0; --ii)
-    {
-        if (slist->layer_entries[ii] > 0)
-        {
-            slist->top_layer = ii;
-            break;
-        }
-    }
+    skiplist_count(slist, 1);
 
-    skiplist_reset_flags(prevs, 0, top_layer);
+    skiplist_reset_flags(slist, prevs, 0, top_layer);
 }
 
 static inline bool lock_prev_node(skiplist_node *prev_node, bool *expected, bool bool_true)
@@ -408,38 +1246,47 @@ static inline bool lock_prev_node(skiplist_node *prev_node, bool *expected, bool
     return ATOMIC_COMPARE_AND_SWAP(prev_node->being_modified, *expected, bool_true);
 }
 
-static inline void reset_flags_and_retry(skiplist_node **prevs, int locked_layer, int top_layer, skiplist_node *cur_node)
+// Give the flags from 'locked_layer' up back and wait before the next
+// pass, until 'cur_node' is unmodified if 'blocked' is set
+static inline void reset_flags_and_retry(skiplist_raw *slist, skiplist_path *path, int locked_layer, int top_layer,
+                                         skiplist_node *cur_node, bool blocked)
 {
-    skiplist_reset_flags(prevs, locked_layer, top_layer);
-    ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-    YIELD();
+    skiplist_reset_flags(slist, path->prevs, locked_layer, top_layer);
+    if (blocked)
+        skiplist_wait_unmodified(slist, cur_node);
+    else
+        skiplist_backoff(slist, path);
+    skiplist_hop_release(slist, cur_node);
 }
 
-static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, bool no_dup, int top_layer, int tid_hash)
+// One pass of an insert, starting where 'path' says. Returns -1 if it ran
+// into a change and has to be repeated.
+static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, bool no_dup, int top_layer, int tid_hash,
+                                   skiplist_path *path)
 {
-    skiplist_node *prevs[SKIPLIST_max_levels];
+    skiplist_node **prevs = path->prevs;
     skiplist_node *nexts[SKIPLIST_max_levels];
 
     int comparison_result = 0, current_level = 0;
-    skiplist_node *cur_node = &slist->head;
-    ATOMIC_FETCH_ADD(cur_node->ref_count, 1);
+    skiplist_node *cur_node;
 
     int sl_top_layer = slist->top_layer;
     if (top_layer > sl_top_layer)
         sl_top_layer = top_layer;
 
-    for (current_level = sl_top_layer; current_level >= 0; --current_level)
+    for (current_level = skiplist_path_start(slist, path, sl_top_layer, &cur_node); current_level >= 0; --current_level)
     {
         do
         {
 
 
-            skiplist_node *next_node = skiplist_next_internal(slist, cur_node, current_level, NULL, NULL);
+            skiplist_node *next_node = skiplist_next_internal(slist, path, cur_node, current_level, NULL, NULL);
             if (!next_node)
             {
-                skiplist_reset_flags(prevs, current_level + 1, top_layer);
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                YIELD();
+                skiplist_reset_flags(slist, prevs, current_level + 1, top_layer);
+                skiplist_path_retry(path, current_level, cur_node, top_layer);
+                skiplist_hop_release(slist, cur_node);
+                skiplist_backoff(slist, path);
                 return -1;
             }
 
@@ -449,26 +1296,30 @@ static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, boo
                 // cur_node < next_node < node => move to next node
                 skiplist_node *temp = cur_node;
                 cur_node = next_node;
-                ATOMIC_FETCH_SUB(temp->ref_count, 1);
+                skiplist_path_advance(path, cur_node);
+                skiplist_hop_release(slist, temp);
                 continue;
             }
-            else
-            {
-                // otherwise: cur_node < node <= next_node
-                ATOMIC_FETCH_SUB(next_node->ref_count, 1);
-            }
+            // otherwise: cur_node < node <= next_node. `next_node` stays
+            // referenced until it was found valid with `cur_node` flagged,
+            // after that it cannot be unlinked.
 
             if (no_dup && comparison_result == 0)
             {
                 // Duplicate key is not allowed
-                skiplist_reset_flags(prevs, current_level + 1, top_layer);
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
+                skiplist_reset_flags(slist, prevs, current_level + 1, top_layer);
+                skiplist_hop_release(slist, next_node);
+                skiplist_hop_release(slist, cur_node);
                 return -2;
             }
 
-            if (current_level <= top_layer)
+            skiplist_path_set(path, current_level, cur_node);
+            if (current_level > top_layer)
+            {
+                skiplist_hop_release(slist, next_node);
+            }
+            else
             {
-                prevs[current_level] = cur_node;
                 nexts[current_level] = next_node;
 
                 int error_code = 0;
@@ -496,11 +1347,12 @@ static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, boo
                 {
                     error_code = -2;
                 }
+                skiplist_hop_release(slist, next_node);
 
                 if (error_code != 0)
                 {
-
-                    reset_flags_and_retry(prevs, locked_layer, top_layer, cur_node);
+                    skiplist_path_retry(path, current_level, cur_node, top_layer);
+                    reset_flags_and_retry(slist, path, locked_layer, top_layer, cur_node, error_code == -1);
                     return -1;
                 }
 
@@ -508,12 +1360,13 @@ static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, boo
                 ATOMIC_STORE(node->next[current_level], nexts[current_level]);
 
                 // Check if `cur_node->next` has been changed from `next_node`
-                skiplist_node *next_node_again = skiplist_next_internal(slist, cur_node, current_level, NULL, NULL);
-                ATOMIC_FETCH_SUB(next_node_again->ref_count, 1);
+                skiplist_node *next_node_again = skiplist_next_internal(slist, path, cur_node, current_level, NULL, NULL);
+                if (next_node_again)
+                    skiplist_hop_release(slist, next_node_again);
                 if (next_node_again != next_node)
                 {
-
-                    reset_flags_and_retry(prevs, current_level, top_layer, cur_node);
+                    skiplist_path_retry(path, current_level, cur_node, top_layer);
+                    reset_flags_and_retry(slist, path, current_level, top_layer, cur_node, false);
                     return -1;
                 }
             }
@@ -526,7 +1379,7 @@ static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, boo
 
             // Bottom layer => insertion succeeded
             finalize_insertion(slist, node, top_layer, prevs, tid_hash);
-            ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
+            skiplist_hop_release(slist, cur_node);
 
             return 0;
         } while (cur_node != &slist->tail);
@@ -534,22 +1387,28 @@ static inline int handle_insertion(skiplist_raw *slist, skiplist_node *node, boo
     return 0;
 }
 
-static inline int skiplist_add(skiplist_raw *slist, skiplist_node *node, bool no_dup, unsigned short int random_state[3])
+static inline int skiplist_add(skiplist_raw *slist, skiplist_node *node, bool no_dup, rng_state *random_state)
 {
     pthread_t tid = pthread_self();
     size_t tid_hash = ((size_t)tid) % 256;
 
-    int top_layer = skiplist_determine_top_layer(slist, random_state);
+    int top_layer = node->embedded ? node->top_layer :
+        slist->keyed ? (int)skiplist_key_top_layer(slist, skiplist_node_key(slist, node), random_state) :
+        (int)skiplist_determine_top_layer(slist, random_state);
 
     // Initialize node before insertion
-    initialize_node(node, top_layer);
-
+    initialize_node(slist, node, top_layer);
 
+    epoch_slot *slot = skiplist_enter(slist);
+    skiplist_path path;
+    skiplist_path_init(slist, &path, slot);
     while (true)
     {
-        int result = handle_insertion(slist, node, no_dup, top_layer, tid_hash);
+        int result = handle_insertion(slist, node, no_dup, top_layer, tid_hash, &path);
         if (result != -1)
         {
+            skiplist_path_done(&path);
+            skiplist_leave(slist, slot);
             return result;
         }
         // Retry insertion if result is -1
@@ -557,7 +1416,7 @@ static inline int skiplist_add(skiplist_raw *slist, skiplist_node *node, bool no
 }
 
 int lock_free_skiplist_insert(skiplist_raw *slist,
-                    skiplist_node *node,unsigned short int random_state[3])
+                    skiplist_node *node,rng_state *random_state)
 {
     return skiplist_add(slist, node, true, random_state);
 }
@@ -577,59 +1436,61 @@ typedef enum
     GREATER_THAN = 2
 } skiplist_find_mode;
 
-// Note: it increases the `ref_count` of returned node.
-//       Caller is responsible to decrease it.
-static inline skiplist_node *skiplist_find_node(skiplist_raw *slist,
-                                                skiplist_node *query,
-                                                skiplist_find_mode mode)
+// Search along 'path'. A search that does not find the key records a
+// predecessor at every level, an insert can go on from there.
+static inline skiplist_node *skiplist_find_internal(skiplist_raw *slist,
+                                                    skiplist_query *query,
+                                                    skiplist_find_mode mode,
+                                                    skiplist_path *path)
 {
-
 find_retry:
     (void)mode;
     int comparison_result = 0;
     int current_level = 0;
-    skiplist_node *cur_node = &slist->head;
-    ATOMIC_FETCH_ADD(cur_node->ref_count, 1);
+    skiplist_node *cur_node;
 
 
 
     uint8_t sl_top_layer = slist->top_layer;
-    for (current_level = sl_top_layer; current_level >= 0; --current_level)
+    for (current_level = skiplist_path_start(slist, path, sl_top_layer, &cur_node); current_level >= 0; --current_level)
     {
         do
         {
 
 
-            skiplist_node *next_node = skiplist_next_internal(slist, cur_node, current_level,
+            skiplist_node *next_node = skiplist_next_internal(slist, path, cur_node, current_level,
                                                      NULL, NULL);
             if (!next_node)
             {
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                YIELD();
+                skiplist_path_retry(path, current_level, cur_node, 0);
+                skiplist_hop_release(slist, cur_node);
+                skiplist_backoff(slist, path);
                 goto find_retry;
             }
-            comparison_result = skiplist_compare(slist, query, next_node);
+            comparison_result = skiplist_compare_query(slist, query, next_node);
             if (comparison_result > 0)
             {
                 // cur_node < next_node < query
                 // => move to next node
                 skiplist_node *temp = cur_node;
                 cur_node = next_node;
-                ATOMIC_FETCH_SUB(temp->ref_count, 1);
+                skiplist_path_advance(path, cur_node);
+                skiplist_hop_release(slist, temp);
                 continue;
             }
             else if (-1 <= mode && mode <= 1 && comparison_result == 0)
             {
                 // cur_node < query == next_node .. return
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                return next_node;
+                skiplist_hop_release(slist, cur_node);
+                return skiplist_hand_out(slist, next_node);
             }
 
             // otherwise: cur_node < query < next_node
             if (current_level)
             {
                 // non-bottom layer => go down
-                ATOMIC_FETCH_SUB(next_node->ref_count, 1);
+                skiplist_path_set(path, current_level, cur_node);
+                skiplist_hop_release(slist, next_node);
                 break;
             }
 
@@ -637,18 +1498,19 @@ find_retry:
             if (mode < 0 && cur_node != &slist->head)
             {
                 // smaller mode
-                ATOMIC_FETCH_SUB(next_node->ref_count, 1);
-                return cur_node;
+                skiplist_hop_release(slist, next_node);
+                return skiplist_hand_out(slist, cur_node);
             }
             else if (mode > 0 && next_node != &slist->tail)
             {
                 // greater mode
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                return next_node;
+                skiplist_hop_release(slist, cur_node);
+                return skiplist_hand_out(slist, next_node);
             }
             // otherwise: exact match mode OR not found
-            ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-            ATOMIC_FETCH_SUB(next_node->ref_count, 1);
+            skiplist_path_set(path, 0, cur_node);
+            skiplist_hop_release(slist, cur_node);
+            skiplist_hop_release(slist, next_node);
             return NULL;
         } while (cur_node != &slist->tail);
     }
@@ -656,26 +1518,107 @@ find_retry:
     return NULL;
 }
 
+// Note: it increases the `ref_count` of returned node.
+//       Caller is responsible to decrease it.
+static inline skiplist_node *skiplist_find_node(skiplist_raw *slist,
+                                                skiplist_query *query,
+                                                skiplist_find_mode mode)
+{
+    epoch_slot *slot = skiplist_enter(slist);
+    skiplist_path path;
+    skiplist_path_init(slist, &path, slot);
+    skiplist_node *found = skiplist_find_internal(slist, query, mode, &path);
+    skiplist_path_done(&path);
+    skiplist_leave(slist, slot);
+    return found;
+}
+
 skiplist_node *lock_free_skiplist_find(skiplist_raw *slist,
                              skiplist_node *query)
 {
-    return skiplist_find_node(slist, query, EQUAL);
+    skiplist_query q = {.node = query};
+    return skiplist_find_node(slist, &q, EQUAL);
 }
 
 skiplist_node *skiplist_find_smaller_or_equal(skiplist_raw *slist,
                                               skiplist_node *query)
 {
-    return skiplist_find_node(slist, query, LESS_THAN_OR_EQUAL);
+    skiplist_query q = {.node = query};
+    return skiplist_find_node(slist, &q, LESS_THAN_OR_EQUAL);
 }
 
 skiplist_node *skiplist_find_greater_or_equal(skiplist_raw *slist,
                                               skiplist_node *query)
 {
-    return skiplist_find_node(slist, query, GREATER_THAN_OR_EQUAL);
+    skiplist_query q = {.node = query};
+    return skiplist_find_node(slist, &q, GREATER_THAN_OR_EQUAL);
 }
 
-int skiplist_erase_node_passive(skiplist_raw *slist,
-                                skiplist_node *node)
+skiplist_node *lock_free_skiplist_find_key(skiplist_raw *slist, skey_t key)
+{
+    skiplist_query q = {.node = NULL, .key = key};
+    return skiplist_find_node(slist, &q, EQUAL);
+}
+
+skiplist_node *skiplist_find_key_greater_or_equal(skiplist_raw *slist, skey_t key)
+{
+    skiplist_query q = {.node = NULL, .key = key};
+    return skiplist_find_node(slist, &q, GREATER_THAN_OR_EQUAL);
+}
+
+int lock_free_skiplist_insert_key(skiplist_raw *slist, skey_t key, void *data,
+                                  rng_state *random_state)
+{
+    if (!slist->alloc_func || !slist->retire_func)
+        return -1;
+
+    pthread_t tid = pthread_self();
+    size_t tid_hash = ((size_t)tid) % 256;
+    int top_layer = skiplist_key_top_layer(slist, key, random_state);
+
+    epoch_slot *slot = skiplist_enter(slist);
+    skiplist_path path;
+    skiplist_path_init(slist, &path, slot);
+    skiplist_query q = {.node = NULL, .key = key};
+    int result = -2;
+    skiplist_node *found = skiplist_find_internal(slist, &q, EQUAL, &path);
+    if (found)
+    {
+        ATOMIC_FETCH_SUB(found->ref_count, 1);
+    }
+    else
+    {
+        skiplist_node *node = slist->alloc_func(top_layer, key, data, slist->alloc_ctx);
+        if (!node)
+        {
+            result = -1;
+        }
+        else
+        {
+            if (node->embedded)
+                top_layer = node->top_layer;
+            initialize_node(slist, node, top_layer);
+            // redo the levels of the new tower from the recorded predecessors
+            path.resume = top_layer;
+            while ((result = handle_insertion(slist, node, true, top_layer, tid_hash, &path)) == -1)
+                ;
+            if (result != 0)
+            {
+                bool embedded = node->embedded;
+                slist->retire_func(node, slist->retire_ctx);
+                if (embedded)
+                    lock_free_skiplist_pool_free(slist, node);
+            }
+        }
+    }
+    skiplist_path_done(&path);
+    skiplist_leave(slist, slot);
+    return result;
+}
+
+static int skiplist_erase_internal(skiplist_raw *slist,
+                                   skiplist_node *node,
+                                   epoch_slot *slot)
 {
 
     int top_layer = node->top_layer;
@@ -690,7 +1633,8 @@ int skiplist_erase_node_passive(skiplist_raw *slist,
         return -1;
     }
 
-    skiplist_node *prevs[SKIPLIST_max_levels];
+    skiplist_path path;
+    skiplist_node **prevs = path.prevs;
     skiplist_node *nexts[SKIPLIST_max_levels];
 
     bool expected = false;
@@ -703,7 +1647,7 @@ int skiplist_erase_node_passive(skiplist_raw *slist,
 
     // set removed flag first, so that reader cannot read this node.
     ATOMIC_STORE(node->removed, bool_true);
-
+    skiplist_path_init(slist, &path, slot);
 
 erase_node_retry:
     ATOMIC_LOAD(node->is_fully_linked, is_fully_linked);
@@ -712,31 +1656,33 @@ erase_node_retry:
         // already unlinked .. remove is done by other thread
         ATOMIC_STORE(node->removed, bool_false);
         ATOMIC_STORE(node->being_modified, bool_false);
+        skiplist_wake(slist, skiplist_flag_word(&node->being_modified));
+        skiplist_path_done(&path);
         return -3;
     }
 
     int comparison_result = 0;
     bool found_node_to_erase = false;
     (void)found_node_to_erase;
-    skiplist_node *cur_node = &slist->head;
-    ATOMIC_FETCH_ADD(cur_node->ref_count, 1);
+    skiplist_node *cur_node;
 
 
 
-    int current_level = slist->top_layer;
+    int current_level = skiplist_path_start(slist, &path, slist->top_layer, &cur_node);
     for (; current_level >= 0; --current_level)
     {
         do
         {
 
             bool node_found = false;
-            skiplist_node *next_node = skiplist_next_internal(slist, cur_node, current_level,
+            skiplist_node *next_node = skiplist_next_internal(slist, &path, cur_node, current_level,
                                                      node, &node_found);
             if (!next_node)
             {
-                skiplist_reset_flags(prevs, current_level + 1, top_layer);
-                ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                YIELD();
+                skiplist_reset_flags(slist, prevs, current_level + 1, top_layer);
+                skiplist_path_retry(&path, current_level, cur_node, top_layer);
+                skiplist_hop_release(slist, cur_node);
+                skiplist_backoff(slist, &path);
                 goto erase_node_retry;
             }
 
@@ -748,28 +1694,30 @@ erase_node_retry:
                 // => move to next node
                 skiplist_node *temp = cur_node;
                 cur_node = next_node;
+                skiplist_path_advance(&path, cur_node);
                 if (comparison_result > 0) {
                     int cmp2 = skiplist_compare(slist, cur_node, node);
                     if (cmp2 > 0) {
                         // node < cur_node <= next_node: not found.
-                        skiplist_reset_flags(prevs, current_level + 1, top_layer);
-                        ATOMIC_FETCH_SUB(temp->ref_count, 1);
-                        ATOMIC_FETCH_SUB(next_node->ref_count, 1);
+                        skiplist_reset_flags(slist, prevs, current_level + 1, top_layer);
+                        skiplist_hop_release(slist, temp);
+                        skiplist_hop_release(slist, next_node);
 
                     }
                 }
-                ATOMIC_FETCH_SUB(temp->ref_count, 1);
+                skiplist_hop_release(slist, temp);
                 continue;
             }
-            else
+            // otherwise: cur_node <= node <= next_node. `next_node` stays
+            // referenced until it was found valid with `cur_node` flagged.
+
+            skiplist_path_set(&path, current_level, cur_node);
+            if (current_level > top_layer)
             {
-                // otherwise: cur_node <= node <= next_node
-                ATOMIC_FETCH_SUB(next_node->ref_count, 1);
+                skiplist_hop_release(slist, next_node);
             }
-
-            if (current_level <= top_layer)
+            else
             {
-                prevs[current_level] = cur_node;
                 // note: 'next_node' and 'node' should not be the same, as 'removed' flag is already set.     
                 nexts[current_level] = next_node;
 
@@ -802,25 +1750,24 @@ erase_node_retry:
                 {
                     error_code = -2;
                 }
+                skiplist_hop_release(slist, next_node);
 
                 if (error_code != 0)
                 {
-                    skiplist_reset_flags(prevs, locked_layer, top_layer);
-                    ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                    YIELD();
+                    skiplist_path_retry(&path, current_level, cur_node, top_layer);
+                    reset_flags_and_retry(slist, &path, locked_layer, top_layer, cur_node, error_code == -1);
                     goto erase_node_retry;
                 }
 
                 skiplist_node *next_node_again =
-                    skiplist_next_internal(slist, cur_node, current_level, node, NULL);
-                ATOMIC_FETCH_SUB(next_node_again->ref_count, 1);
+                    skiplist_next_internal(slist, &path, cur_node, current_level, node, NULL);
+                if (next_node_again)
+                    skiplist_hop_release(slist, next_node_again);
                 if (next_node_again != nexts[current_level])
                 {
                     // `next` pointer has been changed, retry.
-
-                    skiplist_reset_flags(prevs, current_level, top_layer);
-                    ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
-                    YIELD();
+                    skiplist_path_retry(&path, current_level, cur_node, top_layer);
+                    reset_flags_and_retry(slist, &path, current_level, top_layer, cur_node, false);
                     goto erase_node_retry;
                 }
             }
@@ -833,16 +1780,16 @@ erase_node_retry:
     // bottom layer => removal succeeded.
 
     // mark this node unlinked
-    skiplist_write_lock(node);
+    skiplist_write_lock(slist, node);
     {
         ATOMIC_STORE(node->is_fully_linked, bool_false);
     }
-    skiplist_write_unlock(node);
+    skiplist_write_unlock(slist, node);
 
     // change prev nodes' next pointer from 0 ~ top_layer
     for (current_level = 0; current_level <= top_layer; ++current_level)
     {
-        skiplist_write_lock(prevs[current_level]);
+        skiplist_write_lock(slist, prevs[current_level]);
         skiplist_node *exp = node;
 
         if (!ATOMIC_COMPARE_AND_SWAP(prevs[current_level]->next[current_level],
@@ -851,31 +1798,36 @@ erase_node_retry:
         fprintf(stderr, "Failed to update next pointer at level %d\n", current_level);
         }
 
-        skiplist_write_unlock(prevs[current_level]);
+        skiplist_write_unlock(slist, prevs[current_level]);
     }
 
 
 
-    ATOMIC_FETCH_SUB(slist->total_nodes, 1);
-    ATOMIC_FETCH_SUB(slist->layer_entries[node->top_layer], 1);
-    for (int ii = slist->levels - 1; ii >= 0; --ii)
-    {
-        if (slist->layer_entries[ii] > 0)
-        {
-            slist->top_layer = ii;
-            break;
-        }
-    }
+    skiplist_count(slist, -1);
 
     // modification is done for all layers
-    skiplist_reset_flags(prevs, 0, top_layer);
-    ATOMIC_FETCH_SUB(cur_node->ref_count, 1);
+    skiplist_reset_flags(slist, prevs, 0, top_layer);
+    skiplist_hop_release(slist, cur_node);
 
     ATOMIC_STORE(node->being_modified, bool_false);
+    skiplist_wake(slist, skiplist_flag_word(&node->being_modified));
+    skiplist_path_done(&path);
 
     return 0;
 }
 
+int skiplist_erase_node_passive(skiplist_raw *slist,
+                                skiplist_node *node)
+{
+    epoch_slot *slot = skiplist_enter(slist);
+    int ret = skiplist_erase_internal(slist, node, slot);
+    // unlinked in every layer, nobody can reach it from the head anymore
+    if (ret == 0 && slist->reclaim)
+        epoch_retire(slist->reclaim, slot, node);
+    skiplist_leave(slist, slot);
+    return ret;
+}
+
 int skiplist_erase_node(skiplist_raw *slist,
                         skiplist_node *node)
 {
@@ -884,14 +1836,16 @@ int skiplist_erase_node(skiplist_raw *slist,
     {
         ret = skiplist_erase_node_passive(slist, node);
         // if ret == -2, other thread is accessing the same node at the same time. try again.
+        if (ret == -2)
+            skiplist_wait_unmodified(slist, node);
     } while (ret == -2);
     return ret;
 }
 
-int lock_free_skiplist_erase(skiplist_raw *slist,
-                   skiplist_node *query)
+// Erase 'found', referenced by the find that returned it
+static int skiplist_erase_found(skiplist_raw *slist,
+                                skiplist_node *found)
 {
-    skiplist_node *found = lock_free_skiplist_find(slist, query);
     if (!found)
     {
         // key not found
@@ -903,12 +1857,25 @@ int lock_free_skiplist_erase(skiplist_raw *slist,
     {
         ret = skiplist_erase_node_passive(slist, found);
         // if ret == -2, other thread is accessing the same node at the same time. try again.
+        if (ret == -2)
+            skiplist_wait_unmodified(slist, found);
     } while (ret == -2);
 
     ATOMIC_FETCH_SUB(found->ref_count, 1);
     return ret;
 }
 
+int lock_free_skiplist_erase(skiplist_raw *slist,
+                   skiplist_node *query)
+{
+    return skiplist_erase_found(slist, lock_free_skiplist_find(slist, query));
+}
+
+int lock_free_skiplist_erase_key(skiplist_raw *slist, skey_t key)
+{
+    return skiplist_erase_found(slist, lock_free_skiplist_find_key(slist, key));
+}
+
 int skiplist_is_valid_node(skiplist_node *node)
 {
     return skiplist_node_isvalid(node);
@@ -930,12 +1897,15 @@ int skiplist_is_safe_to_free(skiplist_node *node)
     return 1;
 }
 
-void skiplist_wait_for_free(skiplist_node *node)
+void skiplist_wait_for_free(skiplist_raw *slist, skiplist_node *node)
 {
+    skiplist_waiter waiter;
+    skiplist_waiter_init(&waiter);
     while (!skiplist_is_safe_to_free(node))
     {
-        YIELD();
+        skiplist_wait_poll(slist, &waiter, NULL, 0);
     }
+    skiplist_wait_done(&waiter);
 }
 
 void skiplist_grab_node(skiplist_node *node)
@@ -959,9 +1929,19 @@ skiplist_node *skiplist_next(skiplist_raw *slist,
 // To address this, the traversal should restart from the top layer to find 
 // a valid link, ensuring correctness.
 
-    skiplist_node *next = skiplist_next_internal(slist, node, 0, NULL, NULL);
+    epoch_slot *slot = skiplist_enter(slist);
+    skiplist_path path;
+    skiplist_path_init(slist, &path, slot);
+    skiplist_node *next = skiplist_next_internal(slist, &path, node, 0, NULL, NULL);
     if (!next)
-        next = skiplist_find_node(slist, node, GREATER_THAN);
+    {
+        skiplist_query q = {.node = node};
+        next = skiplist_find_internal(slist, &q, GREATER_THAN, &path);
+    }
+    else if (next != &slist->tail)
+        skiplist_hand_out(slist, next);
+    skiplist_path_done(&path);
+    skiplist_leave(slist, slot);
 
     if (next == &slist->tail)
         return NULL;
@@ -971,7 +1951,8 @@ skiplist_node *skiplist_next(skiplist_raw *slist,
 skiplist_node *skiplist_prev(skiplist_raw *slist,
                              skiplist_node *node)
 {
-    skiplist_node *prev = skiplist_find_node(slist, node, LESS_THAN);
+    skiplist_query q = {.node = node};
+    skiplist_node *prev = skiplist_find_node(slist, &q, LESS_THAN);
     if (prev == &slist->head)
         return NULL;
     return prev;
@@ -980,10 +1961,17 @@ skiplist_node *skiplist_prev(skiplist_raw *slist,
 skiplist_node *skiplist_begin(skiplist_raw *slist)
 {
     skiplist_node *next = NULL;
+    epoch_slot *slot = skiplist_enter(slist);
+    skiplist_path path;
+    skiplist_path_init(slist, &path, slot);
     while (!next)
     {
-        next = skiplist_next_internal(slist, &slist->head, 0, NULL, NULL);
+        next = skiplist_next_internal(slist, &path, &slist->head, 0, NULL, NULL);
     }
+    if (next != &slist->tail)
+        skiplist_hand_out(slist, next);
+    skiplist_path_done(&path);
+    skiplist_leave(slist, slot);
     if (next == &slist->tail)
         return NULL;
     return next;
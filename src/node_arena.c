@@ -0,0 +1,81 @@
+#include "../inc/node_arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Header of a chunk is padded so that blocks stay ARENA_ALIGN aligned */
+#define CHUNK_HEADER (((sizeof(arena_chunk) + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN)
+
+static inline size_t size_class(size_t size) {
+    return (size + ARENA_ALIGN - 1) / ARENA_ALIGN - 1;
+}
+
+node_arena* node_arena_init(size_t chunk_size) {
+    node_arena* arena = (node_arena*)malloc(sizeof(node_arena));
+    if (!arena) return NULL;
+    if (chunk_size == 0) chunk_size = ARENA_CHUNK_SIZE;
+    /* a chunk has to fit at least the largest size class */
+    if (chunk_size < CHUNK_HEADER + ARENA_ALIGN * ARENA_CLASSES)
+        chunk_size = CHUNK_HEADER + ARENA_ALIGN * ARENA_CLASSES;
+    /* aligned_alloc wants a multiple of the alignment */
+    chunk_size = ((chunk_size + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN;
+    arena->chunk_size = chunk_size;
+    arena->chunks = NULL;
+    arena->bump = NULL;
+    arena->end = NULL;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+    return arena;
+}
+
+void node_arena_destroy(node_arena* arena) {
+    arena_chunk* current = arena->chunks;
+    while (current) {
+        arena_chunk* next = current->next;
+        free(current);
+        current = next;
+    }
+    free(arena);
+}
+
+/* Request a new chunk from malloc and make it the bump region */
+static bool grow(node_arena* arena) {
+    arena_chunk* chunk = (arena_chunk*)aligned_alloc(ARENA_ALIGN, arena->chunk_size);
+    if (!chunk) return false;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bump = (char*)chunk + CHUNK_HEADER;
+    arena->end = (char*)chunk + arena->chunk_size;
+    return true;
+}
+
+void* node_arena_alloc(node_arena* arena, size_t size) {
+    if (size == 0) size = 1;
+    size_t class = size_class(size);
+    if (class >= ARENA_CLASSES) return NULL;
+
+    /* Recycle a block of the same size class */
+    void* block = arena->free_lists[class];
+    if (block) {
+        arena->free_lists[class] = *(void**)block;
+        return block;
+    }
+
+    /* Carve a new block from the current chunk. The remainder of
+      a chunk too small for the request is abandoned */
+    size_t bytes = (class + 1) * ARENA_ALIGN;
+    if (!arena->bump || (size_t)(arena->end - arena->bump) < bytes) {
+        if (!grow(arena)) return NULL;
+    }
+    block = arena->bump;
+    arena->bump += bytes;
+    return block;
+}
+
+void node_arena_free(node_arena* arena, void* block, size_t size) {
+    if (!block) return;
+    if (size == 0) size = 1;
+    size_t class = size_class(size);
+    *(void**)block = arena->free_lists[class];
+    arena->free_lists[class] = block;
+}
@@ -4,38 +4,158 @@
 #include <string.h>
 #include <stdbool.h>
 
-seq_list* seq_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange, long int random_seed) {
+/* Size of a node with a tower of 'height' next pointers,
+  rounded up so consecutive nodes stay NODE_ALIGN aligned */
+static inline size_t node_size(uint8_t height) {
+    size_t size = sizeof(seq_node) + sizeof(seq_node*) * height;
+    return ((size + NODE_ALIGN - 1) / NODE_ALIGN) * NODE_ALIGN;
+}
+
+/* Allocate a node with an empty tower of 'height' next pointers */
+static seq_node* create_node(seq_list* list, skey_t key, void* data, uint8_t height) {
+    seq_node* node;
+    if (list->arena) {
+        node = (seq_node*)node_arena_alloc(list->arena, node_size(height));
+    } else {
+        node = (seq_node*)aligned_alloc(NODE_ALIGN, node_size(height));
+    }
+    if (!node) return NULL;
+    memset(node->next, 0, sizeof(seq_node*) * height);
+    node->key = key;
+    node->height = height;
+    node->data = data;
+    return node;
+}
+
+static void destroy_node(seq_list* list, seq_node* node) {
+    if (list->arena) {
+        node_arena_free(list->arena, node, node_size(node->height));
+    } else {
+        free(node);
+    }
+}
+
+/* Height of a new node for 'key', it is present in level i+1 with
+  probability list->prob if it is in level i */
+static uint8_t random_height(seq_list* list, skey_t key) {
+    if (list->towers == HASHED_TOWERS)
+        return hashed_height(KEY_HASH(key), list->prob, list->height_shift, list->levels);
+    return geometric_height(&list->random_state, list->prob, list->height_shift, list->levels);
+}
+
+/* Add levels until they are sized for 'size' keys. The head already has
+  a tower of SKIPLIST_MAX_LEVELS, new levels start out empty */
+static void grow_levels(seq_list* list, size_t size) {
+    while (size > list->capacity && list->levels < SKIPLIST_MAX_LEVELS) {
+        list->levels++;
+        list->capacity = level_capacity(list->prob, list->levels);
+    }
+}
+
+seq_list* seq_skiplist_init(uint8_t levels, double prob, skey_range_t keyrange, long int random_seed,
+    node_allocator allocator) {
     seq_list* skiplist = (seq_list*)malloc(sizeof(seq_list));
     if (!skiplist) return NULL;
+    if (levels < 1) levels = 1;
+    if (levels > SKIPLIST_MAX_LEVELS) levels = SKIPLIST_MAX_LEVELS;
     skiplist->levels = levels;
     skiplist->prob = prob;
+    skiplist->height_shift = height_shift(prob);
+    skiplist->towers = RANDOM_TOWERS;
+    skiplist->size = 0;
+    skiplist->capacity = level_capacity(prob, levels);
     skiplist->keyrange.min = keyrange.min;
     skiplist->keyrange.max = keyrange.max;
 
+    skiplist->removals = 0;
+    skiplist->arena = NULL;
+    if (allocator == ARENA_ALLOC) {
+        skiplist->arena = node_arena_init(ARENA_CHUNK_SIZE);
+        if (!skiplist->arena) {
+            free(skiplist);
+            return NULL;
+        }
+    }
+
     /* Initialize random state */
-    skiplist->random_state = (struct drand48_data*)malloc(6);
-    srand48_r(random_seed, skiplist->random_state);
+    rng_seed(&skiplist->random_state, random_seed);
 
     /* Create head node */
-    skiplist->head = (seq_node*)malloc(sizeof(seq_node));
+    skiplist->head = create_node(skiplist, skiplist->keyrange.min, NULL, SKIPLIST_MAX_LEVELS);
     if (!skiplist->head) return NULL;
-    skiplist->head->next = (seq_node**)malloc(sizeof(seq_node*) * skiplist->levels);
-    for (size_t i = 0; i < skiplist->levels; i++) {
-        skiplist->head->next[i] = NULL;
-    }
-    skiplist->head->key = skiplist->keyrange.min;
     return skiplist;
 }
 
+seq_list* seq_skiplist_build_sorted(const skey_t* keys, void** values, size_t n,
+    uint8_t levels, double prob, skey_range_t keyrange, long int random_seed,
+    node_allocator allocator, tower_mode towers) {
+    seq_list* list = seq_skiplist_init(levels, prob, keyrange, random_seed, allocator);
+    if (!list) return NULL;
+    if (towers == HASHED_TOWERS) list->towers = HASHED_TOWERS;
+    /* size the levels for all keys up front, towers are only drawn once */
+    grow_levels(list, n);
+
+    /* Rightmost node of every level, new nodes are appended behind them */
+    seq_node** last = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
+    if (!last) {
+        seq_skiplist_destroy(list);
+        return NULL;
+    }
+    for (size_t i = 0; i < list->levels; i++) {
+        last[i] = list->head;
+    }
+
+    size_t position = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], keyrange)) continue;
+        if (position > 0 && KEY_LE(keys[j], last[0]->key)) continue;
+        position++;
+
+        uint8_t height = towers == DETERMINISTIC_TOWERS ?
+            deterministic_height(position, list->prob, list->levels) : random_height(list, keys[j]);
+        seq_node* node = create_node(list, keys[j], values ? values[j] : NULL, height);
+        if (!node) {
+            free(last);
+            seq_skiplist_destroy(list);
+            return NULL;
+        }
+        for (uint8_t i = 0; i < height; i++) {
+            last[i]->next[i] = node;
+            last[i] = node;
+        }
+    }
+    list->size = position;
+    free(last);
+    return list;
+}
+
+size_t seq_skiplist_size(seq_list* list) {
+    return list->size;
+}
+
+size_t seq_skiplist_memory(seq_list* list, size_t* n_keys) {
+    size_t bytes = 0;
+    size_t keys = 0;
+    for (seq_node* current = list->head->next[0]; current; current = current->next[0]) {
+        bytes += node_size(current->height);
+        keys++;
+    }
+    if (n_keys) *n_keys = keys;
+    return bytes;
+}
+
 void seq_skiplist_destroy(seq_list* list) {
-    seq_node* current = list->head;
-    while (current) {
-        seq_node* next = current->next[0];
-        if (current->next) free(current->next);
-        free(current);
-        current = next;
+    if (list->arena) {
+        /* nodes live in the arena chunks, no need to walk the list */
+        node_arena_destroy(list->arena);
+    } else {
+        seq_node* current = list->head;
+        while (current) {
+            seq_node* next = current->next[0];
+            destroy_node(list, current);
+            current = next;
+        }
     }
-    free(list->random_state);
     free(list);
 }
 
@@ -43,20 +163,87 @@ void seq_skiplist_destroy(seq_list* list) {
   If 'key' is contained in 'list', 'pred' will contain a pointer to the node with 
   key = 'key' for each level it was present in
   Returns true if key was found, false otherwise */
-static bool find_predecessors(seq_list* list, int key, seq_node** preds) {
+static bool find_predecessors(seq_list* list, skey_t key, seq_node** preds) {
     seq_node* current = list->head;
     for (int i = list->levels - 1; i >= 0; i--) {
         seq_node* next = current->next[i];
-        while (next && key > next->key) {
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+        preds[i] = current;
+    }
+    /* current is preds[0] now */
+    return current->next[0] && KEY_EQ(current->next[0]->key, key);
+}
+
+/* Like find_predecessors, but starts from 'preds' left by an earlier search
+  as a finger. Only the levels where the finger lags behind 'key' are walked,
+  from the highest of them down, which is cheap if 'key' is close to the
+  finger. Every node in 'preds' has to be still linked. Falls back to a
+  search from the head if 'key' lies before the finger */
+static bool find_predecessors_from(seq_list* list, skey_t key, seq_node** preds) {
+    if (preds[0] != list->head && KEY_GE(preds[0]->key, key)) {
+        return find_predecessors(list, key, preds);
+    }
+    /* above the highest lagging level the finger still holds the predecessors */
+    int level = list->levels - 1;
+    while (level > 0 && !(preds[level]->next[level] && KEY_GT(key, preds[level]->next[level]->key))) {
+        level--;
+    }
+    seq_node* current = preds[level];
+    for (int i = level; i >= 0; i--) {
+        /* the finger may be ahead at lower levels */
+        if (KEY_GT(preds[i]->key, current->key)) current = preds[i];
+        seq_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
             current = next;
             next = current->next[i];
         }
         preds[i] = current;
     }
-    return preds[0]->next[0] && preds[0]->next[0]->key == key;
+    return current->next[0] && KEY_EQ(current->next[0]->key, key);
+}
+
+/* Link a new node with 'key' and a tower of random height behind 'preds'.
+  Returns false if out of memory */
+static bool link_node(seq_list* list, seq_node** preds, skey_t key, void* data) {
+    seq_node* new_node = create_node(list, key, data, random_height(list, key));
+    if (!new_node) return false;
+    for (uint8_t i = 0; i < new_node->height; i++) {
+        new_node->next[i] = preds[i]->next[i];
+        preds[i]->next[i] = new_node;
+    }
+    grow_levels(list, ++list->size);
+    return true;
+}
+
+/* Unlink and free the node following preds[0], returns its data.
+  The predecessors stay linked, so they remain a valid finger */
+static void* unlink_node(seq_list* list, seq_node** preds) {
+    seq_node* target = preds[0]->next[0];
+    for (uint8_t i = 0; i < target->height; i++) {
+        preds[i]->next[i] = target->next[i];
+    }
+    void* data = target->data;
+    destroy_node(list, target);
+    list->size--;
+    list->removals++;
+    return data;
+}
+
+/* Predecessor array for a batch or finger, every level starts at the head.
+  It covers all levels the list may grow to while it is in use */
+static seq_node** batch_preds(seq_list* list) {
+    seq_node** preds = (seq_node**)malloc(sizeof(seq_node*) * SKIPLIST_MAX_LEVELS);
+    if (!preds) return NULL;
+    for (size_t i = 0; i < SKIPLIST_MAX_LEVELS; i++) {
+        preds[i] = list->head;
+    }
+    return preds;
 }
 
-seq_node* seq_skiplist_contains(seq_list* list, int key) {
+seq_node* seq_skiplist_contains(seq_list* list, skey_t key) {
     seq_node** preds = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
     if (!preds) return NULL;
 
@@ -68,8 +255,8 @@ seq_node* seq_skiplist_contains(seq_list* list, int key) {
     return result;
 }
 
-bool seq_skiplist_add(seq_list* list, int key, void* data) {
-    if (key < list->keyrange.min || key > list->keyrange.max) return false;
+bool seq_skiplist_add(seq_list* list, skey_t key, void* data) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
 
     seq_node** preds = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
     if (!preds) return false;
@@ -79,61 +266,163 @@ bool seq_skiplist_add(seq_list* list, int key, void* data) {
         return false; /* Key already exists */
     }
 
-    /* Create new node */
-    seq_node* new_node = (seq_node*)malloc(sizeof(seq_node));
-    if (!new_node) {
-        free(preds);
-        return false;
-    }
-    new_node->next = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
-    if (!new_node->next) {
-        free(new_node);
+    /* Create new node with a tower of random height */
+    bool added = link_node(list, preds, key, data);
+    free(preds);
+    return added;
+}
+
+bool seq_skiplist_remove(seq_list* list, skey_t key, void** data_out) {
+    seq_node** preds = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
+    if (!find_predecessors(list, key, preds)) {
         free(preds);
-        return false;
+        return false; /* Key not found */
     }
-    memset(new_node->next, 0, sizeof(seq_node*) * list->levels);
-    new_node->key = key;
-    new_node->data = data;
 
-    /* Link at level 0 */
-    new_node->next[0] = preds[0]->next[0];
-    preds[0]->next[0] = new_node;
+    void* data = unlink_node(list, preds);
+    if (data_out) *data_out = data;
+    free(preds);
+    return true;
+}
 
-    /* Probabilistic linking for higher levels */
-    for (size_t i = 1; i < list->levels; i++) {
-        double die;
-        drand48_r(list->random_state, &die);
-        if (die > list->prob) break;
+size_t seq_skiplist_contains_batch(seq_list* list, const skey_t* keys, size_t n, seq_node** results) {
+    seq_node** preds = batch_preds(list);
+    if (!preds) return 0;
 
-        new_node->next[i] = preds[i]->next[i];
-        preds[i]->next[i] = new_node;
+    size_t found = 0;
+    for (size_t j = 0; j < n; j++) {
+        seq_node* result = NULL;
+        if (find_predecessors_from(list, keys[j], preds)) {
+            result = preds[0]->next[0];
+            found++;
+        }
+        if (results) results[j] = result;
     }
+    free(preds);
+    return found;
+}
+
+size_t seq_skiplist_add_batch(seq_list* list, const skey_t* keys, void** values, size_t n) {
+    seq_node** preds = batch_preds(list);
+    if (!preds) return 0;
 
+    size_t added = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (!KEY_IN_RANGE(keys[j], list->keyrange)) continue;
+        if (find_predecessors_from(list, keys[j], preds)) continue; /* Key already exists */
+        if (!link_node(list, preds, keys[j], values ? values[j] : NULL)) break;
+        added++;
+    }
     free(preds);
-    return true;
+    return added;
 }
 
-bool seq_skiplist_remove(seq_list* list, int key, void** data_out) {
-    seq_node** preds = (seq_node**)malloc(sizeof(seq_node*) * list->levels);
-    if (!find_predecessors(list, key, preds)) {
-        free(preds);
-        return false; /* Key not found */
+size_t seq_skiplist_remove_batch(seq_list* list, const skey_t* keys, size_t n, void** data_out) {
+    seq_node** preds = batch_preds(list);
+    if (!preds) return 0;
+
+    size_t removed = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (data_out) data_out[j] = NULL;
+        if (!find_predecessors_from(list, keys[j], preds)) continue; /* Key not found */
+        void* data = unlink_node(list, preds);
+        if (data_out) data_out[j] = data;
+        removed++;
     }
+    free(preds);
+    return removed;
+}
 
-    seq_node* target = preds[0]->next[0];
-    for (size_t i = 0; i < list->levels; i++) {
-        if (preds[i]->next[i] == target) {
-            preds[i]->next[i] = target->next[i];
-        }
+seq_finger* seq_skiplist_finger_init(seq_list* list) {
+    seq_finger* finger = (seq_finger*)malloc(sizeof(seq_finger));
+    if (!finger) return NULL;
+    finger->preds = batch_preds(list);
+    if (!finger->preds) {
+        free(finger);
+        return NULL;
     }
+    finger->removals = list->removals;
+    return finger;
+}
 
-    if (data_out) *data_out = target->data;
-    free(target->next);
-    free(target);
-    free(preds);
+void seq_skiplist_finger_destroy(seq_finger* finger) {
+    free(finger->preds);
+    free(finger);
+}
+
+/* Search 'key' starting from 'finger', a finger that saw fewer removals
+  than the list may hold freed nodes and starts over from the head */
+static bool finger_search(seq_list* list, seq_finger* finger, skey_t key) {
+    if (finger->removals != list->removals) {
+        finger->removals = list->removals;
+        return find_predecessors(list, key, finger->preds);
+    }
+    return find_predecessors_from(list, key, finger->preds);
+}
+
+seq_node* seq_skiplist_finger_contains(seq_list* list, seq_finger* finger, skey_t key) {
+    if (!finger_search(list, finger, key)) return NULL;
+    return finger->preds[0]->next[0];
+}
+
+bool seq_skiplist_finger_add(seq_list* list, seq_finger* finger, skey_t key, void* data) {
+    if (!KEY_IN_RANGE(key, list->keyrange)) return false;
+    if (finger_search(list, finger, key)) return false; /* Key already exists */
+    return link_node(list, finger->preds, key, data);
+}
+
+bool seq_skiplist_finger_remove(seq_list* list, seq_finger* finger, skey_t key, void** data_out) {
+    if (!finger_search(list, finger, key)) return false; /* Key not found */
+    void* data = unlink_node(list, finger->preds);
+    if (data_out) *data_out = data;
+    /* the own removal leaves the finger intact */
+    finger->removals = list->removals;
     return true;
 }
 
+/* First node with a key not smaller than 'key', NULL if there is none */
+static seq_node* find_first(seq_list* list, skey_t key) {
+    seq_node* current = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        seq_node* next = current->next[i];
+        while (next && KEY_GT(key, next->key)) {
+            current = next;
+            next = current->next[i];
+        }
+    }
+    return current->next[0];
+}
+
+size_t seq_skiplist_range_scan(seq_list* list, skey_t lo, skey_t hi, skey_callback callback, void* ctx) {
+    size_t visited = 0;
+    for (seq_node* node = find_first(list, lo); node && KEY_LE(node->key, hi); node = node->next[0]) {
+        visited++;
+        if (!callback(node->key, node->data, ctx)) break;
+    }
+    return visited;
+}
+
+/* Move 'cursor' onto 'node' */
+static bool cursor_set(seq_cursor* cursor, seq_node* node) {
+    cursor->node = node;
+    cursor->valid = node != NULL;
+    if (node) {
+        cursor->key = node->key;
+        cursor->data = node->data;
+    }
+    return cursor->valid;
+}
+
+bool seq_skiplist_cursor_seek(seq_list* list, seq_cursor* cursor, skey_t key) {
+    return cursor_set(cursor, find_first(list, key));
+}
+
+bool seq_skiplist_cursor_next(seq_list* list, seq_cursor* cursor) {
+    (void)list;
+    if (!cursor->valid) return false;
+    return cursor_set(cursor, cursor->node->next[0]);
+}
+
 #ifdef DEBUG2
 #include <stdio.h>
 #include <string.h>
@@ -163,7 +452,7 @@ void print_list(seq_list* list) {
     higher level current pointers against its next key. If they match
     print and advance the higher level
   */
-  while (current[0]->next && current[0]->next[0])
+  while (current[0]->next[0])
   {
     /* set the temp buffer and print level 0 */
     int next_key = current[0]->next[0]->key;
@@ -0,0 +1,66 @@
+#include "../inc/thread_slot.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Whether a slot is claimed by a running thread */
+static uint8_t slot_used[THREAD_SLOTS];
+
+/* One more than the highest slot ever claimed */
+static int slots_bound = 0;
+
+/* Slots handed back so far. A thread without one only scans for a
+  slot again once this changed since its last claim */
+static unsigned slots_released = 0;
+
+/* Slot of the calling thread, -1 before its first claim or while it has none */
+static __thread int thread_index = -1;
+static __thread bool thread_claimed = false;
+static __thread unsigned thread_released;
+
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+/* Hand the slot of an exiting thread back, the value is its index + 1 */
+static void release_slot(void* value) {
+    int index = (int)(intptr_t)value - 1;
+    /* whatever the thread left in the slot is visible to the next owner */
+    __atomic_store_n(&slot_used[index], 0, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&slots_released, 1, __ATOMIC_RELAXED);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+static int claim_slot(void) {
+    pthread_once(&slot_key_once, create_slot_key);
+    for (int i = 0; i < THREAD_SLOTS; i++) {
+        uint8_t expected = 0;
+        if (!__atomic_load_n(&slot_used[i], __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&slot_used[i], &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            pthread_setspecific(slot_key, (void*)(intptr_t)(i + 1));
+            int bound = __atomic_load_n(&slots_bound, __ATOMIC_RELAXED);
+            while (bound <= i &&
+                   !__atomic_compare_exchange_n(&slots_bound, &bound, i + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int thread_slot_get(void) {
+    if (thread_index >= 0) return thread_index;
+    unsigned released = __atomic_load_n(&slots_released, __ATOMIC_RELAXED);
+    if (!thread_claimed || released != thread_released) {
+        thread_claimed = true;
+        thread_released = released;
+        thread_index = claim_slot();
+    }
+    return thread_index;
+}
+
+int thread_slot_bound(void) {
+    return __atomic_load_n(&slots_bound, __ATOMIC_RELAXED);
+}
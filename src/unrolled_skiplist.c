@@ -0,0 +1,303 @@
+#include "../inc/unrolled_skiplist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Number of keys in 'keys' smaller than 'key', which is the position
+  of 'key' within the sorted block. Padding slots hold INT_MAX and are
+  never smaller, so the whole block can be compared at once */
+static int block_rank_scalar(const int* keys, int key) {
+    int rank = 0;
+    for (int i = 0; i < UNROLLED_BLOCK; i++) {
+        rank += keys[i] < key;
+    }
+    return rank;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static int block_rank_sse2(const int* keys, int key) {
+    __m128i k = _mm_set1_epi32(key);
+    unsigned mask = 0;
+    for (int i = 0; i < UNROLLED_BLOCK; i += 4) {
+        __m128i block = _mm_load_si128((const __m128i*)(keys + i));
+        mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, block))) << i;
+    }
+    return __builtin_popcount(mask);
+}
+
+__attribute__((target("avx2")))
+static int block_rank_avx2(const int* keys, int key) {
+    __m256i k = _mm256_set1_epi32(key);
+    unsigned mask = 0;
+    for (int i = 0; i < UNROLLED_BLOCK; i += 8) {
+        __m256i block = _mm256_load_si256((const __m256i*)(keys + i));
+        mask |= (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, block))) << i;
+    }
+    return __builtin_popcount(mask);
+}
+#endif
+
+/* Block search picked at init according to the instruction sets of the cpu */
+static int (*block_rank)(const int* keys, int key) = block_rank_scalar;
+
+/* Size of a node with a tower of 'height' next pointers,
+  rounded up so consecutive nodes stay UNROLLED_ALIGN aligned */
+static inline size_t node_size(uint8_t height) {
+    size_t size = sizeof(unrolled_node) + sizeof(unrolled_node*) * height;
+    return ((size + UNROLLED_ALIGN - 1) / UNROLLED_ALIGN) * UNROLLED_ALIGN;
+}
+
+/* Allocate a node without keys and an empty tower of 'height' next pointers */
+static unrolled_node* create_node(uint8_t height) {
+    unrolled_node* node = (unrolled_node*)aligned_alloc(UNROLLED_ALIGN, node_size(height));
+    if (!node) return NULL;
+    for (int i = 0; i < UNROLLED_BLOCK; i++) {
+        node->keys[i] = INT_MAX;
+        node->data[i] = NULL;
+    }
+    memset(node->next, 0, sizeof(unrolled_node*) * height);
+    node->count = 0;
+    node->height = height;
+    return node;
+}
+
+/* Height of a new node, it is present in level i+1 with probability list->prob if it is in level i */
+static uint8_t random_height(unrolled_list* list) {
+    return geometric_height(&list->random_state, list->prob, list->height_shift, list->levels);
+}
+
+unrolled_list* unrolled_skiplist_init(uint8_t levels, double prob, keyrange_t keyrange, long int random_seed) {
+    unrolled_list* skiplist = (unrolled_list*)malloc(sizeof(unrolled_list));
+    if (!skiplist) return NULL;
+    /* add records a predecessor per level on the stack */
+    if (levels > SKIPLIST_MAX_LEVELS) levels = SKIPLIST_MAX_LEVELS;
+    skiplist->levels = levels;
+    skiplist->prob = prob;
+    skiplist->height_shift = height_shift(prob);
+    skiplist->keyrange.min = keyrange.min;
+    skiplist->keyrange.max = keyrange.max;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) block_rank = block_rank_avx2;
+    else if (__builtin_cpu_supports("sse2")) block_rank = block_rank_sse2;
+#endif
+
+    /* Initialize random state */
+    rng_seed(&skiplist->random_state, random_seed);
+
+    /* Create head node */
+    skiplist->head = create_node(skiplist->levels);
+    if (!skiplist->head) return NULL;
+    return skiplist;
+}
+
+size_t unrolled_skiplist_memory(unrolled_list* list, size_t* n_keys) {
+    size_t bytes = 0;
+    size_t keys = 0;
+    for (unrolled_node* current = list->head->next[0]; current; current = current->next[0]) {
+        bytes += node_size(current->height);
+        keys += current->count;
+    }
+    if (n_keys) *n_keys = keys;
+    return bytes;
+}
+
+void unrolled_skiplist_destroy(unrolled_list* list) {
+    unrolled_node* current = list->head;
+    while (current) {
+        unrolled_node* next = current->next[0];
+        free(current);
+        current = next;
+    }
+    free(list);
+}
+
+/* Find the last node in each level whose first key is not larger than 'key'
+  and write them to 'preds'. preds[0] is the only node that may contain 'key',
+  it is the head if 'key' is smaller than every key in the list */
+static unrolled_node* find_predecessors(unrolled_list* list, int key, unrolled_node** preds) {
+    unrolled_node* current = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        unrolled_node* next = current->next[i];
+        while (next && next->keys[0] <= key) {
+            current = next;
+            next = current->next[i];
+        }
+        preds[i] = current;
+    }
+    return current;
+}
+
+/* Last node whose first key is not larger than 'key', the only one that
+  may contain it. The head if 'key' is smaller than every key in the list */
+static unrolled_node* find_node(unrolled_list* list, int key) {
+    unrolled_node* current = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        unrolled_node* next = current->next[i];
+        while (next && next->keys[0] <= key) {
+            current = next;
+            next = current->next[i];
+        }
+    }
+    return current;
+}
+
+/* Remove 'node' whose first key is 'first' from every level it is linked in */
+static void unlink_node(unrolled_list* list, unrolled_node* node, int first) {
+    unrolled_node* current = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        unrolled_node* next = current->next[i];
+        while (next && next != node && next->keys[0] < first) {
+            current = next;
+            next = current->next[i];
+        }
+        if (i < node->height) current->next[i] = node->next[i];
+    }
+}
+
+/* Insert 'key' at position 'pos' of a node that is not full */
+static void block_insert(unrolled_node* node, int pos, int key, void* data) {
+    memmove(&node->keys[pos + 1], &node->keys[pos], sizeof(int) * (node->count - pos));
+    memmove(&node->data[pos + 1], &node->data[pos], sizeof(void*) * (node->count - pos));
+    node->keys[pos] = key;
+    node->data[pos] = data;
+    node->count++;
+}
+
+/* Delete the key at position 'pos' of a node */
+static void block_delete(unrolled_node* node, int pos) {
+    memmove(&node->keys[pos], &node->keys[pos + 1], sizeof(int) * (node->count - pos - 1));
+    memmove(&node->data[pos], &node->data[pos + 1], sizeof(void*) * (node->count - pos - 1));
+    node->count--;
+    node->keys[node->count] = INT_MAX;
+    node->data[node->count] = NULL;
+}
+
+bool unrolled_skiplist_contains(unrolled_list* list, int key, void** data_out) {
+    /* only the bottom predecessor is needed, no need to record the others */
+    unrolled_node* current = find_node(list, key);
+    if (current == list->head) return false;
+
+    int pos = block_rank(current->keys, key);
+    if (pos >= current->count || current->keys[pos] != key) return false;
+    if (data_out) *data_out = current->data[pos];
+    return true;
+}
+
+bool unrolled_skiplist_add(unrolled_list* list, int key, void* data) {
+    if (key < list->keyrange.min || key > list->keyrange.max) return false;
+
+    unrolled_node* preds[SKIPLIST_MAX_LEVELS];
+    unrolled_node* node = find_predecessors(list, key, preds);
+    if (node == list->head) {
+        if (!node->next[0]) {
+            /* Empty list, start the first node */
+            unrolled_node* new_node = create_node(random_height(list));
+            if (!new_node) return false;
+            block_insert(new_node, 0, key, data);
+            for (uint8_t i = 0; i < new_node->height; i++) {
+                new_node->next[i] = preds[i]->next[i];
+                preds[i]->next[i] = new_node;
+            }
+            return true;
+        }
+        /* Smaller than every key, becomes the new first key of the first node */
+        node = node->next[0];
+    }
+
+    int pos = block_rank(node->keys, key);
+    if (pos < node->count && node->keys[pos] == key) return false; /* Key already exists */
+
+    if (node->count == UNROLLED_BLOCK) {
+        /* Split, the upper half moves to a new node right after 'node' */
+        unrolled_node* sibling = create_node(random_height(list));
+        if (!sibling) return false;
+        int half = UNROLLED_BLOCK / 2;
+        memcpy(sibling->keys, &node->keys[half], sizeof(int) * (UNROLLED_BLOCK - half));
+        memcpy(sibling->data, &node->data[half], sizeof(void*) * (UNROLLED_BLOCK - half));
+        sibling->count = UNROLLED_BLOCK - half;
+        for (int i = half; i < UNROLLED_BLOCK; i++) {
+            node->keys[i] = INT_MAX;
+            node->data[i] = NULL;
+        }
+        node->count = half;
+
+        /* 'node' precedes the sibling in every level it is linked in,
+          above that the predecessors of 'key' do */
+        for (uint8_t i = 0; i < sibling->height; i++) {
+            unrolled_node* pred = i < node->height ? node : preds[i];
+            sibling->next[i] = pred->next[i];
+            pred->next[i] = sibling;
+        }
+
+        /* never insert in front of the sibling's first key,
+          it would have to move in the levels above */
+        if (pos > half) {
+            node = sibling;
+            pos -= half;
+        }
+    }
+    block_insert(node, pos, key, data);
+    return true;
+}
+
+bool unrolled_skiplist_remove(unrolled_list* list, int key, void** data_out) {
+    /* the levels above are walked again only if a node has to be unlinked */
+    unrolled_node* node = find_node(list, key);
+    if (node == list->head) return false;
+
+    int pos = block_rank(node->keys, key);
+    if (pos >= node->count || node->keys[pos] != key) return false; /* Key not found */
+
+    if (data_out) *data_out = node->data[pos];
+    int first = node->keys[0];
+    block_delete(node, pos);
+
+    if (node->count == 0) {
+        /* Last key is gone, drop the node */
+        unlink_node(list, node, first);
+        free(node);
+    } else if (node->count <= UNROLLED_BLOCK / 4 && node->next[0] &&
+        node->count + node->next[0]->count <= UNROLLED_BLOCK / 2) {
+        /* Merge the successor into the node, all its keys are larger */
+        unrolled_node* next = node->next[0];
+        memcpy(&node->keys[node->count], next->keys, sizeof(int) * next->count);
+        memcpy(&node->data[node->count], next->data, sizeof(void*) * next->count);
+        node->count += next->count;
+        unlink_node(list, next, next->keys[0]);
+        free(next);
+    }
+    return true;
+}
+
+size_t unrolled_skiplist_range_scan(unrolled_list* list, int lo, int hi, range_callback callback, void* ctx) {
+    /* last node whose first key is not larger than 'lo' */
+    unrolled_node* node = list->head;
+    for (int i = list->levels - 1; i >= 0; i--) {
+        unrolled_node* next = node->next[i];
+        while (next && next->keys[0] <= lo) {
+            node = next;
+            next = node->next[i];
+        }
+    }
+    int pos = 0;
+    if (node == list->head) node = node->next[0];
+    else pos = block_rank(node->keys, lo);
+
+    size_t visited = 0;
+    for (; node; node = node->next[0], pos = 0) {
+        for (; pos < node->count; pos++) {
+            if (node->keys[pos] > hi) return visited;
+            visited++;
+            if (!callback(node->keys[pos], node->data[pos], ctx)) return visited;
+        }
+    }
+    return visited;
+}